@@ -2,8 +2,24 @@
 // Created by alexa on 2022-03-28.
 //
 
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <core/Scene/Scene.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+/// adds parentCount children to the root, each with childCount mesh children. The parents are offset on x
+static void createSyntheticScene(Scene& scene, int parentCount, int childCount) {
+    for (int i = 0; i < parentCount; ++i){
+        int parent = scene.addSceneNode(0, 1, "Parent");
+        scene.setTransform(parent, glm::translate(glm::mat4(1.f), glm::vec3((float)i, 0.f, 0.f)));
+        for (int j = 0; j < childCount; ++j){
+            int child = scene.addSceneNode(parent, 2, "Child");
+            scene.setTransform(child, glm::rotate(glm::mat4(1.f), (float)j, glm::vec3(0.f, 1.f, 0.f)));
+            scene.createMesh(child);
+        }
+    }
+}
 
 TEST_CASE( "Create", "[Scene]" ) {
     Scene scene("test");
@@ -46,3 +62,153 @@ TEST_CASE( "Children", "[Scene]" ){
 }
 
 
+
+TEST_CASE( "Traverse", "[Scene]" ){
+    Scene scene("test");
+    int a = scene.addSceneNode(0, 1, "A");
+    int b = scene.addSceneNode(a, 2, "B");
+    int c = scene.addSceneNode(b, 3, "C");
+    int d = scene.addSceneNode(a, 2, "D");
+    int e = scene.addSceneNode(0, 1, "E");
+
+    // the traversal stays in the subtree
+    std::vector<int> visited;
+    scene.traverse(a, [&visited](int entity){ visited.push_back(entity); });
+    REQUIRE(visited == std::vector<int>{a, b, c, d});
+
+    // a moved node is visited with its new parent
+    scene.reparentSceneNode(e, b);
+    visited.clear();
+    scene.traverse(a, [&visited](int entity){ visited.push_back(entity); });
+    REQUIRE(visited == std::vector<int>{a, b, c, e, d});
+}
+
+TEST_CASE( "RemoveAndReparent", "[Scene]" ){
+    Scene scene("test");
+    int first = scene.addSceneNode(0, 1, "First");
+    int second = scene.addSceneNode(0, 1, "Second");
+    int third = scene.addSceneNode(0, 1, "Third");
+    int grandChild = scene.addSceneNode(second, 2, "Grand child");
+    scene.createMesh(first);
+    scene.createMesh(grandChild);
+    REQUIRE(scene.getHierarchy(0).lastChild == third);
+    REQUIRE(scene.getHierarchy(third).prevSibling == second);
+
+    // removing a node in the middle relinks its siblings, its children are removed as well
+    scene.removeSceneNode(second);
+    REQUIRE_FALSE(scene.isAlive(second));
+    REQUIRE_FALSE(scene.isAlive(grandChild));
+    REQUIRE(scene.getHierarchy(first).nextSibling == third);
+    REQUIRE(scene.getHierarchy(third).prevSibling == first);
+    REQUIRE(scene.getMeshes().size() == 1);
+    REQUIRE(scene.getMesh(first)->meshIndex == 0);
+
+    // the removed ids are recycled
+    int recycled = scene.addSceneNode(third, 2, "Recycled");
+    REQUIRE((recycled == second || recycled == grandChild));
+    REQUIRE(scene.getHierarchy(recycled).parent == third);
+    REQUIRE(scene.getMesh(recycled) == nullptr);
+
+    // the moved subtree follows its new parent
+    scene.setTransform(first, glm::translate(glm::mat4(1.f), glm::vec3(1.f, 0.f, 0.f)));
+    scene.reparentSceneNode(third, first);
+    REQUIRE(scene.getHierarchy(third).level == 2);
+    REQUIRE(scene.getHierarchy(recycled).level == 3);
+    REQUIRE(scene.getHierarchy(0).lastChild == first);
+    REQUIRE(scene.getHierarchy(first).firstChild == third);
+    scene.propagateTransforms();
+    REQUIRE(scene.getTransform(recycled).worldTransform[3] == glm::vec4(1.f, 0.f, 0.f, 1.f));
+
+    // a node can't be moved under its descendants
+    REQUIRE_THROWS(scene.reparentSceneNode(first, recycled));
+}
+
+TEST_CASE( "SparseSet", "[Scene]" ){
+    SparseSet<int> set;
+    set.emplace(3) = 30;
+    set.emplace(7) = 70;
+    set.emplace(1) = 10;
+    REQUIRE(set.size() == 3);
+    REQUIRE(set.contains(7));
+    REQUIRE_FALSE(set.contains(2));
+    REQUIRE_FALSE(set.contains(100));
+
+    // the last component takes the place of the removed one
+    REQUIRE(set.remove(3) == 0);
+    REQUIRE(set.remove(3) == -1);
+    REQUIRE(set.size() == 2);
+    REQUIRE(*set.get(1) == 10);
+    REQUIRE(set.indexOf(1) == 0);
+    REQUIRE(set.getEntities()[0] == 1);
+    REQUIRE(set.get(3) == nullptr);
+}
+
+TEST_CASE( "PropagateTransforms", "[Scene]" ){
+    Scene scene("test");
+    int parent = scene.addSceneNode(0, 1, "Parent");
+    int child = scene.addSceneNode(parent, 2, "Child");
+    scene.createMesh(child);
+
+    // the world transforms are computed level by level
+    scene.setTransform(parent, glm::translate(glm::mat4(1.f), glm::vec3(1.f, 0.f, 0.f)));
+    scene.setTransform(child, glm::translate(glm::mat4(1.f), glm::vec3(0.f, 2.f, 0.f)));
+    scene.propagateTransforms();
+    REQUIRE(scene.getTransform(child).worldTransform[3] == glm::vec4(1.f, 2.f, 0.f, 1.f));
+    REQUIRE(scene.getWorldTransforms(RenderNode::MESH)[0] == scene.getTransform(child).worldTransform);
+
+    // only moving the parent updates the child as well
+    scene.getTransform(parent).position = glm::vec3(3.f, 0.f, 0.f);
+    scene.getTransform(parent).needUpdateModelMatrix = true;
+    scene.setDirtyTransform(parent);
+    scene.propagateTransforms();
+    REQUIRE(scene.getWorldTransforms(RenderNode::MESH)[0][3] == glm::vec4(3.f, 2.f, 0.f, 1.f));
+}
+
+TEST_CASE( "DirtyMeshTransforms", "[Scene]" ){
+    Scene scene("test");
+    int parent = scene.addSceneNode(0, 1, "Parent");
+    int first = scene.addSceneNode(parent, 2, "First");
+    int second = scene.addSceneNode(0, 1, "Second");
+    scene.createMesh(first);
+    scene.createMesh(second);
+
+    // the new meshes are dirty, until cleared by the renderer
+    scene.propagateTransforms();
+    REQUIRE(scene.getDirtyMeshTransforms() == std::vector<uint64_t>{0b11});
+    scene.clearDirtyMeshTransforms();
+    scene.propagateTransforms();
+    REQUIRE(scene.getDirtyMeshTransforms() == std::vector<uint64_t>{0});
+
+    // moving the parent only dirties the mesh of its child
+    scene.setTransform(parent, glm::translate(glm::mat4(1.f), glm::vec3(1.f, 0.f, 0.f)));
+    scene.propagateTransforms();
+    REQUIRE(scene.getDirtyMeshTransforms() == std::vector<uint64_t>{0b01});
+}
+
+TEST_CASE( "ParallelPropagateTransforms", "[Scene]" ){
+    // enough dirty children for the second level to be split in jobs
+    Scene serialScene("serial"), parallelScene("parallel");
+    createSyntheticScene(serialScene, 10, 1000);
+    createSyntheticScene(parallelScene, 10, 1000);
+    serialScene.propagateTransforms(false);
+    parallelScene.propagateTransforms(true);
+
+    REQUIRE(serialScene.getWorldTransforms(RenderNode::MESH) == parallelScene.getWorldTransforms(RenderNode::MESH));
+    REQUIRE(serialScene.getMeshNormalMatrices() == parallelScene.getMeshNormalMatrices());
+}
+
+TEST_CASE( "PropagateTransformsBenchmark", "[!benchmark][Scene]" ){
+    // 100k nodes. Every frame, the whole hierarchy is moved and all the transforms are recomputed
+    Scene scene("benchmark");
+    createSyntheticScene(scene, 100, 1000);
+
+    BENCHMARK("Serial 100k nodes"){
+        scene.setDirtyTransform(0);
+        scene.propagateTransforms(false);
+    };
+
+    BENCHMARK("Parallel 100k nodes"){
+        scene.setDirtyTransform(0);
+        scene.propagateTransforms(true);
+    };
+}
@@ -6,6 +6,14 @@
 #include <core/Utils/UtilsTemplate.h>
 #include <core/Utils/UtilsVulkan.h>
 #include <core/Utils/UtilsMath.h>
+#include <core/Utils/UtilsSimd.h>
+#include <core/Utils/UtilsMesh.h>
+#include <core/Utils/ThreadPool.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <atomic>
+#include <algorithm>
+#include <random>
 
 TEST_CASE( "VectorSizeByte", "[UtilsTemplate]" ) {
     std::vector<int> ok = {1, 2, 3};
@@ -15,6 +23,16 @@ TEST_CASE( "VectorSizeByte", "[UtilsTemplate]" ) {
     REQUIRE(utils::vectorSizeByte(ok) == 0);
 }
 
+TEST_CASE( "SwapRemove", "[UtilsTemplate]" ) {
+    std::vector<int> values = {1, 2, 3, 4};
+    utils::swapRemove(values, 1);
+    REQUIRE(values == std::vector<int>{1, 4, 3});
+
+    // the last element is simply removed
+    utils::swapRemove(values, 2);
+    REQUIRE(values == std::vector<int>{1, 4});
+}
+
 TEST_CASE( "Almost Equal", "[UtilsMath]") {
     float a = 4.01f;
     float b = 5.03f;
@@ -48,3 +66,233 @@ TEST_CASE( "IsFeaturesSupported", "[UtilsVulkan]") {
     REQUIRE(utils::isFeaturesSupported({VK_TRUE, VK_TRUE, VK_TRUE}, {VK_FALSE, VK_FALSE, VK_TRUE, VK_FALSE, VK_FALSE}));
     REQUIRE(utils::isFeaturesSupported({}, {}));
 }
+
+TEST_CASE( "ParallelFor", "[ThreadPool]") {
+    ThreadPool pool(3);
+
+    // every index is processed exactly once
+    std::vector<std::atomic<int>> calls(1000);
+    pool.parallelFor(calls.size(), [&](uint32_t i){ ++calls[i]; });
+    for (auto& count : calls)
+        REQUIRE(count == 1);
+
+    // nested parallel for from a worker does not deadlock
+    std::atomic<int> total = 0;
+    auto future = pool.submit([&](){
+        pool.parallelFor(100, [&](uint32_t){ ++total; });
+        return total.load();
+    });
+    REQUIRE(future.get() == 100);
+
+    // exceptions are rethrown on the calling thread
+    REQUIRE_THROWS(pool.parallelFor(10, [](uint32_t i){
+        if (i == 5)
+            throw std::runtime_error("failed");
+    }));
+}
+
+TEST_CASE( "FrustumPlanes", "[UtilsMath]") {
+    glm::mat4 projection = glm::perspective(glm::radians(90.f), 1.f, 0.1f, 100.f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+    std::array<glm::vec4, 6> planes = utils::getFrustumPlanes(projection * view);
+
+    auto isInside = [&planes](const glm::vec3& point){
+        for (auto& plane : planes){
+            if (glm::dot(glm::vec3(plane), point) + plane.w < 0.f)
+                return false;
+        }
+        return true;
+    };
+    REQUIRE(isInside(glm::vec3(0.f, 0.f, -10.f)));
+    REQUIRE(isInside(glm::vec3(9.f, -9.f, -10.f)));
+    REQUIRE_FALSE(isInside(glm::vec3(11.f, 0.f, -10.f)));  // right of the frustum
+    REQUIRE_FALSE(isInside(glm::vec3(0.f, 0.f, 10.f)));    // behind the camera
+    REQUIRE_FALSE(isInside(glm::vec3(0.f, 0.f, -0.05f)));  // before the near plane
+    REQUIRE_FALSE(isInside(glm::vec3(0.f, 0.f, -101.f)));  // after the far plane
+
+    // the planes are normalized, the near plane is at 0.1 of the origin
+    REQUIRE(std::abs(planes[4].w + 0.1f) < 1e-4f);
+}
+
+TEST_CASE( "NormalMatrix", "[UtilsMath]") {
+    // the transformed normal stays perpendicular to the transformed surface under non uniform scale
+    glm::mat4 model = utils::calculateModelMatrix(glm::vec3(1.f, 2.f, 3.f), glm::vec3(3.f, 1.f, 0.5f), glm::vec3(0.3f, 0.5f, 0.f));
+    glm::mat3 normalMatrix = glm::mat3(utils::calculateNormalMatrix(model));
+
+    glm::vec3 tangent = glm::mat3(model) * glm::vec3(1.f, -1.f, 0.f);
+    glm::vec3 normal = normalMatrix * glm::vec3(1.f, 1.f, 0.f);
+    REQUIRE(std::abs(glm::dot(tangent, normal)) < 1e-4f);
+
+    // the padding of the columns is 0
+    glm::mat3x4 padded = utils::calculateNormalMatrix(model);
+    REQUIRE(padded[0].w == 0.f);
+    REQUIRE(padded[2].w == 0.f);
+}
+
+TEST_CASE( "SimdTransforms", "[UtilsSimd]") {
+    // odd count, the last transforms don't fill a vector
+    constexpr uint32_t count = 13;
+    std::vector<glm::vec3> positions, rotations, scales;
+    std::vector<glm::mat4> parents;
+    for (uint32_t i = 0; i < count; ++i){
+        float f = (float)i;
+        positions.emplace_back(f, -2.f * f, 0.5f);
+        rotations.emplace_back(0.1f * f, -0.3f * f, 0.7f);
+        scales.emplace_back(1.f + f, 0.5f, 2.f);
+        parents.push_back(utils::calculateModelMatrix(glm::vec3(f), glm::vec3(2.f), glm::vec3(0.2f * f)));
+    }
+
+    auto almostEqual = [](const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b){
+        for (uint32_t i = 0; i < a.size(); ++i){
+            for (int c = 0; c < 4; ++c){
+                for (int r = 0; r < 4; ++r){
+                    if (std::abs(a[i][c][r] - b[i][c][r]) > 1e-4f * std::max(1.f, std::abs(b[i][c][r])))
+                        return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    // every supported instruction set gives the scalar results
+    std::vector<glm::mat4> expectedLocals(count), expectedWorlds(count);
+    for (uint32_t i = 0; i < count; ++i){
+        expectedLocals[i] = utils::calculateModelMatrix(positions[i], scales[i], rotations[i]);
+        expectedWorlds[i] = parents[i] * expectedLocals[i];
+    }
+    for (int level = 0; level <= (int)utils::getSimdLevel(); ++level){
+        std::vector<glm::mat4> transforms(count);
+        utils::composeTransforms(positions.data(), rotations.data(), scales.data(), transforms.data(), count,
+                                 (utils::SimdLevel)level);
+        REQUIRE(almostEqual(transforms, expectedLocals));
+
+        // the results can alias the children
+        utils::multiplyTransforms(parents.data(), transforms.data(), transforms.data(), count, (utils::SimdLevel)level);
+        REQUIRE(almostEqual(transforms, expectedWorlds));
+    }
+}
+
+TEST_CASE( "MeshOptimization", "[UtilsMesh]") {
+    // grid of quads, with its triangles shuffled
+    constexpr uint32_t SIZE = 64;
+    std::vector<glm::vec3> positions;
+    for (uint32_t y = 0; y <= SIZE; ++y)
+        for (uint32_t x = 0; x <= SIZE; ++x)
+            positions.emplace_back((float)x, (float)y, 0.f);
+    std::vector<std::array<uint32_t, 3>> triangles;
+    for (uint32_t y = 0; y < SIZE; ++y){
+        for (uint32_t x = 0; x < SIZE; ++x){
+            uint32_t corner = y * (SIZE + 1) + x;
+            triangles.push_back({corner, corner + 1, corner + SIZE + 1});
+            triangles.push_back({corner + 1, corner + SIZE + 2, corner + SIZE + 1});
+        }
+    }
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(42));
+    std::vector<uint32_t> indices;
+    for (auto& triangle : triangles)
+        indices.insert(indices.end(), triangle.begin(), triangle.end());
+    uint32_t vertexCount = positions.size();
+
+    // triangles with their smallest index first, sorted. The optimizations must keep the same triangles and winding
+    auto getSortedTriangles = [](const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions){
+        std::vector<std::array<float, 9>> sorted;
+        for (uint32_t i = 0; i < indices.size(); i += 3){
+            uint32_t first = i + std::min_element(indices.begin() + i, indices.begin() + i + 3) - (indices.begin() + i);
+            std::array<float, 9> triangle{};
+            for (uint32_t k = 0; k < 3; ++k){
+                const glm::vec3& position = positions[indices[i + (first - i + k) % 3]];
+                triangle[k * 3] = position.x;
+                triangle[k * 3 + 1] = position.y;
+                triangle[k * 3 + 2] = position.z;
+            }
+            sorted.push_back(triangle);
+        }
+        std::sort(sorted.begin(), sorted.end());
+        return sorted;
+    };
+    auto expectedTriangles = getSortedTriangles(indices, positions);
+
+    utils::VertexCacheStatistics before = utils::analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+    utils::optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+    utils::optimizeOverdraw(indices.data(), indices.size(), positions.data(), vertexCount);
+    REQUIRE(utils::optimizeVertexFetch(positions.data(), indices.data(), indices.size(), vertexCount, sizeof(glm::vec3)) == vertexCount);
+    utils::VertexCacheStatistics after = utils::analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+
+    REQUIRE(getSortedTriangles(indices, positions) == expectedTriangles);
+    REQUIRE(before.acmr > 2.5f);
+    REQUIRE(after.acmr < 0.8f);
+    REQUIRE(after.atvr < 1.5f);
+
+    // the vertices are in the order of their first use
+    uint32_t nextVertex = 0;
+    for (uint32_t index : indices){
+        REQUIRE(index <= nextVertex);
+        if (index == nextVertex)
+            ++nextVertex;
+    }
+}
+
+TEST_CASE( "PackedVertex", "[UtilsMesh]") {
+    glm::vec4 bounds(1.f, -2.f, 3.f, 10.f);
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+    for (uint32_t i = 0; i < 1000; ++i){
+        glm::vec3 position = glm::vec3(bounds) + glm::vec3(distribution(generator), distribution(generator),
+                                                           distribution(generator)) * bounds.w * 0.5f;
+        glm::vec3 normal = glm::normalize(glm::vec3(distribution(generator), distribution(generator), distribution(generator)));
+        glm::vec2 uv(distribution(generator), distribution(generator));
+
+        glm::vec3 unpackedPosition, unpackedNormal;
+        glm::vec2 unpackedUv;
+        utils::unpackVertex(utils::packVertex(position, normal, uv, bounds), bounds, unpackedPosition, unpackedNormal, unpackedUv);
+
+        // 16 bits over the bounding cube, the normals on 2 x 16 bits
+        REQUIRE(glm::distance(position, unpackedPosition) < bounds.w * 1e-4f);
+        REQUIRE(glm::dot(normal, unpackedNormal) > 0.9999f);
+        REQUIRE(glm::distance(uv, unpackedUv) < 1e-3f);
+    }
+}
+
+TEST_CASE( "SimplifyMesh", "[UtilsMesh]") {
+    // flat grid of quads, its border can't move
+    constexpr uint32_t SIZE = 32;
+    std::vector<glm::vec3> positions;
+    for (uint32_t y = 0; y <= SIZE; ++y)
+        for (uint32_t x = 0; x <= SIZE; ++x)
+            positions.emplace_back((float)x, (float)y, 0.f);
+    std::vector<uint32_t> indices;
+    for (uint32_t y = 0; y < SIZE; ++y){
+        for (uint32_t x = 0; x < SIZE; ++x){
+            uint32_t corner = y * (SIZE + 1) + x;
+            indices.insert(indices.end(), {corner, corner + 1, corner + SIZE + 1, corner + 1, corner + SIZE + 2, corner + SIZE + 1});
+        }
+    }
+    uint32_t vertexCount = positions.size();
+    auto getArea = [&positions](const std::vector<uint32_t>& indices, uint32_t indexCount){
+        float area = 0.f;
+        for (uint32_t i = 0; i < indexCount; i += 3){
+            glm::vec3 normal = glm::cross(positions[indices[i + 1]] - positions[indices[i]], positions[indices[i + 2]] - positions[indices[i]]);
+            REQUIRE(normal.z > 0.f);
+            area += normal.z * 0.5f;
+        }
+        return area;
+    };
+
+    // the plane is kept exactly, without flipped triangles
+    std::vector<uint32_t> simplified(indices.size());
+    float error;
+    uint32_t indexCount = utils::simplifyMesh(simplified.data(), indices.data(), indices.size(), positions.data(),
+                                              vertexCount, indices.size() / 4, 1.f, error);
+    REQUIRE(indexCount <= indices.size() / 4);
+    REQUIRE(indexCount % 3 == 0);
+    REQUIRE(error < 1e-4f);
+    REQUIRE(std::abs(getArea(simplified, indexCount) - (float)(SIZE * SIZE)) < 1e-2f);
+
+    // a bumpy grid can't be simplified within a tiny error
+    for (glm::vec3& position : positions)
+        position.z = std::sin(position.x) * std::cos(position.y);
+    indexCount = utils::simplifyMesh(simplified.data(), indices.data(), indices.size(), positions.data(), vertexCount,
+                                     indices.size() / 4, 1e-3f, error);
+    REQUIRE(indexCount > indices.size() / 2);
+    REQUIRE(error <= 1e-3f);
+}
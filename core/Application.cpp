@@ -64,8 +64,8 @@ bool Application::init(){
     //no openGL nor openGL es
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-    // complex for now
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    // the renderer recreates the swapchain on resize, the pipelines use a dynamic viewport
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
     // create window and make sure it's successful
     _window = glfwCreateWindow(_windowData.width, _windowData.height, "Reborn", nullptr, nullptr);
@@ -148,14 +148,16 @@ bool Application::init(){
         SPDLOG_ERROR("GLFW error {}", description);
     });
 
-    // TODO : renable when pipeline can support window resize!
-//    glfwSetWindowSizeCallback(_window, [](GLFWwindow* window, int width, int height){
-//        WindowData* data = (WindowData*) glfwGetWindowUserPointer(window);
-//        data->width = width;
-//        data->height = height;
-//        WindowResizeEvent e(width, height);
-//        data->eventCallback(e);
-//    });
+    glfwSetWindowSizeCallback(_window, [](GLFWwindow* window, int width, int height){
+        // a minimized window has a null size, the renderer waits until it is restored
+        if (width == 0 || height == 0)
+            return;
+        WindowData* data = (WindowData*) glfwGetWindowUserPointer(window);
+        data->width = width;
+        data->height = height;
+        WindowResizeEvent e(width, height);
+        data->eventCallback(e);
+    });
 
     //setVSync(true);
     return true;
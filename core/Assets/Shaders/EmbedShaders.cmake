@@ -0,0 +1,68 @@
+# Generates OUTPUT, a header embedding every SPIR-V file of SPIRV_DIR. Run in script mode :
+# cmake -DSPIRV_DIR=<dir> -DSOURCE_DIR=<dir> -DOUTPUT=<header> -P EmbedShaders.cmake
+# Every "<name>.spv" literal of the sources of SOURCE_DIR must name a file of SPIRV_DIR, with the same case : the
+# embedded shaders are looked up by exact name, a missing one would only fail when its pipeline is created
+
+cmake_minimum_required(VERSION 3.20)
+
+file(GLOB SPIRV_FILES "${SPIRV_DIR}/*.spv")
+list(SORT SPIRV_FILES)
+
+set(SPIRV_NAMES "")
+foreach(SPIRV_FILE ${SPIRV_FILES})
+    get_filename_component(SPIRV_NAME ${SPIRV_FILE} NAME)
+    list(APPEND SPIRV_NAMES ${SPIRV_NAME})
+endforeach()
+
+if (DEFINED SOURCE_DIR)
+    file(GLOB_RECURSE SOURCE_FILES "${SOURCE_DIR}/*.cpp" "${SOURCE_DIR}/*.h")
+    foreach(SOURCE_FILE ${SOURCE_FILES})
+        file(STRINGS ${SOURCE_FILE} SOURCE_LINES REGEX "\"[A-Za-z0-9_]+\\.spv\"")
+        foreach(SOURCE_LINE ${SOURCE_LINES})
+            string(REGEX MATCHALL "\"[A-Za-z0-9_]+\\.spv\"" REQUESTED_NAMES "${SOURCE_LINE}")
+            foreach(REQUESTED_NAME ${REQUESTED_NAMES})
+                string(REPLACE "\"" "" REQUESTED_NAME ${REQUESTED_NAME})
+                if (NOT REQUESTED_NAME IN_LIST SPIRV_NAMES)
+                    message(FATAL_ERROR "${SOURCE_FILE} requests ${REQUESTED_NAME}, which is not in ${SPIRV_DIR}")
+                endif()
+            endforeach()
+        endforeach()
+    endforeach()
+endif()
+
+set(ARRAYS "")
+set(TABLE "")
+set(INDEX 0)
+foreach(SPIRV_FILE ${SPIRV_FILES})
+    get_filename_component(SPIRV_NAME ${SPIRV_FILE} NAME)
+    file(READ ${SPIRV_FILE} SPIRV_HEX HEX)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," SPIRV_BYTES "${SPIRV_HEX}")
+    string(APPEND ARRAYS "    alignas(uint32_t) constexpr unsigned char SHADER_${INDEX}[] = {${SPIRV_BYTES}};\n")
+    string(APPEND TABLE "            EmbeddedShader{\"${SPIRV_NAME}\", SHADER_${INDEX}, sizeof(SHADER_${INDEX})},\n")
+    math(EXPR INDEX "${INDEX} + 1")
+endforeach()
+
+file(WRITE "${OUTPUT}.tmp"
+"// generated by EmbedShaders.cmake from the SPIR-V directory, do not edit
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace embedded_shaders {
+    struct EmbeddedShader {
+        std::string_view name;      ///< file name, e.g. multiV.spv
+        const unsigned char* code;  ///< SPIR-V words
+        size_t size;                ///< in bytes
+    };
+
+${ARRAYS}
+    constexpr std::array<EmbeddedShader, ${INDEX}> SHADERS = {
+${TABLE}    };
+}
+")
+# only touch the header when the content changed, the dependent files are not rebuilt otherwise
+configure_file("${OUTPUT}.tmp" "${OUTPUT}" COPYONLY)
+file(REMOVE "${OUTPUT}.tmp")
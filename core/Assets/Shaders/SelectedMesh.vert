@@ -1,5 +1,14 @@
 #version 460
 
+// true if drawn with vkCmdDrawIndexed, gl_VertexIndex is then the vertex index read from the index buffer
+layout(constant_id = 0) const bool INDEXED_DRAW = false;
+
+// true if the vertices are PackedVertex, quantized in the bounds of their mesh
+layout(constant_id = 1) const bool PACKED_VERTICES = false;
+
+// true if the indices are 16 bits, relative to the vertex offset of their mesh like the 32 bits ones
+layout(constant_id = 2) const bool SHORT_INDICES = false;
+
 layout(binding = 0) uniform Uniform{
     mat4 vp;
 };
@@ -16,10 +25,22 @@ struct Vertex{
     float v;
 };
 
+// must match utils::PackedVertex. Only the position is decoded
+struct PackedVertex{
+    uint positionXY;
+    uint positionZ;
+    uint normal;
+    uint uv;
+};
+
 layout(binding = 1) readonly buffer Vertices{
     Vertex vertices[];
 };
 
+layout(binding = 1) readonly buffer PackedVertices{
+    PackedVertex packedVertices[];
+};
+
 layout(binding = 2) readonly buffer Indices{
     uint indices[];
 };
@@ -28,15 +49,40 @@ layout(binding = 3) readonly buffer Transforms{
     mat4 transforms[];
 };
 
+// bounding sphere of each mesh (center xyz, radius w), the packed positions are relative to it
+layout(binding = 4) readonly buffer MeshBounds{
+    vec4 meshBounds[];
+};
+
+// must match SelectedMeshLayer::MeshPush
 layout(push_constant) uniform PC {
     float factor;
+    uint vertexOffset;  // first vertex of the mesh, the indices are relative to it
 };
 
+// reads the index pulled by the non indexed draws. The 16 bits indices are packed by pairs in the uints
+uint readIndex(uint i){
+    if (!SHORT_INDICES)
+        return indices[i];
+    uint pair = indices[i >> 1];
+    return (i & 1u) != 0u ? pair >> 16 : pair & 0xFFFFu;
+}
+
 void main(){
     // get vertex using PVP
-    uint idx = indices[gl_VertexIndex];
-    Vertex vtx = vertices[idx];
+    uint idx = INDEXED_DRAW ? gl_VertexIndex : vertexOffset + readIndex(gl_VertexIndex);
+    vec3 position;
+    if (PACKED_VERTICES){
+        PackedVertex vtx = packedVertices[idx];
+        vec4 bounds = meshBounds[gl_InstanceIndex];
+        vec3 unorm = vec3(unpackUnorm2x16(vtx.positionXY), unpackUnorm2x16(vtx.positionZ).x);
+        position = bounds.xyz + (unorm * 2.0 - 1.0) * bounds.w;
+    }
+    else {
+        Vertex vtx = vertices[idx];
+        position = vec3(vtx.x, vtx.y, vtx.z);
+    }
 
     // calculate position using factor and instance index
-    gl_Position = vp * transforms[gl_InstanceIndex] * vec4(vtx.x * factor, vtx.y * factor, vtx.z * factor, 1.0);
+    gl_Position = vp * transforms[gl_InstanceIndex] * vec4(position * factor, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1 @@
+C:\VulkanSDK\1.3.204.1\Bin\glslc.exe %1.comp -o SPIR-V\%1C.spv
\ No newline at end of file
@@ -5,6 +5,15 @@ layout(location = 1) out vec3 normal;
 layout(location = 2) out vec3 worldPos;
 layout(location = 3) out flat uint materialIndex;
 
+// true if drawn with vkCmdDrawIndexed*, gl_VertexIndex is then the vertex index read from the index buffer
+layout(constant_id = 0) const bool INDEXED_DRAW = false;
+
+// true if the vertices are PackedVertex, quantized in the bounds of their mesh
+layout(constant_id = 1) const bool PACKED_VERTICES = false;
+
+// true if the indices are 16 bits, relative to the vertex offset of their mesh like the 32 bits ones
+layout(constant_id = 2) const bool SHORT_INDICES = false;
+
 layout(binding = 0) uniform UniformBuffer{
     mat4 vp;
 } ubo;
@@ -20,10 +29,22 @@ struct Vertex{
     float v;
 };
 
+// must match utils::PackedVertex
+struct PackedVertex{
+    uint positionXY;    // unorm 16 bits, in the bounding cube of the mesh
+    uint positionZ;
+    uint normal;        // octahedral, snorm 16 bits
+    uint uv;            // half floats
+};
+
 layout(binding = 1) readonly buffer Vertices{
     Vertex vertices[];
 };
 
+layout(binding = 1) readonly buffer PackedVertices{
+    PackedVertex packedVertices[];
+};
+
 layout(binding = 2) readonly buffer Indices{
     uint indices[];
 };
@@ -32,26 +53,71 @@ layout(binding = 3) readonly buffer Xforms{
     mat4 transforms[];
 };
 
-layout(binding = 4) readonly buffer MaterialIndices{
-    uint materialIndices[];
+// must match MultiMeshLayer::MeshMetadata
+struct MeshMetadata{
+    uint materialIndex;
+    uint vertexOffset;  // first vertex of the mesh, the indices are relative to it
+};
+
+layout(binding = 4) readonly buffer Metadata{
+    MeshMetadata meshMetadata[];
+};
+
+// inverse transpose of the model, computed on the CPU when the transform changes
+layout(binding = 6) readonly buffer NormalMatrices{
+    mat3 normalMatrices[];
+};
+
+// bounding sphere of each mesh (center xyz, radius w), the packed positions are relative to it
+layout(binding = 7) readonly buffer MeshBounds{
+    vec4 meshBounds[];
 };
 
+// reads the index pulled by the non indexed draws. The 16 bits indices are packed by pairs in the uints
+uint readIndex(uint i){
+    if (!SHORT_INDICES)
+        return indices[i];
+    uint pair = indices[i >> 1];
+    return (i & 1u) != 0u ? pair >> 16 : pair & 0xFFFFu;
+}
+
+// decodes the normal folded on the [-1, 1] square (see utils::PackedVertex)
+vec3 decodeOctahedral(vec2 e){
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main() {
-    // get vertex using PVP
-    uint idx = indices[gl_VertexIndex];
-    Vertex vertex = vertices[idx];
+    // get vertex using PVP. Indexed draws let the post transform cache reuse the shared vertices
+    // (the vertex offset of the mesh is already added to gl_VertexIndex by indexed draws)
+    uint idx = INDEXED_DRAW ? gl_VertexIndex : meshMetadata[gl_BaseInstance].vertexOffset + readIndex(gl_VertexIndex);
+    vec3 position;
+    vec3 vertexNormal;
+    if (PACKED_VERTICES){
+        PackedVertex vertex = packedVertices[idx];
+        vec4 bounds = meshBounds[gl_BaseInstance];
+        vec3 unorm = vec3(unpackUnorm2x16(vertex.positionXY), unpackUnorm2x16(vertex.positionZ).x);
+        position = bounds.xyz + (unorm * 2.0 - 1.0) * bounds.w;
+        vertexNormal = decodeOctahedral(unpackSnorm2x16(vertex.normal));
+        uv = unpackHalf2x16(vertex.uv);
+    }
+    else {
+        Vertex vertex = vertices[idx];
+        position = vec3(vertex.x, vertex.y, vertex.z);
+        vertexNormal = vec3(vertex.nx, vertex.ny, vertex.nz);
+        uv = vec2(vertex.u, vertex.v);
+    }
 
     // get model transform using baseInstance (defined in VK_DRAW_INDIRECT)
     mat4 model = transforms[gl_BaseInstance];
-    materialIndex = materialIndices[gl_BaseInstance];
+    materialIndex = meshMetadata[gl_BaseInstance].materialIndex;
 
     // calculate normal (transpose + inverse for non uniform scale)
-    // mat3 test = inverse(transpose(mat3(model))); // Is this better ??
-    mat3 normalMatrix = mat3(transpose(inverse(model)));
-    normal = normalMatrix * vec3(vertex.nx, vertex.ny, vertex.nz);
-
-    // calculate tex coords + vertex pos
-    uv = vec2(vertex.u, vertex.v);
-    worldPos = vec3(model * vec4(vertex.x, vertex.y, vertex.z, 1.0));
-    gl_Position = ubo.vp * model * vec4(vertex.x, vertex.y, vertex.z, 1.0);
+    normal = normalMatrices[gl_BaseInstance] * vertexNormal;
+
+    // calculate vertex pos
+    worldPos = vec3(model * vec4(position, 1.0));
+    gl_Position = ubo.vp * model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <typeinfo>
+#include <algorithm>
 
 class FPSCounter{
 public:
@@ -15,6 +16,11 @@ public:
             // calculate current fps
             _currentFPS = (float)_numFrames / _accumulatedTime;
 
+            // calculate the time the cpu spent blocked on the gpu. The rest of the frame is overlapped with gpu work
+            _fenceWaitTime = _numFrames > 0 ? _accumulatedFenceWait / (float)_numFrames : 0.f;
+            _overlap = 1.f - std::min(_accumulatedFenceWait / _accumulatedTime, 1.f);
+            _accumulatedFenceWait = 0.f;
+
             // calculate average fps
             _totalTime += _accumulatedTime;
             _totalFrames += _numFrames;
@@ -30,6 +36,11 @@ public:
     float getFPS(){ return _currentFPS; }
     float getAverageFPS() { return _averageFPS; }
 
+    /// time (in seconds) the cpu spent waiting on fences during the current frame
+    void addFenceWaitTime(float waitTime) { _accumulatedFenceWait += waitTime; }
+    float getFenceWaitTime() { return _fenceWaitTime; }  ///< average fence wait per frame (in seconds) during last interval
+    float getOverlap() { return _overlap; }              ///< fraction of the last interval the cpu was not blocked by the gpu
+
 private:
     float _interval = 0.f;
 
@@ -38,6 +49,11 @@ private:
     float _accumulatedTime = 0.f;
     float _currentFPS = 0.f;
 
+    // used for cpu/gpu overlap
+    float _accumulatedFenceWait = 0.f;
+    float _fenceWaitTime = 0.f;
+    float _overlap = 0.f;
+
     // used for average fps
     uint32_t _totalFrames = 0;
     float _totalTime = 0.f;
@@ -3,11 +3,82 @@
 //
 
 #include "FactoryModel.h"
+#include "../../Utils/ThreadPool.h"
+#include "../../Utils/UtilsMesh.h"
 
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <assimp/Importer.hpp>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+
+// Layout of a cooked file. All sections start on a 16 bytes boundary, their offsets are relative to the file start
+namespace {
+    constexpr uint32_t COOKED_MAGIC = 0x4B4F4F43; // "COOK"
+    constexpr uint32_t COOKED_VERSION = 5;        ///< increment when the layout of the file (or of a cooked struct) changes,
+                                                  ///< or when the geometry is processed differently
+    constexpr uint64_t COOKED_ALIGNMENT = 16;
+
+    struct CookedHeader {
+        uint32_t magic = COOKED_MAGIC;
+        uint32_t version = COOKED_VERSION;
+        uint32_t vertexSize = sizeof(Vertex);   ///< the cooked vertices are used as is
+        uint32_t nodeCount = 0;
+        uint32_t meshCount = 0;
+        uint32_t materialCount = 0;
+        uint64_t vertexCount = 0;
+        uint64_t indexCount = 0;
+        uint64_t stringsSize = 0;
+        int64_t sourceWriteTime = 0;            ///< the cooked file is outdated if the source file changed
+        uint64_t sourceSize = 0;
+
+        uint64_t nodesOffset = 0;
+        uint64_t meshesOffset = 0;
+        uint64_t materialsOffset = 0;
+        uint64_t materialNamesOffset = 0;
+        uint64_t verticesOffset = 0;
+        uint64_t indicesOffset = 0;
+        uint64_t stringsOffset = 0;
+    };
+
+    /// range in the strings section
+    struct CookedString {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+    };
+
+    struct CookedNode {
+        glm::mat4 transform;
+        int32_t parent;
+        int32_t mesh;
+        CookedString name;
+    };
+
+    struct CookedMesh {
+        glm::vec4 boundingSphere;
+        uint32_t firstVertex;
+        uint32_t vertexCount;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t materialIndex;
+        CookedString name;
+        uint32_t lodCount;
+        MeshLod lods[MAX_MESH_LODS];
+    };
 
+    /// write time and size of the source file, both 0 if the file does not exist
+    std::pair<int64_t, uint64_t> getSourceStamp(const std::string& path) {
+        std::error_code error;
+        auto writeTime = std::filesystem::last_write_time(path, error);
+        if (error)
+            return {0, 0};
+        uint64_t size = std::filesystem::file_size(path, error);
+        return {(int64_t)writeTime.time_since_epoch().count(), error ? 0 : size};
+    }
+}
 
 
 bool FactoryModel::createDuckModel(std::vector<TexVertex>& vertices, std::vector<uint32_t>& indices) {
@@ -68,118 +139,206 @@ bool FactoryModel::createTexturedSquare2(std::vector<TexVertex2>& vertices) {
 }
 
 
-void FactoryModel::importFromFile(const std::string& path, std::shared_ptr<Scene> scene) {
-    Assimp::Importer importer;
+std::shared_ptr<ImportedModel> FactoryModel::loadFromFile(const std::string& path) {
+    // use the cooked file if it is up to date
+    std::string cookedPath = path + COOKED_EXTENSION;
+    std::shared_ptr<ImportedModel> model = loadCooked(cookedPath, path);
+    if (model != nullptr)
+        return model;
+
+    // import with assimp and cook the result for the next runs
+    model = importWithAssimp(path);
+    if (!writeCooked(cookedPath, path, *model))
+        SPDLOG_WARN("Failed to cook {}", path);
+    return model;
+}
+
+std::future<std::shared_ptr<ImportedModel>> FactoryModel::loadFromFileAsync(const std::string& path) {
+    return ThreadPool::global().submit([path](){ return loadFromFile(path); });
+}
+
+int FactoryModel::addToScene(const ImportedModel& model, const std::shared_ptr<Scene>& scene) {
     if (scene == nullptr)
         throw std::runtime_error("Scene is null");
 
-    // Note : assimp winding order is by default counterclockwise
-    _aiScene = importer.ReadFile(path, aiProcess_Triangulate
-                                       | aiProcess_JoinIdenticalVertices // without this, index buffer is useless
-                                       | aiProcess_GenNormals            // generate normals if not already in model
-                                       // TODO : add flags from rendering coockbook!! or other!
-    );
+    // index of the first material of the model. Relevant if importing multiple models in a scene
+    uint32_t firstMaterialIndex = scene->_materials.size();
+
+    // append the geometry of the model. The indices are relative to their mesh, they are copied as is
+    uint32_t firstVertex = scene->_vertices.size();
+    uint32_t firstIndex = scene->_indices.size();
+    scene->_vertices.insert(scene->_vertices.end(), model.vertices.begin(), model.vertices.end());
+    scene->_indices.insert(scene->_indices.end(), model.indices.begin(), model.indices.end());
+
+    // create the entities, parents are created before their children
+    std::vector<int> entities(model.nodes.size());
+    for (uint32_t i = 0; i < model.nodes.size(); ++i){
+        const auto& node = model.nodes[i];
+        int parentEntity = node.parent == -1 ? 0 : entities[node.parent];
+        entities[i] = scene->addSceneNode(parentEntity, scene->getHierarchy(parentEntity).level + 1, node.name);
+
+        if (node.mesh == -1){
+            scene->setTransform(entities[i], node.transform);
+            continue;
+        }
 
-    // TODO : prob want to remove this
-    if (_aiScene == nullptr || _aiScene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !_aiScene->mRootNode){
-        throw std::exception(importer.GetErrorString());
-        return;
+        // mesh nodes reference the geometry of their mesh
+        const auto& mesh = model.meshes[node.mesh];
+        MeshComponent& mc = scene->createMesh(entities[i]);
+        mc.materialIndex = firstMaterialIndex + mesh.materialIndex;
+        mc.boundingSphere = mesh.boundingSphere;
+        mc.firstVertexIndex = firstIndex + mesh.firstIndex;
+        mc.indexCount = mesh.indexCount;
+        mc.vertexOffset = firstVertex + mesh.firstVertex;
+        mc.vertexCount = mesh.vertexCount;
+        mc.lodCount = mesh.lodCount;
+        for (uint32_t j = 0; j < mesh.lodCount; ++j)
+            mc.lods[j] = {firstIndex + mesh.lods[j].firstIndex, mesh.lods[j].indexCount, mesh.lods[j].error};
     }
 
-    SPDLOG_INFO("Num meshes {}", _aiScene->mNumMeshes);
-    _filePath = path;
-    _firstMaterialIndex = scene->_materials.size();
+    // add all materials and their names to the scene
+    scene->_materials.insert(scene->_materials.end(), model.materials.begin(), model.materials.end());
+    scene->_materialsNames.insert(scene->_materialsNames.end(), model.materialNames.begin(), model.materialNames.end());
 
-    traverseNodeRecursive(_aiScene->mRootNode, -1, 1, scene);
-    scene->setDirtyTransform(0);
+    int rootEntity = entities.empty() ? -1 : entities[0];
+    scene->setDirtyTransform(rootEntity);
 
     SPDLOG_INFO("Num vertices {}", scene->_vertices.size());
-    SPDLOG_INFO("Max index {}", *std::max_element(scene->_indices.begin(), scene->_indices.end()));
-
-    // add all materials to scene
-    for (uint32_t i = 0; i < _aiScene->mNumMaterials; ++i){
-        Material material{};
-        aiMaterial* aiMaterial = _aiScene->mMaterials[i];
-
-        // get name of material
-        aiString name;
-        std::string matName = "No name :(";
-        if (aiMaterial->Get(AI_MATKEY_NAME, name) == AI_SUCCESS) {
-            matName = name.C_Str();
-            SPDLOG_INFO("Material Name {}", matName);
-        }
+    return rootEntity;
+}
 
-        aiColor3D output{};
+void FactoryModel::importFromFile(const std::string& path, std::shared_ptr<Scene> scene) {
+    addToScene(*loadFromFile(path), scene);
+}
 
-        // the ambient color corresponds to the max between MIN_AMBIENT, ambient and emmisive
-        material.ambientColor = MATERIAL_MIN_AMBIENT;
-        if (aiMaterial->Get(AI_MATKEY_COLOR_AMBIENT, output) == AI_SUCCESS) {
-            material.ambientColor = glm::max(MATERIAL_MIN_AMBIENT, convertAiColor3D(output));
-        }
-        if (aiMaterial->Get(AI_MATKEY_COLOR_EMISSIVE, output) == AI_SUCCESS) {
-            material.ambientColor = glm::max(MATERIAL_MIN_AMBIENT, convertAiColor3D(output));
-        }
-        SPDLOG_INFO("Ambient {}", glm::to_string(material.ambientColor));
+std::shared_ptr<ImportedModel> FactoryModel::importWithAssimp(const std::string& path) {
+    // the importer owns the ai scene, one per import makes this method reentrant
+    Assimp::Importer importer;
 
-        // get the diffuse and the specular color
-        if (aiMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, output) == AI_SUCCESS) {
-            material.diffuseColor = convertAiColor3D(output);
-            SPDLOG_INFO("diffuse {}", glm::to_string(material.diffuseColor));
-        }
-        if (aiMaterial->Get(AI_MATKEY_COLOR_SPECULAR, output) == AI_SUCCESS) {
-            material.specularColor = convertAiColor3D(output);
-            SPDLOG_INFO("Specular {}", glm::to_string(material.specularColor));
-        }
+    // Note : assimp winding order is by default counterclockwise
+    const aiScene* aiScene = importer.ReadFile(path, aiProcess_Triangulate
+                                       | aiProcess_JoinIdenticalVertices // without this, index buffer is useless
+                                       | aiProcess_GenNormals            // generate normals if not already in model
+                                       // TODO : add flags from rendering coockbook!! or other!
+    );
 
-        // add material and its name to scene
-        scene->_materials.push_back(material);
-        scene->_materialsNames.push_back(matName);
+    if (aiScene == nullptr || aiScene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !aiScene->mRootNode)
+        throw std::runtime_error(importer.GetErrorString());
+
+    SPDLOG_INFO("Num meshes {} in {}", aiScene->mNumMeshes, path);
+    auto model = std::make_shared<ImportedModel>();
+    model->path = path;
+
+    // reserve the range of each mesh in the model geometry, so the meshes can be converted in parallel
+    model->meshes.resize(aiScene->mNumMeshes);
+    uint32_t vertexCount = 0, indexCount = 0;
+    for (uint32_t i = 0; i < aiScene->mNumMeshes; ++i){
+        const aiMesh* aiMesh = aiScene->mMeshes[i];
+        auto& mesh = model->meshes[i];
+        mesh.firstVertex = vertexCount;
+        mesh.vertexCount = aiMesh->mNumVertices;
+        mesh.firstIndex = indexCount;
+        for (uint32_t j = 0; j < aiMesh->mNumFaces; ++j)
+            mesh.indexCount += aiMesh->mFaces[j].mNumIndices;
+
+        vertexCount += mesh.vertexCount;
+        indexCount += mesh.indexCount;
+    }
+    model->vertexStorage.resize(vertexCount);
+    model->indexStorage.resize(indexCount);
+
+    // the meshes are independent, convert and optimize them in parallel
+    std::vector<MeshReport> reports(aiScene->mNumMeshes);
+    std::vector<std::vector<uint32_t>> lodIndices(aiScene->mNumMeshes);
+    ThreadPool::global().parallelFor(aiScene->mNumMeshes, [&](uint32_t i){
+        convertMesh(aiScene->mMeshes[i], *model, i, lodIndices[i], reports[i]);
+    });
+
+    // the levels of detail follow the full detail meshes
+    uint32_t lodIndexCount = 0;
+    for (uint32_t i = 0; i < aiScene->mNumMeshes; ++i){
+        auto& mesh = model->meshes[i];
+        for (uint32_t j = 0; j < mesh.lodCount; ++j)
+            mesh.lods[j].firstIndex += model->indexStorage.size();
+        model->indexStorage.insert(model->indexStorage.end(), lodIndices[i].begin(), lodIndices[i].end());
+        lodIndexCount += lodIndices[i].size();
+    }
+    model->vertices = model->vertexStorage;
+    model->indices = model->indexStorage;
+
+    // vertex cache efficiency of the whole model before and after the optimization, and precision lost by the packing
+    MeshReport modelReport{};
+    for (const MeshReport& report : reports){
+        modelReport.cacheBefore.transformedVertices += report.cacheBefore.transformedVertices;
+        modelReport.cacheAfter.transformedVertices += report.cacheAfter.transformedVertices;
+        modelReport.positionError = std::max(modelReport.positionError, report.positionError);
+        modelReport.normalError = std::max(modelReport.normalError, report.normalError);
+        modelReport.uvError = std::max(modelReport.uvError, report.uvError);
+        modelReport.lodError = std::max(modelReport.lodError, report.lodError);
+    }
+    if (indexCount != 0 && vertexCount != 0){
+        float triangleCount = (float)(indexCount / 3);
+        SPDLOG_INFO("Optimized {} : ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}", path,
+                    modelReport.cacheBefore.transformedVertices / triangleCount,
+                    modelReport.cacheAfter.transformedVertices / triangleCount,
+                    modelReport.cacheBefore.transformedVertices / (float)vertexCount,
+                    modelReport.cacheAfter.transformedVertices / (float)vertexCount);
+        SPDLOG_INFO("Packed vertices max error of {} : position {:.2e} (of the mesh radius), normal {:.3f} deg, uv {:.2e}",
+                    path, modelReport.positionError, modelReport.normalError, modelReport.uvError);
+        SPDLOG_INFO("Levels of detail of {} : {} indices ({:.1f}% of the full detail), max error {:.2e} (of the mesh radius)",
+                    path, lodIndexCount, 100.f * lodIndexCount / indexCount, modelReport.lodError);
     }
 
-    // don't forget to reset the cached AiScene
-    _aiScene = nullptr;
-    _filePath.clear();
-}
+    // flatten the node hierarchy
+    traverseNodeRecursive(aiScene, aiScene->mRootNode, -1, *model);
 
-void FactoryModel::traverseNodeRecursive(aiNode* node, int parentEntity, int level, const std::shared_ptr<Scene>& scene) {
-    // create the node entity and append its local transform
-    int nodeEntity = scene->addSceneNode(parentEntity, level, node->mName.C_Str());
+    // convert all materials
+    model->materials.resize(aiScene->mNumMaterials);
+    model->materialNames.resize(aiScene->mNumMaterials);
+    for (uint32_t i = 0; i < aiScene->mNumMaterials; ++i)
+        convertMaterial(aiScene->mMaterials[i], model->materials[i], model->materialNames[i]);
 
-    scene->setTransform(nodeEntity, convertAiMat4(node->mTransformation));
+    return model;
+}
 
-    // increase the level for all mesh of node and children of node
-    ++level;
+void FactoryModel::traverseNodeRecursive(const aiScene* aiScene, aiNode* node, int parentNode, ImportedModel& model) {
+    // add the node with its local transform
+    int nodeIndex = model.nodes.size();
+    model.nodes.push_back({
+            .name = node->mName.C_Str(),
+            .parent = parentNode,
+            .transform = convertAiMat4(node->mTransformation),
+    });
 
-    // iterate through the mesh of the node and add the mesh component to the scene
+    // add a child node for each mesh of the node
     for (int i = 0 ; i < node->mNumMeshes; ++i){
-        int entityID = scene->addSceneNode(nodeEntity, level, getMeshName(node->mMeshes[i]));
-        MeshComponent& mc = scene->createMesh(entityID);
-        createMeshComponent(node->mMeshes[i], mc, scene);
+        if (node->mMeshes[i] >= aiScene->mNumMeshes)
+            throw std::runtime_error("Index out of range");
+        model.nodes.push_back({
+                .name = aiScene->mMeshes[node->mMeshes[i]]->mName.C_Str(),
+                .parent = nodeIndex,
+                .mesh = (int)node->mMeshes[i],
+        });
     }
 
     // recursively traverse all children of the node
     for (int i = 0; i < node->mNumChildren; ++i){
-        traverseNodeRecursive(node->mChildren[i], nodeEntity, level, scene);
+        traverseNodeRecursive(aiScene, node->mChildren[i], nodeIndex, model);
     }
 }
 
-bool FactoryModel::createMeshComponent(int aiMeshIndex, MeshComponent& mc, std::shared_ptr<Scene> scene) {
-    if (aiMeshIndex >= _aiScene->mNumMeshes)
-        throw std::runtime_error("Index out of range");
-    aiMesh* mesh = _aiScene->mMeshes[aiMeshIndex];
-
-    // add the material index. First material index is relevant if importing multiple models in a scene
-    mc.materialIndex = _firstMaterialIndex + mesh->mMaterialIndex;
-
-    // store the mesh first index (will be added to all indices since all indices of all meshes are stored continuously)
-    uint32_t meshFirstVertexIndex = scene->_vertices.size();
-
-    // get and add all vertices
-    for (int i = 0; i < mesh->mNumVertices; ++i){
-        auto& aiVertex = mesh->mVertices[i];
-        auto& aiNormal = mesh->mNormals[i];
-        Vertex vertex = {};
-        //vertex.meshIndex = meshID;
+void FactoryModel::convertMesh(const aiMesh* aiMesh, ImportedModel& model, uint32_t meshIndex, std::vector<uint32_t>& lodIndices,
+                               MeshReport& report) {
+    auto& mesh = model.meshes[meshIndex];
+    mesh.name = aiMesh->mName.C_Str();
+    mesh.materialIndex = aiMesh->mMaterialIndex;
+
+    // write all vertices in the range of the mesh
+    Vertex* vertices = model.vertexStorage.data() + mesh.firstVertex;
+    for (int i = 0; i < aiMesh->mNumVertices; ++i){
+        auto& aiVertex = aiMesh->mVertices[i];
+        auto& aiNormal = aiMesh->mNormals[i];
+        Vertex& vertex = vertices[i];
         vertex.position.x = aiVertex.x;
         vertex.position.y = aiVertex.y;
         vertex.position.z = aiVertex.z;
@@ -187,24 +346,315 @@ bool FactoryModel::createMeshComponent(int aiMeshIndex, MeshComponent& mc, std::
         vertex.normal.y = aiNormal.y;
         vertex.normal.z = aiNormal.z;
         //vertex.uv = // TODO : add UV!
-        scene->_vertices.push_back(vertex);
     }
 
-    // the index (in the index buffer) of the first index is the current index buffer size
-    mc.firstVertexIndex = scene->_indices.size();
+    // bounding sphere enclosing the bounding box of the mesh, used to cull the mesh on the GPU
+    if (aiMesh->mNumVertices != 0){
+        glm::vec3 min = vertices[0].position, max = vertices[0].position;
+        for (int i = 1; i < aiMesh->mNumVertices; ++i){
+            min = glm::min(min, vertices[i].position);
+            max = glm::max(max, vertices[i].position);
+        }
+        mesh.boundingSphere = glm::vec4((min + max) * 0.5f, glm::length(max - min) * 0.5f);
+    }
 
-    // get and add all indices
-    for (int i = 0; i < mesh->mNumFaces; ++i) {
-        auto& face = mesh->mFaces[i];
+    // write all indices, relative to the first vertex of the mesh
+    uint32_t* indices = model.indexStorage.data() + mesh.firstIndex;
+    uint32_t* index = indices;
+    for (int i = 0; i < aiMesh->mNumFaces; ++i) {
+        auto& face = aiMesh->mFaces[i];
         for (int j = 0; j < face.mNumIndices; ++j)
-            scene->_indices.emplace_back(meshFirstVertexIndex + face.mIndices[j]);
+            *index++ = face.mIndices[j];
+    }
+
+    // reorder the triangles for the vertex cache, then the clusters of triangles for the overdraw and finally the
+    // vertices for the fetch locality
+    std::vector<glm::vec3> positions(mesh.vertexCount);
+    for (uint32_t i = 0; i < mesh.vertexCount; ++i)
+        positions[i] = vertices[i].position;
+    report.cacheBefore = utils::analyzeVertexCache(indices, mesh.indexCount, mesh.vertexCount);
+    utils::optimizeVertexCache(indices, mesh.indexCount, mesh.vertexCount);
+    utils::optimizeOverdraw(indices, mesh.indexCount, positions.data(), mesh.vertexCount);
+    utils::optimizeVertexFetch(vertices, indices, mesh.indexCount, mesh.vertexCount, sizeof(Vertex));
+    report.cacheAfter = utils::analyzeVertexCache(indices, mesh.indexCount, mesh.vertexCount);
+
+    // levels of detail, each simplified from the full detail mesh with half of the triangles of the previous one. The
+    // vertices are shared with the full detail mesh
+    for (uint32_t i = 0; i < mesh.vertexCount; ++i)
+        positions[i] = vertices[i].position;
+    std::vector<uint32_t> simplified(mesh.indexCount);
+    uint32_t previousIndexCount = mesh.indexCount;
+    while (mesh.lodCount < MAX_MESH_LODS){
+        float error;
+        uint32_t targetIndexCount = previousIndexCount / 6 * 3;
+        uint32_t lodIndexCount = utils::simplifyMesh(simplified.data(), indices, mesh.indexCount, positions.data(),
+                                                     mesh.vertexCount, targetIndexCount,
+                                                     LOD_MAX_ERROR * mesh.boundingSphere.w, error);
+        if (lodIndexCount == 0 || lodIndexCount > previousIndexCount * LOD_MIN_REDUCTION)
+            break;
+
+        utils::optimizeVertexCache(simplified.data(), lodIndexCount, mesh.vertexCount);
+        mesh.lods[mesh.lodCount++] = {(uint32_t)lodIndices.size(), lodIndexCount, error};
+        lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.begin() + lodIndexCount);
+        if (mesh.boundingSphere.w > 0.f)
+            report.lodError = std::max(report.lodError, error / mesh.boundingSphere.w);
+        previousIndexCount = lodIndexCount;
+    }
+
+    // precision lost by the packed vertices (see MultiMeshLayer), relative to the mesh bounds
+    for (uint32_t i = 0; i < mesh.vertexCount; ++i){
+        const Vertex& vertex = vertices[i];
+        glm::vec3 position, normal;
+        glm::vec2 uv;
+        utils::unpackVertex(utils::packVertex(vertex.position, vertex.normal, vertex.uv, mesh.boundingSphere),
+                            mesh.boundingSphere, position, normal, uv);
+        if (mesh.boundingSphere.w > 0.f)
+            report.positionError = std::max(report.positionError, glm::distance(position, vertex.position) / mesh.boundingSphere.w);
+        float cosAngle = glm::clamp(glm::dot(normal, glm::normalize(vertex.normal)), -1.f, 1.f);
+        report.normalError = std::max(report.normalError, glm::degrees(std::acos(cosAngle)));
+        report.uvError = std::max(report.uvError, glm::distance(uv, vertex.uv));
+    }
+}
+
+std::shared_ptr<ImportedModel> FactoryModel::loadCooked(const std::string& cookedPath, const std::string& sourcePath) {
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(cookedPath))
+        return nullptr;
+
+    // make sure the file was cooked with the current layout, from the current source
+    const uint8_t* data = file->getData();
+    if (file->getSize() < sizeof(CookedHeader))
+        return nullptr;
+    CookedHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != COOKED_MAGIC || header.version != COOKED_VERSION || header.vertexSize != sizeof(Vertex)){
+        SPDLOG_INFO("Cooked file {} has an outdated format", cookedPath);
+        return nullptr;
+    }
+
+    // the source can be missing if only the cooked files are shipped
+    auto [sourceWriteTime, sourceSize] = getSourceStamp(sourcePath);
+    if (sourceSize != 0 && (sourceWriteTime != header.sourceWriteTime || sourceSize != header.sourceSize)){
+        SPDLOG_INFO("Cooked file {} is outdated", cookedPath);
+        return nullptr;
+    }
+
+    // all sections must be in the file
+    auto isInFile = [&](uint64_t offset, uint64_t count, uint64_t elementSize){
+        return offset % COOKED_ALIGNMENT == 0 && offset <= file->getSize() && count <= (file->getSize() - offset) / elementSize;
+    };
+    if (!isInFile(header.nodesOffset, header.nodeCount, sizeof(CookedNode)) ||
+        !isInFile(header.meshesOffset, header.meshCount, sizeof(CookedMesh)) ||
+        !isInFile(header.materialsOffset, header.materialCount, sizeof(Material)) ||
+        !isInFile(header.materialNamesOffset, header.materialCount, sizeof(CookedString)) ||
+        !isInFile(header.verticesOffset, header.vertexCount, sizeof(Vertex)) ||
+        !isInFile(header.indicesOffset, header.indexCount, sizeof(uint32_t)) ||
+        !isInFile(header.stringsOffset, header.stringsSize, 1)){
+        SPDLOG_ERROR("Cooked file {} is corrupted", cookedPath);
+        return nullptr;
+    }
+
+    const char* strings = (const char*)data + header.stringsOffset;
+    auto getString = [&](const CookedString& string){
+        if ((uint64_t)string.offset + string.size > header.stringsSize)
+            return std::string();
+        return std::string(strings + string.offset, string.size);
+    };
+
+    auto model = std::make_shared<ImportedModel>();
+    model->path = sourcePath;
+
+    // the hierarchy and the materials are small, copy them
+    const CookedNode* nodes = (const CookedNode*)(data + header.nodesOffset);
+    model->nodes.resize(header.nodeCount);
+    for (uint32_t i = 0; i < header.nodeCount; ++i){
+        model->nodes[i] = {
+                .name = getString(nodes[i].name),
+                .parent = nodes[i].parent,
+                .transform = nodes[i].transform,
+                .mesh = nodes[i].mesh,
+        };
+        // -1 for no parent / no mesh, the parents are stored before their children
+        if (nodes[i].parent < -1 || nodes[i].parent >= (int)i || nodes[i].mesh < -1 || nodes[i].mesh >= (int)header.meshCount){
+            SPDLOG_ERROR("Cooked file {} is corrupted", cookedPath);
+            return nullptr;
+        }
+    }
+
+    // the indices are relative to their mesh, an index past its vertices would be pulled out of bounds by the GPU
+    const uint32_t* indices = (const uint32_t*)(data + header.indicesOffset);
+    auto isInMesh = [indices](uint32_t firstIndex, uint32_t indexCount, uint32_t vertexCount){
+        return std::all_of(indices + firstIndex, indices + firstIndex + indexCount,
+                           [vertexCount](uint32_t index){ return index < vertexCount; });
+    };
+
+    const CookedMesh* meshes = (const CookedMesh*)(data + header.meshesOffset);
+    model->meshes.resize(header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; ++i){
+        model->meshes[i] = {
+                .name = getString(meshes[i].name),
+                .firstVertex = meshes[i].firstVertex,
+                .vertexCount = meshes[i].vertexCount,
+                .firstIndex = meshes[i].firstIndex,
+                .indexCount = meshes[i].indexCount,
+                .materialIndex = meshes[i].materialIndex,
+                .boundingSphere = meshes[i].boundingSphere,
+                .lodCount = meshes[i].lodCount,
+        };
+        // the ranges of the mesh and of its lods must be in the geometry of the file
+        bool valid = (uint64_t)meshes[i].firstVertex + meshes[i].vertexCount <= header.vertexCount &&
+                     (uint64_t)meshes[i].firstIndex + meshes[i].indexCount <= header.indexCount &&
+                     meshes[i].materialIndex < header.materialCount && meshes[i].lodCount <= MAX_MESH_LODS &&
+                     isInMesh(meshes[i].firstIndex, meshes[i].indexCount, meshes[i].vertexCount);
+        for (uint32_t j = 0; valid && j < meshes[i].lodCount; ++j){
+            model->meshes[i].lods[j] = meshes[i].lods[j];
+            valid = (uint64_t)meshes[i].lods[j].firstIndex + meshes[i].lods[j].indexCount <= header.indexCount &&
+                    isInMesh(meshes[i].lods[j].firstIndex, meshes[i].lods[j].indexCount, meshes[i].vertexCount);
+        }
+        if (!valid){
+            SPDLOG_ERROR("Cooked file {} is corrupted", cookedPath);
+            return nullptr;
+        }
     }
 
-    // the index count is the current index buffer size - the first vertex index
-    mc.indexCount = scene->_indices.size() - mc.firstVertexIndex;
+    const Material* materials = (const Material*)(data + header.materialsOffset);
+    const CookedString* materialNames = (const CookedString*)(data + header.materialNamesOffset);
+    model->materials.assign(materials, materials + header.materialCount);
+    for (uint32_t i = 0; i < header.materialCount; ++i)
+        model->materialNames.push_back(getString(materialNames[i]));
+
+    // the geometry is used in place, the mapped file is kept alive by the model
+    model->vertices = {(const Vertex*)(data + header.verticesOffset), header.vertexCount};
+    model->indices = {(const uint32_t*)(data + header.indicesOffset), header.indexCount};
+    model->cookedFile = file;
 
+    SPDLOG_INFO("Loaded cooked file {}", cookedPath);
+    return model;
+}
+
+bool FactoryModel::writeCooked(const std::string& cookedPath, const std::string& sourcePath, const ImportedModel& model) {
+    // gather all the names in a single section
+    std::string strings;
+    auto addString = [&strings](const std::string& string){
+        CookedString cookedString = {.offset = (uint32_t)strings.size(), .size = (uint32_t)string.size()};
+        strings += string;
+        return cookedString;
+    };
+
+    std::vector<CookedNode> nodes;
+    for (auto& node : model.nodes)
+        nodes.push_back({.transform = node.transform, .parent = node.parent, .mesh = node.mesh, .name = addString(node.name)});
+
+    std::vector<CookedMesh> meshes;
+    for (auto& mesh : model.meshes){
+        meshes.push_back({
+                .boundingSphere = mesh.boundingSphere,
+                .firstVertex = mesh.firstVertex,
+                .vertexCount = mesh.vertexCount,
+                .firstIndex = mesh.firstIndex,
+                .indexCount = mesh.indexCount,
+                .materialIndex = mesh.materialIndex,
+                .name = addString(mesh.name),
+                .lodCount = mesh.lodCount,
+        });
+        std::copy(mesh.lods.begin(), mesh.lods.end(), meshes.back().lods);
+    }
+
+    std::vector<CookedString> materialNames;
+    for (auto& name : model.materialNames)
+        materialNames.push_back(addString(name));
+
+    // compute the offset of every section
+    auto [sourceWriteTime, sourceSize] = getSourceStamp(sourcePath);
+    CookedHeader header = {
+            .nodeCount = (uint32_t)nodes.size(),
+            .meshCount = (uint32_t)meshes.size(),
+            .materialCount = (uint32_t)model.materials.size(),
+            .vertexCount = model.vertices.size(),
+            .indexCount = model.indices.size(),
+            .stringsSize = strings.size(),
+            .sourceWriteTime = sourceWriteTime,
+            .sourceSize = sourceSize,
+    };
+    uint64_t offset = sizeof(CookedHeader);
+    auto reserveSection = [&offset](uint64_t size){
+        offset = (offset + COOKED_ALIGNMENT - 1) / COOKED_ALIGNMENT * COOKED_ALIGNMENT;
+        uint64_t sectionOffset = offset;
+        offset += size;
+        return sectionOffset;
+    };
+    header.nodesOffset = reserveSection(nodes.size() * sizeof(CookedNode));
+    header.meshesOffset = reserveSection(meshes.size() * sizeof(CookedMesh));
+    header.materialsOffset = reserveSection(model.materials.size() * sizeof(Material));
+    header.materialNamesOffset = reserveSection(materialNames.size() * sizeof(CookedString));
+    header.verticesOffset = reserveSection(model.vertices.size_bytes());
+    header.indicesOffset = reserveSection(model.indices.size_bytes());
+    header.stringsOffset = reserveSection(strings.size());
+
+    // write to a temporary file, renamed once complete so a partially written file is never loaded. The name is unique
+    // to the thread, concurrent imports of the same model each write their own file
+    std::string threadId = std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    std::string tempPath = cookedPath + "." + threadId + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        auto writeSection = [&file](uint64_t sectionOffset, const void* data, uint64_t size){
+            static constexpr char PADDING[COOKED_ALIGNMENT] = {};
+            file.write(PADDING, sectionOffset - (uint64_t)file.tellp());
+            file.write((const char*)data, size);
+        };
+        file.write((const char*)&header, sizeof(header));
+        writeSection(header.nodesOffset, nodes.data(), nodes.size() * sizeof(CookedNode));
+        writeSection(header.meshesOffset, meshes.data(), meshes.size() * sizeof(CookedMesh));
+        writeSection(header.materialsOffset, model.materials.data(), model.materials.size() * sizeof(Material));
+        writeSection(header.materialNamesOffset, materialNames.data(), materialNames.size() * sizeof(CookedString));
+        writeSection(header.verticesOffset, model.vertices.data(), model.vertices.size_bytes());
+        writeSection(header.indicesOffset, model.indices.data(), model.indices.size_bytes());
+        writeSection(header.stringsOffset, strings.data(), strings.size());
+        if (!file)
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cookedPath, error);
+    if (error){
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    SPDLOG_INFO("Cooked {}", cookedPath);
     return true;
-};
+}
+
+void FactoryModel::convertMaterial(const aiMaterial* aiMaterial, Material& material, std::string& name) {
+    // get name of material
+    aiString aiName;
+    name = "No name :(";
+    if (aiMaterial->Get(AI_MATKEY_NAME, aiName) == AI_SUCCESS)
+        name = aiName.C_Str();
+
+    aiColor3D output{};
+
+    // the ambient color corresponds to the max between MIN_AMBIENT, ambient and emmisive
+    material.ambientColor = MATERIAL_MIN_AMBIENT;
+    if (aiMaterial->Get(AI_MATKEY_COLOR_AMBIENT, output) == AI_SUCCESS) {
+        material.ambientColor = glm::max(MATERIAL_MIN_AMBIENT, convertAiColor3D(output));
+    }
+    if (aiMaterial->Get(AI_MATKEY_COLOR_EMISSIVE, output) == AI_SUCCESS) {
+        material.ambientColor = glm::max(MATERIAL_MIN_AMBIENT, convertAiColor3D(output));
+    }
+
+    // get the diffuse and the specular color
+    if (aiMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, output) == AI_SUCCESS) {
+        material.diffuseColor = convertAiColor3D(output);
+    }
+    if (aiMaterial->Get(AI_MATKEY_COLOR_SPECULAR, output) == AI_SUCCESS) {
+        material.specularColor = convertAiColor3D(output);
+    }
+    SPDLOG_INFO("Material {} : ambient {}, diffuse {}, specular {}", name, glm::to_string(material.ambientColor),
+                glm::to_string(material.diffuseColor), glm::to_string(material.specularColor));
+}
 
 /// ai mats are row major, glm (and opengl) mats are column major ;  we can't type pun
 glm::mat4 FactoryModel::convertAiMat4(const aiMatrix4x4& mat){
@@ -214,13 +664,6 @@ glm::mat4 FactoryModel::convertAiMat4(const aiMatrix4x4& mat){
                      mat.a4, mat.b4, mat.c4, mat.d4};
 }
 
-std::string FactoryModel::getMeshName(int meshIndex) {
-    if (meshIndex >= _aiScene->mNumMeshes)
-        throw std::runtime_error("Index out of range");
-    aiMesh* mesh = _aiScene->mMeshes[meshIndex];
-    return {mesh->mName.C_Str()};
-}
-
 glm::vec3 FactoryModel::convertAiColor3D(const aiColor3D& color) {
     return {color.r, color.g, color.b};
 }
@@ -7,6 +7,11 @@
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 #include "../../Scene/Scene.h"
+#include "../../Utils/MappedFile.h"
+#include "../../Utils/UtilsMesh.h"
+
+#include <future>
+#include <span>
 
 struct TexVertex{
     glm::vec3 position;
@@ -18,6 +23,42 @@ struct TexVertex2{
     glm::vec2 uv;
 };
 
+/// CPU side result of a model import. Produced on any thread, then merged in a scene on the main thread
+struct ImportedModel {
+    struct Mesh {
+        std::string name;
+        uint32_t firstVertex = 0;               ///< range of the mesh in the vertices of the model
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;                ///< range of the mesh in the indices of the model
+        uint32_t indexCount = 0;
+        uint32_t materialIndex = 0;             ///< index in the materials of the model
+        glm::vec4 boundingSphere = glm::vec4(0.f); ///< center (xyz) and radius (w) in the mesh space
+        std::array<MeshLod, MAX_MESH_LODS> lods{}; ///< coarser levels of detail, their ranges are in the indices of the model
+        uint32_t lodCount = 0;
+    };
+
+    struct Node {
+        std::string name;
+        int parent = -1;                        ///< index in nodes, -1 for the root of the model
+        glm::mat4 transform = glm::mat4(1.f);   ///< local transform
+        int mesh = -1;                          ///< index in meshes if the node is a mesh node
+    };
+
+    std::string path;
+    std::vector<Node> nodes;                    ///< parents are always before their children
+    std::vector<Mesh> meshes;                   ///< one per assimp mesh, shared by the nodes referencing it
+    std::vector<Material> materials;
+    std::vector<std::string> materialNames;
+
+    /// geometry of all meshes, indices are relative to the first vertex of their mesh. Views either the storage below
+    /// (assimp import) or the mapped cooked file
+    std::span<const Vertex> vertices;
+    std::span<const uint32_t> indices;
+    std::vector<Vertex> vertexStorage;
+    std::vector<uint32_t> indexStorage;
+    std::shared_ptr<MappedFile> cookedFile;
+};
+
 class FactoryModel {
 public:
     static bool createDuckModel(std::vector<TexVertex>& vertices, std::vector<uint32_t>& indices);
@@ -26,25 +67,55 @@ public:
     static bool createTexturedSquare(std::vector<TexVertex>& vertices, std::vector<uint32_t>& indices);
     static bool createTexturedSquare2(std::vector<TexVertex2>& vertices);
 
+    /// loads the cooked version of the file if it is up to date. Otherwise, parses the file with assimp (converting the
+    /// meshes in parallel on the global thread pool) and cooks it for the next runs. Reentrant, can be called from any thread
+    static std::shared_ptr<ImportedModel> loadFromFile(const std::string& path);
+
+    /// loadFromFile on a worker thread. The future rethrows the import error if any
+    static std::future<std::shared_ptr<ImportedModel>> loadFromFileAsync(const std::string& path);
+
+    /// merges the model in the scene. Must be called from the thread owning the scene. Returns the root entity of the model
+    static int addToScene(const ImportedModel& model, const std::shared_ptr<Scene>& scene);
+
+    /// synchronously loads the model and adds it to the scene
     static void importFromFile(const std::string& path, std::shared_ptr<Scene> scene);
 
+    /// extension appended to the path of a model to get its cooked file
+    static constexpr const char* COOKED_EXTENSION = ".vcooked";
+
 private:
-    static void traverseNodeRecursive(aiNode* node, int parentEntity, int level, const std::shared_ptr<Scene>& scene);
+    static std::shared_ptr<ImportedModel> importWithAssimp(const std::string& path);
+    static void traverseNodeRecursive(const aiScene* aiScene, aiNode* node, int parentNode, ImportedModel& model);
+
+    // Cooked files : versioned binary dump of an imported model, mapped and used without parsing
+    static std::shared_ptr<ImportedModel> loadCooked(const std::string& cookedPath, const std::string& sourcePath);
+    static bool writeCooked(const std::string& cookedPath, const std::string& sourcePath, const ImportedModel& model);
 
     // Helper methods
-    static bool createMeshComponent(int aiMeshIndex, MeshComponent& mc, std::shared_ptr<Scene> scene);
-    static std::string getMeshName(int meshIndex);
+    /// statistics of the processing of a mesh, logged for the whole model
+    struct MeshReport {
+        utils::VertexCacheStatistics cacheBefore{};     ///< before the optimization
+        utils::VertexCacheStatistics cacheAfter{};
+        float positionError = 0.f;                      ///< max error of the packed positions, relative to the mesh radius
+        float normalError = 0.f;                        ///< max error of the packed normals, in degrees
+        float uvError = 0.f;                            ///< max error of the packed uvs
+        float lodError = 0.f;                           ///< max error of the coarsest level of detail, relative to the mesh radius
+    };
+
+    /// converts the mesh in its range of the model geometry and optimizes it for the GPU. The indices of the levels of
+    /// detail are written in lodIndices, the ranges of the mesh lods are relative to it
+    static void convertMesh(const aiMesh* aiMesh, ImportedModel& model, uint32_t meshIndex, std::vector<uint32_t>& lodIndices,
+                            MeshReport& report);
+    static void convertMaterial(const aiMaterial* aiMaterial, Material& material, std::string& name);
     static glm::mat4 convertAiMat4(const aiMatrix4x4& mat);
     static glm::vec3 convertAiColor3D(const aiColor3D& color);
 
-
-    static inline const aiScene* _aiScene = nullptr; ///<cached scene
-    ///< index of the first material in the scene. Relevant if importing multiple models to a scene
-    static inline uint32_t _firstMaterialIndex = 0;
-    static inline std::string _filePath; ///< cached filepath
-
     // constants
     ///< Minimum ambient color of a material. Necessary because a lot of assimp materials have 0 as ambient color.
     /// Note: we could also have a maximum ambient color
     static constexpr glm::vec3 MATERIAL_MIN_AMBIENT = glm::vec3(0.1f);
+    ///< The levels of detail stop before exceeding this error, relative to the mesh radius
+    static constexpr float LOD_MAX_ERROR = 0.2f;
+    ///< A level of detail is only kept if it has less triangles than this ratio of the previous one
+    static constexpr float LOD_MIN_REDUCTION = 0.8f;
 };
\ No newline at end of file
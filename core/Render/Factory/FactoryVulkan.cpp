@@ -7,6 +7,13 @@
 #include "../../Application.h"
 #include "../../Utils/UtilsVulkan.h"
 #include "../../Utils/UtilsFile.h"
+#include "../ShaderLibrary.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL VulkanDebugCallback(
         VkDebugUtilsMessageSeverityFlagBitsEXT Severity,
@@ -29,6 +36,41 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL VulkanDebugCallback(
     return VK_FALSE;
 }
 
+namespace {
+    std::atomic<uint64_t> pipelineCreationNs = 0;   ///< time spent in the pipeline creations, in nanoseconds
+
+    /// adds the time elapsed since start to the pipeline creation time
+    void addPipelineCreationTime(std::chrono::steady_clock::time_point start) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        pipelineCreationNs += elapsed.count();
+    }
+
+    /// header of a pipeline cache file. The driver may reject (or crash on) data written by another driver, so the
+    /// cache data is only given back to the same device and driver version
+    struct PipelineCacheFileHeader {
+        uint32_t magic = PIPELINE_CACHE_MAGIC;
+        uint32_t vendorID = 0;
+        uint32_t deviceID = 0;
+        uint32_t driverVersion = 0;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE] = {};
+        uint64_t dataSize = 0;                          ///< size of the cache data following the header
+
+        static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x48434350; // "PCCH"
+    };
+
+    PipelineCacheFileHeader getPipelineCacheFileHeader(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        PipelineCacheFileHeader header = {
+                .vendorID = properties.vendorID,
+                .deviceID = properties.deviceID,
+                .driverVersion = properties.driverVersion,
+        };
+        memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+        return header;
+    }
+}
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL VulkanDebugReportCallback
         (
                 VkDebugReportFlagsEXT      flags,
@@ -123,19 +165,26 @@ namespace Factory {
         vkDestroyDebugUtilsMessengerEXT(instance, messenger, nullptr);
     }
 
-    VkDevice createDevice(VkPhysicalDevice physicalDevice, uint32_t graphicsQueueFamilyIndex,
+    VkDevice createDevice(VkPhysicalDevice physicalDevice, uint32_t graphicsQueueFamilyIndex, uint32_t transferQueueFamilyIndex,
                           const VkPhysicalDeviceFeatures& features) {
         VkDevice device;
         // queue create info for the graphics queue
         float priority = 1.f;
-        VkDeviceQueueCreateInfo queueCreateInfo = {
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos = {{
                 .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
                 .pNext = nullptr,
                 .flags = 0u,
                 .queueFamilyIndex = graphicsQueueFamilyIndex,
                 .queueCount = 1,
                 .pQueuePriorities = &priority,
-        };
+        }};
+
+        // the transfer queue shares the graphics queue if there is no other family
+        if (transferQueueFamilyIndex != graphicsQueueFamilyIndex){
+            VkDeviceQueueCreateInfo transferCreateInfo = queueCreateInfos[0];
+            transferCreateInfo.queueFamilyIndex = transferQueueFamilyIndex;
+            queueCreateInfos.push_back(transferCreateInfo);
+        }
 
         const std::vector<const char*> extensions = {
                 VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -151,22 +200,25 @@ namespace Factory {
                 .shaderDrawParameters = VK_TRUE
         };
 
-        // TODO : can we check if it is supported ?
-        VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = {
-                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
+        // Vulkan 1.2 features. Timeline semaphores track the completion of the uploads, draw indirect count is used
+        // by the GPU culling. TODO : can we check if the indexing features are supported ?
+        VkPhysicalDeviceVulkan12Features features12 = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
                 .pNext = &features11,
+                .drawIndirectCount = VK_TRUE,
                 .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
                 .descriptorBindingVariableDescriptorCount = VK_TRUE,
-                .runtimeDescriptorArray = VK_TRUE
+                .runtimeDescriptorArray = VK_TRUE,
+                .timelineSemaphore = VK_TRUE,
         };
 
         // create logical device
         VkDeviceCreateInfo createInfo = {
                 .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-                .pNext = &indexingFeatures,
+                .pNext = &features12,
                 .flags = 0u,
-                .queueCreateInfoCount = 1u,
-                .pQueueCreateInfos = &queueCreateInfo,
+                .queueCreateInfoCount = (uint32_t)queueCreateInfos.size(),
+                .pQueueCreateInfos = queueCreateInfos.data(),
                 .enabledLayerCount = 0u,
                 .ppEnabledLayerNames = nullptr,
                 .enabledExtensionCount = (uint32_t) extensions.size(),
@@ -198,32 +250,29 @@ namespace Factory {
         return output;
     }
 
-    VkShaderModule createShaderModule(VkDevice device, const std::string& filename) {
+    VkShaderModule createShaderModule(VkDevice device, const uint32_t* code, size_t codeSize) {
         VkShaderModule shaderModule = nullptr;
-        std::filesystem::path path(R"(..\..\..\core\Assets\Shaders\SPIR-V)");
-        path /= filename;
-        VK_ASSERT(utils::fileExists(path), "Shader file does not exist");
-
-        std::vector<char> code = utils::getFileContent(path.string());
-
         VkShaderModuleCreateInfo shaderCI = {
                 .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
                 .pNext = nullptr,
-                .codeSize = (uint32_t) code.size(),
-                .pCode = (uint32_t*) code.data(),
+                .codeSize = codeSize,
+                .pCode = code,
         };
 
         VK_CHECK(vkCreateShaderModule(device, &shaderCI, nullptr, &shaderModule));
         return shaderModule;
     }
 
-    VkPipeline createGraphicsPipeline(VkDevice device, VkExtent2D& extent, VkRenderPass renderPass,
+    VkPipeline createGraphicsPipeline(VulkanRenderDevice* vrd, VkRenderPass renderPass,
                                       VkPipelineLayout pipelineLayout, const GraphicsPipelineProps& props) {
+        auto start = std::chrono::steady_clock::now();
+        VkDevice device = vrd->device;
         VK_ASSERT(!props.shaders.geometry.has_value(), "Geo shader not supported yet");
 
         VK_ASSERT(props.shaders.fragment.has_value() && props.shaders.vertex.has_value(), "Filenames are empty");
-        VkShaderModule vertModule = Factory::createShaderModule(device, props.shaders.vertex.value());
-        VkShaderModule fragModule = Factory::createShaderModule(device, props.shaders.fragment.value());
+        // the modules are owned by the library, shared with the other pipelines
+        VkShaderModule vertModule = vrd->shaderLibrary->getModule(props.shaders.vertex.value());
+        VkShaderModule fragModule = vrd->shaderLibrary->getModule(props.shaders.fragment.value());
 
         std::array<VkPipelineShaderStageCreateInfo, 2> shadersCI{};
 
@@ -264,28 +313,15 @@ namespace Factory {
                 .primitiveRestartEnable = VK_FALSE, // if enabled a special index value (0xFFFFFFFF) restarts the assembly if drawing indexed
         };
 
-        VkViewport viewPort = {
-                .x = 0.f,
-                .y = 0.f,
-                .width = (float) extent.width,
-                .height = (float) extent.height,
-                .minDepth = 0.f,
-                .maxDepth = 1.f,
-        };
-
-        VkRect2D scissor = {
-                .offset = {0, 0},
-                .extent = extent
-        };
-
+        // the viewport and scissor are dynamic (set by the renderer), a resize does not rebuild the pipelines
         VkPipelineViewportStateCreateInfo viewPortCI = {
                 .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
                 .pNext = nullptr,
                 .flags = 0u,
                 .viewportCount = 1,
-                .pViewports = &viewPort,
+                .pViewports = nullptr,
                 .scissorCount = 1,
-                .pScissors = &scissor
+                .pScissors = nullptr
         };
 
         VkPipelineRasterizationStateCreateInfo rastCI = {
@@ -358,11 +394,16 @@ namespace Factory {
                 .blendConstants = {0.f, 0.f, 0.f, 0.f}
         };
 
-        // set up dynamic states with requested dynamic states
+        // set up dynamic states with the viewport, the scissor and the requested dynamic states
+        std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        for (VkDynamicState state : props.dynamicStates){
+            if (std::find(dynamicStates.begin(), dynamicStates.end(), state) == dynamicStates.end())
+                dynamicStates.push_back(state);
+        }
         VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {
                 .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-                .dynamicStateCount = (uint32_t)props.dynamicStates.size(),
-                .pDynamicStates = props.dynamicStates.data()
+                .dynamicStateCount = (uint32_t)dynamicStates.size(),
+                .pDynamicStates = dynamicStates.data()
         };
 
         VkGraphicsPipelineCreateInfo pipelineCI = {
@@ -386,16 +427,102 @@ namespace Factory {
         };
 
         VkPipeline output = nullptr;
-        VK_CHECK(vkCreateGraphicsPipelines(device, nullptr, 1, &pipelineCI, nullptr, &output));
+        VK_CHECK(vkCreateGraphicsPipelines(device, vrd->pipelineCache, 1, &pipelineCI, nullptr, &output));
 
-        vkDestroyShaderModule(device, vertModule, nullptr);
-        vkDestroyShaderModule(device, fragModule, nullptr);
+        addPipelineCreationTime(start);
+        return output;
+    }
 
+    VkPipeline createComputePipeline(VulkanRenderDevice* vrd, VkPipelineLayout pipelineLayout, const std::string& shaderFile,
+                                     VkSpecializationInfo* specializationInfo) {
+        auto start = std::chrono::steady_clock::now();
+        VkDevice device = vrd->device;
+        VkShaderModule computeModule = vrd->shaderLibrary->getModule(shaderFile);
+
+        VkComputePipelineCreateInfo pipelineCI = {
+                .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                .stage = {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = computeModule,
+                        .pName = "main",
+                        .pSpecializationInfo = specializationInfo
+                },
+                .layout = pipelineLayout,
+                .basePipelineHandle = nullptr,
+                .basePipelineIndex = -1,
+        };
+
+        VkPipeline output = nullptr;
+        VK_CHECK(vkCreateComputePipelines(device, vrd->pipelineCache, 1, &pipelineCI, nullptr, &output));
+
+        addPipelineCreationTime(start);
         return output;
     }
 
-    std::pair<VkBuffer, VkDeviceMemory> createBuffer(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize size,
-                                                     VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+    float getPipelineCreationTime() {
+        return (float)pipelineCreationNs.load() * 1e-9f;
+    }
+
+    VkPipelineCache createPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path) {
+        // the cache data is only used if it was written by this device and driver
+        std::vector<char> data;
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (file.is_open()){
+            uint64_t fileSize = file.tellg();
+            PipelineCacheFileHeader expected = getPipelineCacheFileHeader(physicalDevice), header{};
+            file.seekg(0);
+            if (fileSize >= sizeof(header) && file.read((char*)&header, sizeof(header)) &&
+                header.magic == expected.magic && header.vendorID == expected.vendorID &&
+                header.deviceID == expected.deviceID && header.driverVersion == expected.driverVersion &&
+                memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+                header.dataSize == fileSize - sizeof(header)){
+                data.resize(header.dataSize);
+                if (!file.read(data.data(), (std::streamsize)data.size()))
+                    data.clear();
+            }
+            else
+                SPDLOG_INFO("Pipeline cache {} written by another device or driver, ignored", path);
+        }
+
+        // the data starts with the vulkan header, checked by the driver as well
+        VkPipelineCacheCreateInfo pipelineCacheCI = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+                .initialDataSize = data.size(),
+                .pInitialData = data.empty() ? nullptr : data.data(),
+        };
+        VkPipelineCache pipelineCache = nullptr;
+        if (vkCreatePipelineCache(device, &pipelineCacheCI, nullptr, &pipelineCache) != VK_SUCCESS){
+            // the driver rejected the data, start empty
+            pipelineCacheCI.initialDataSize = 0;
+            pipelineCacheCI.pInitialData = nullptr;
+            VK_CHECK(vkCreatePipelineCache(device, &pipelineCacheCI, nullptr, &pipelineCache));
+            data.clear();
+        }
+        SPDLOG_INFO("Pipeline cache {} loaded, {} bytes", path, data.size());
+        return pipelineCache;
+    }
+
+    bool savePipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, VkPipelineCache pipelineCache,
+                           const std::string& path) {
+        size_t size = 0;
+        VK_CHECK(vkGetPipelineCacheData(device, pipelineCache, &size, nullptr));
+        std::vector<char> data(size);
+        VK_CHECK(vkGetPipelineCacheData(device, pipelineCache, &size, data.data()));
+
+        PipelineCacheFileHeader header = getPipelineCacheFileHeader(physicalDevice);
+        header.dataSize = size;
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.write((const char*)&header, sizeof(header)) || !file.write(data.data(), (std::streamsize)size)){
+            SPDLOG_ERROR("Failed to write the pipeline cache {}", path);
+            return false;
+        }
+        SPDLOG_INFO("Pipeline cache {} saved, {} bytes", path, size);
+        return true;
+    }
+
+    std::pair<VkBuffer, MemoryAllocation> createBuffer(VulkanRenderDevice* vrd, VkDeviceSize size,
+                                                       VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
         VkBuffer buffer = nullptr;
         // create buffer (info about buffer, but a buffer does not contain data)
         VkBufferCreateInfo bufferCreateInfo = {
@@ -408,28 +535,36 @@ namespace Factory {
                 .pQueueFamilyIndices = nullptr,     // only relevant if concurrent sharing mode
         };
 
-        VK_CHECK(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &buffer));
+        // upload destinations are written by the transfer family and read by the graphics family
+        std::array<uint32_t, 2> families = {vrd->graphicsQueueFamilyIndex, vrd->transferQueueFamilyIndex};
+        if ((usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) && families[0] != families[1]){
+            bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferCreateInfo.queueFamilyIndexCount = families.size();
+            bufferCreateInfo.pQueueFamilyIndices = families.data();
+        }
 
-        // allocate memory on physical device for buffer
+        VK_CHECK(vkCreateBuffer(vrd->device, &bufferCreateInfo, nullptr, &buffer));
+
+        // sub-allocate memory for the buffer
         VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-        VkMemoryAllocateInfo allocateInfo = {
-                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-                .allocationSize = memRequirements.size,
-                .memoryTypeIndex = utils::findMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties)
-        };
-        VkDeviceMemory bufferMemory = nullptr;
-        VK_CHECK(vkAllocateMemory(device, &allocateInfo, nullptr, &bufferMemory));
+        vkGetBufferMemoryRequirements(vrd->device, buffer, &memRequirements);
+        MemoryAllocation allocation = vrd->allocator->allocate(memRequirements, properties, true);
 
         // bind allocated memory to buffer
-        VK_CHECK(vkBindBufferMemory(device, buffer, bufferMemory, 0));
+        VK_CHECK(vkBindBufferMemory(vrd->device, buffer, allocation.memory, allocation.offset));
 
-        return std::make_pair(buffer, bufferMemory);
+        return std::make_pair(buffer, allocation);
     }
 
-    std::pair<VkImage, VkDeviceMemory> createImage(VulkanRenderDevice* vrd, VkSampleCountFlagBits sampleCount,
-                                                   uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
-                                            VkImageUsageFlags usage, VkMemoryPropertyFlags properties) {
+    void destroyBuffer(VulkanRenderDevice* vrd, VkBuffer buffer, MemoryAllocation& allocation) {
+        vkDestroyBuffer(vrd->device, buffer, nullptr);
+        vrd->allocator->free(allocation);
+    }
+
+    std::pair<VkImage, MemoryAllocation> createImage(VulkanRenderDevice* vrd, VkSampleCountFlagBits sampleCount,
+                                                     uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
+                                                     VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+                                                     uint32_t mipLevels) {
         // create image
         VkImageCreateInfo imageCreateInfo = {
                 .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -441,7 +576,7 @@ namespace Factory {
                         .height = height,
                         .depth = 1,
                 },
-                .mipLevels = 1,
+                .mipLevels = mipLevels,
                 .arrayLayers = 1,
                 .samples = sampleCount,
                 .tiling = tiling,
@@ -450,28 +585,35 @@ namespace Factory {
                 .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
         };
 
+        // upload destinations are written by the transfer family and read by the graphics family
+        std::array<uint32_t, 2> families = {vrd->graphicsQueueFamilyIndex, vrd->transferQueueFamilyIndex};
+        if ((usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) && families[0] != families[1]){
+            imageCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            imageCreateInfo.queueFamilyIndexCount = families.size();
+            imageCreateInfo.pQueueFamilyIndices = families.data();
+        }
+
         VkImage image = nullptr;
         VK_CHECK(vkCreateImage(vrd->device, &imageCreateInfo, nullptr, &image));
 
-        // allocate memory
+        // sub-allocate memory. Linear images are pooled with the buffers
         VkMemoryRequirements memoryRequirements;
         vkGetImageMemoryRequirements(vrd->device, image, &memoryRequirements);
-        VkMemoryAllocateInfo allocateInfo = {
-                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-                .allocationSize = memoryRequirements.size,
-                .memoryTypeIndex = utils::findMemoryType(vrd->physicalDevice, memoryRequirements.memoryTypeBits, properties)
-        };
-
-        VkDeviceMemory deviceMemory = nullptr;
-        VK_CHECK(vkAllocateMemory(vrd->device, &allocateInfo, nullptr, &deviceMemory));
+        MemoryAllocation allocation = vrd->allocator->allocate(memoryRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR);
 
         // bind image to memory
-        VK_CHECK(vkBindImageMemory(vrd->device, image, deviceMemory, 0));
+        VK_CHECK(vkBindImageMemory(vrd->device, image, allocation.memory, allocation.offset));
+
+        return std::make_pair(image, allocation);
+    }
 
-        return std::make_pair(image, deviceMemory);
+    void destroyImage(VulkanRenderDevice* vrd, VkImage image, MemoryAllocation& allocation) {
+        vkDestroyImage(vrd->device, image, nullptr);
+        vrd->allocator->free(allocation);
     }
 
-    VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
+    VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags,
+                                uint32_t baseMipLevel, uint32_t levelCount) {
         VkImageView imageView = nullptr;
         const VkImageViewCreateInfo viewInfo = {
                 .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -488,8 +630,8 @@ namespace Factory {
                 },
                 .subresourceRange = {
                         .aspectMask = aspectFlags,
-                        .baseMipLevel = 0,
-                        .levelCount = 1,
+                        .baseMipLevel = baseMipLevel,
+                        .levelCount = levelCount,
                         .baseArrayLayer = 0,
                         .layerCount = 1
                 }
@@ -502,7 +644,10 @@ namespace Factory {
     VkDescriptorPool createDescriptorPool(VkDevice device, uint32_t imageCount,
                                                            uint32_t uniformBufferCount,
                                                            uint32_t storageBufferCount,
-                                                           uint32_t samplerImageCount) {
+                                                           uint32_t samplerImageCount,
+                                                           uint32_t uniformBufferDynamicCount,
+                                                           uint32_t storageBufferDynamicCount,
+                                                           uint32_t storageImageCount) {
 
         std::vector<VkDescriptorPoolSize> poolSizes;
         if (uniformBufferCount){
@@ -518,12 +663,31 @@ namespace Factory {
             });
         }
 
+        if (uniformBufferDynamicCount){
+            poolSizes.push_back(VkDescriptorPoolSize{
+                .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                .descriptorCount = uniformBufferDynamicCount * imageCount
+            });
+        }
+        if (storageBufferDynamicCount){
+            poolSizes.push_back(VkDescriptorPoolSize{
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+                .descriptorCount = storageBufferDynamicCount * imageCount
+            });
+        }
+
         if (samplerImageCount){
             poolSizes.push_back(VkDescriptorPoolSize{
                     .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                     .descriptorCount = samplerImageCount * imageCount
             });
         }
+        if (storageImageCount){
+            poolSizes.push_back(VkDescriptorPoolSize{
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    .descriptorCount = storageImageCount * imageCount
+            });
+        }
 
         VkDescriptorPoolCreateInfo createInfo = {
                 .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
@@ -542,6 +706,7 @@ namespace Factory {
 
         // temp variables used to count descriptor count by type
         uint32_t uniformBufferCount = 0, storageBufferCount = 0, samplerImageCount = 0;
+        uint32_t uniformBufferDynamicCount = 0, storageBufferDynamicCount = 0, storageImageCount = 0;
 
         // create layout bindings
         std::vector<VkDescriptorSetLayoutBinding> layoutBindings(descriptors.size());
@@ -555,7 +720,7 @@ namespace Factory {
                     .stageFlags = descriptors[i].shaderStage
             };
 
-            // add type of descriptor to descriptor count (only samplerImages can be arrays)
+            // add type of descriptor to descriptor count (only samplerImages and storage images can be arrays)
             switch (descriptors[i].type) {
                 case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
                     uniformBufferCount++;
@@ -563,10 +728,19 @@ namespace Factory {
                 case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
                     storageBufferCount++;
                     break;
+                case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+                    uniformBufferDynamicCount++;
+                    break;
+                case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+                    storageBufferDynamicCount++;
+                    break;
                 case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
                     // imageInfos must exist if of type image sampler!
                     samplerImageCount += imageInfos->size();
                     break;
+                case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+                    storageImageCount += imageInfos->size();
+                    break;
                 default:
                     VK_ASSERT(false, "Descriptor's type not supported : " + std::string(magic_enum::enum_name(descriptors[i].type)));
             }
@@ -601,7 +775,9 @@ namespace Factory {
         // Other times, vkAllocateDescriptorSets will fail and return VK_ERROR_POOL_OUT_OF_MEMORY.
         // This can be particularly frustrating if the allocation succeeds on some machines, but fails on others.
         VkDescriptorPool descriptorPool = Factory::createDescriptorPool(renderDevice->device, MAX_FRAMES_IN_FLIGHT,
-                                                                        uniformBufferCount, storageBufferCount, samplerImageCount);
+                                                                        uniformBufferCount, storageBufferCount, samplerImageCount,
+                                                                        uniformBufferDynamicCount, storageBufferDynamicCount,
+                                                                        storageImageCount);
 
         std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts = {descriptorSetLayout, descriptorSetLayout};
 
@@ -616,34 +792,38 @@ namespace Factory {
         VK_CHECK(vkAllocateDescriptorSets(renderDevice->device, &descriptorSetAI, descriptorSets.data()));
 
         // update the descriptor sets with the ressources handles
-        for (uint32_t i = 0; i < descriptorSets.size(); ++i) {
-            // create write descriptor set for each descriptor set
-            std::vector<VkWriteDescriptorSet> writeDescriptorSets(descriptors.size());
-
-            for (uint32_t j = 0; j < descriptors.size(); ++j){
-                auto& descWrite = writeDescriptorSets[j];
-                descWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                descWrite.dstSet = descriptorSets[i];
-                descWrite.dstBinding = j;
-                descWrite.dstArrayElement = 0;
-                descWrite.descriptorType = descriptors[j].type;
-
-                auto* imageInfo = std::get_if<std::vector<VkDescriptorImageInfo>>(&descriptors[j].info);
-                if (imageInfo != nullptr){
-                    descWrite.descriptorCount = imageInfo->size();
-                    descWrite.pImageInfo = imageInfo->data();
-                }
-                else {
-                    descWrite.descriptorCount = 1;
-                    descWrite.pBufferInfo = &std::get<std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>>(descriptors[j].info)[i];
-                }
-            }
-
-            // update the descriptor sets with the created descriptor writes
-            vkUpdateDescriptorSets(renderDevice->device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
-        }
+        for (uint32_t i = 0; i < descriptorSets.size(); ++i)
+            updateDescriptorSet(renderDevice, descriptorSets[i], descriptors, i);
 
         // return all the handles
         return std::make_tuple(descriptorSetLayout, pipelineLayout, descriptorPool, descriptorSets);
     }
+
+    void Factory::updateDescriptorSet(VulkanRenderDevice* renderDevice, VkDescriptorSet descriptorSet,
+                                      const std::vector<Descriptor>& descriptors, uint32_t frameIndex) {
+        // create write descriptor set for each descriptor
+        std::vector<VkWriteDescriptorSet> writeDescriptorSets(descriptors.size());
+
+        for (uint32_t j = 0; j < descriptors.size(); ++j){
+            auto& descWrite = writeDescriptorSets[j];
+            descWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descWrite.dstSet = descriptorSet;
+            descWrite.dstBinding = j;
+            descWrite.dstArrayElement = 0;
+            descWrite.descriptorType = descriptors[j].type;
+
+            auto* imageInfo = std::get_if<std::vector<VkDescriptorImageInfo>>(&descriptors[j].info);
+            if (imageInfo != nullptr){
+                descWrite.descriptorCount = imageInfo->size();
+                descWrite.pImageInfo = imageInfo->data();
+            }
+            else {
+                descWrite.descriptorCount = 1;
+                descWrite.pBufferInfo = &std::get<std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>>(descriptors[j].info)[frameIndex];
+            }
+        }
+
+        // update the descriptor set with the created descriptor writes
+        vkUpdateDescriptorSets(renderDevice->device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
+    }
 }
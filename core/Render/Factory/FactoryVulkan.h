@@ -5,6 +5,7 @@
 #pragma once
 
 #include "../VulkanRenderDevice.hpp"
+#include "../MemoryAllocator.h"
 
 #include <vulkan/vulkan.h>
 #include <optional>
@@ -25,15 +26,16 @@ namespace Factory {
    bool setupDebugCallbacks(VkInstance instance, VkDebugUtilsMessengerEXT* messenger, VkDebugReportCallbackEXT* reportCallback);
    void freeDebugCallbacks(VkInstance instance, VkDebugUtilsMessengerEXT messenger, VkDebugReportCallbackEXT reportCallback);
 
-   /// create a logical device
-   VkDevice createDevice(VkPhysicalDevice physicalDevice, uint32_t graphicsQueueFamilyIndex,
+   /// create a logical device with one graphics queue and one transfer queue (if the families differ)
+   VkDevice createDevice(VkPhysicalDevice physicalDevice, uint32_t graphicsQueueFamilyIndex, uint32_t transferQueueFamilyIndex,
                          const VkPhysicalDeviceFeatures& features);
 
    /// sync objects
    VkSemaphore createSemaphore(VkDevice device);
    VkFence createFence(VkDevice device, bool startSignaled); /// signaled = available to used
 
-   VkShaderModule createShaderModule(VkDevice device, const std::string& filename);
+   /// the pipelines get their modules from the shader library of the device, see ShaderLibrary
+   VkShaderModule createShaderModule(VkDevice device, const uint32_t* code, size_t codeSize);
 
    struct GraphicsPipelineProps{
        // vertex input
@@ -50,30 +52,55 @@ namespace Factory {
        VkBool32 enableBackFaceCulling = VK_TRUE;
        VkSampleCountFlagBits sampleCountMSAA = VK_SAMPLE_COUNT_1_BIT;
 
-       std::vector<VkDynamicState> dynamicStates;
+       std::vector<VkDynamicState> dynamicStates;  ///< the viewport and scissor are always dynamic
    };
-   VkPipeline createGraphicsPipeline(VkDevice device, VkExtent2D& extent, VkRenderPass renderPass,
-                                     VkPipelineLayout pipelineLayout, const GraphicsPipelineProps& props);
-
-   /// memory
-   std::pair<VkBuffer, VkDeviceMemory> createBuffer(VkDevice device, VkPhysicalDevice physicalDevice,
-       VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
-
-   std::pair<VkImage, VkDeviceMemory> createImage(VulkanRenderDevice* vrd, VkSampleCountFlagBits sampleCount,
-                                                  uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
-                                                  VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
-
-   VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+   /// the viewport and scissor are dynamic, they must be set before drawing
+   VkPipeline createGraphicsPipeline(VulkanRenderDevice* vrd, VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
+                                     const GraphicsPipelineProps& props);
+
+   /// compute pipeline made of a single compute shader
+   VkPipeline createComputePipeline(VulkanRenderDevice* vrd, VkPipelineLayout pipelineLayout, const std::string& shaderFile,
+                                    VkSpecializationInfo* specializationInfo = nullptr);
+
+   /// time spent creating the pipelines since the start, in seconds. The pipeline creations can be concurrent
+   float getPipelineCreationTime();
+
+   /// pipeline cache filled with the file written by savePipelineCache. The file is ignored (the cache starts empty) if
+   /// it is missing, corrupted or written by another device or driver version
+   VkPipelineCache createPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path);
+   /// writes the content of the cache, prefixed by the device and driver version. Returns false on failure
+   bool savePipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, VkPipelineCache pipelineCache,
+                          const std::string& path);
+
+   /// memory. Buffers and images are bound to memory sub-allocated from the render device allocator
+   std::pair<VkBuffer, MemoryAllocation> createBuffer(VulkanRenderDevice* vrd, VkDeviceSize size,
+                                                      VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+   void destroyBuffer(VulkanRenderDevice* vrd, VkBuffer buffer, MemoryAllocation& allocation);
+
+   std::pair<VkImage, MemoryAllocation> createImage(VulkanRenderDevice* vrd, VkSampleCountFlagBits sampleCount,
+                                                    uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
+                                                    VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+                                                    uint32_t mipLevels = 1);
+   void destroyImage(VulkanRenderDevice* vrd, VkImage image, MemoryAllocation& allocation);
+
+   /// view of levelCount mip levels of the image, starting at baseMipLevel
+   VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags,
+                               uint32_t baseMipLevel = 0, uint32_t levelCount = 1);
 
    /// descriptors
    VkDescriptorPool createDescriptorPool(VkDevice device, uint32_t imageCount,
                                                           uint32_t uniformBufferCount,
                                                           uint32_t storageBufferCount,
-                                                          uint32_t samplerImageCount);
+                                                          uint32_t samplerImageCount,
+                                                          uint32_t uniformBufferDynamicCount = 0,
+                                                          uint32_t storageBufferDynamicCount = 0,
+                                                          uint32_t storageImageCount = 0);
 
    /// describes a descriptor. For now the following are supported :
    /// - Array of textures
+   /// - Array of storage images
    /// - One descriptor per frame in flight (can be duplicated if ressource is the same for both frame in flight)
+   /// - Dynamic uniform/storage buffers. The offset of the buffer info is added to the dynamic offset given when binding
    struct Descriptor {
        VkDescriptorType type;
        VkShaderStageFlags shaderStage;
@@ -82,5 +109,8 @@ namespace Factory {
    std::tuple<VkDescriptorSetLayout, VkPipelineLayout, VkDescriptorPool, std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT>>
            createDescriptorSets(VulkanRenderDevice* renderDevice, const std::vector<Descriptor>& descriptors,
                                 const std::vector<VkPushConstantRange>& pushConstants);
+   /// writes the resources of the frame in flight in its descriptor set. The set must not be in use by the GPU
+   void updateDescriptorSet(VulkanRenderDevice* renderDevice, VkDescriptorSet descriptorSet,
+                            const std::vector<Descriptor>& descriptors, uint32_t frameIndex);
 }
 
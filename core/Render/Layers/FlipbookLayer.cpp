@@ -94,14 +94,14 @@ FlipbookLayer::FlipbookLayer(VkRenderPass renderPass) {
             .enableDepthTest = VK_FALSE, // disable depth test! (won't really matter since we are writing at min depth anyway (0)
             .sampleCountMSAA = _vrd->sampleCount
     };
-    _graphicsPipeline = Factory::createGraphicsPipeline(_vrd->device, _swapchainExtent, renderPass, _pipelineLayout, props);
+    _graphicsPipeline = Factory::createGraphicsPipeline(_vrd, renderPass, _pipelineLayout, props);
 }
 
 FlipbookLayer::~FlipbookLayer() {
     vkDestroySampler(_vrd->device, _sampler, nullptr);
     for (auto& texture : _textures)
-        texture.destroy(_vrd->device);
-    _vertices.destroy(_vrd->device);
+        texture.destroy(_vrd);
+    _vertices.destroy(_vrd);
 }
 
 void FlipbookLayer::update(float dt, uint32_t commandBufferIndex, const glm::mat4& pv) {
@@ -47,6 +47,7 @@ ImGuiLayer::ImGuiLayer(VkRenderPass renderPass) {
             .Device = _vrd->device,
             .QueueFamily = _vrd->graphicsQueueFamilyIndex,
             .Queue = _vrd->graphicsQueue,
+            .PipelineCache = _vrd->pipelineCache,
             .DescriptorPool = _descriptorPool,
             .Subpass = 0,
             .MinImageCount = 2,
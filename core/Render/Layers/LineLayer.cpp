@@ -4,15 +4,11 @@
 
 #include "LineLayer.h"
 #include "../Factory/FactoryVulkan.h"
+#include "../PipelineBuilder.h"
 #include "../../Utils/UtilsTemplate.h"
 
 LineLayer::LineLayer(VkRenderPass renderPass) : RenderLayer() {
 
-    // init the uniform buffers
-    for (auto& buffer : _mvpUniformBuffers) {
-        buffer.init(_vrd->device, _vrd->physicalDevice, sizeof(glm::mat4));
-    }
-
     // add lines to create a plane
     plane3d(glm::vec3(0.f, 0.f, -1.f), {1.f, 0.f, 0.f}, {0.f, 0.f, 1.f}, 10, 10, 3.f, 3.f, glm::vec4(0.7f), glm::vec4(1.f));
 
@@ -21,11 +17,11 @@ LineLayer::LineLayer(VkRenderPass renderPass) : RenderLayer() {
 
     std::vector<Factory::Descriptor> descriptors = {
             {
-                    .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
                     .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
                     .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
-                            VkDescriptorBufferInfo{_mvpUniformBuffers[0].getBuffer(), 0, _mvpUniformBuffers[0].getSize()},
-                            VkDescriptorBufferInfo{_mvpUniformBuffers[1].getBuffer(), 0, _mvpUniformBuffers[1].getSize()},
+                            VkDescriptorBufferInfo{_uploadArena->getBuffer(), 0, sizeof(glm::mat4)},
+                            VkDescriptorBufferInfo{_uploadArena->getBuffer(), 0, sizeof(glm::mat4)},
                     }
             },
             {
@@ -51,27 +47,21 @@ LineLayer::LineLayer(VkRenderPass renderPass) : RenderLayer() {
             .sampleCountMSAA = _vrd->sampleCount
     };
 
-    _graphicsPipeline = Factory::createGraphicsPipeline(_vrd->device, _swapchainExtent, renderPass, _pipelineLayout, props);
+    _vrd->pipelineBuilder->queueGraphicsPipeline(&_graphicsPipeline, renderPass, _pipelineLayout, props);
 }
 
 LineLayer::~LineLayer() {
-    for (auto buffer : _mvpUniformBuffers)
-        buffer.destroy(_vrd->device);
-
-    _pointsSSBO.destroy(_vrd->device);
+    _pointsSSBO.destroy(_vrd);
 }
 
 void LineLayer::fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0,
-                            1, &_descriptorSets[commandBufferIndex], 0, nullptr);
+    bindPipelineAndDS(commandBuffer, commandBufferIndex, {_mvpOffset});
 
     vkCmdDraw(commandBuffer, _lines.size(), 1, 0, 0);
 }
 
 void LineLayer::update(float dt, uint32_t commandBufferIndex, const glm::mat4& pv) {
-    glm::mat4 mvp = pv;
-    _mvpUniformBuffers[commandBufferIndex].setData(_vrd->device, glm::value_ptr(mvp), sizeof(mvp));
+    _mvpOffset = _uploadArena->push(glm::value_ptr(pv), sizeof(pv));
 }
 
 void LineLayer::onEvent(Event& event) {}
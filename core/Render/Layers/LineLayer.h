@@ -5,7 +5,6 @@
 #pragma once
 
 #include "RenderLayer.h"
-#include "../Objects/UniformBuffer.h"
 #include "../Objects/ShaderStorageBuffer.h"
 #include "../Objects/Texture.h"
 
@@ -37,5 +36,5 @@ private:
     DeviceSSBO _pointsSSBO{}; // TODO : probably want dynamic buffer
     std::vector<VertexData> _lines{};
 
-    std::array<UniformBuffer, MAX_FRAMES_IN_FLIGHT> _mvpUniformBuffers{};
+    uint32_t _mvpOffset = 0; ///< dynamic offset of the mvp in the upload arena
 };
\ No newline at end of file
@@ -4,16 +4,13 @@
 
 #include "ModelLayer.h"
 #include "../Factory/FactoryVulkan.h"
+#include "../PipelineBuilder.h"
 #include "../Factory/FactoryModel.h"
 
 #include "../../Application.h"
 #include "../../Utils/UtilsTemplate.h"
 
 ModelLayer::ModelLayer(VkRenderPass renderPass) : RenderLayer() {
-    // init the uniform buffers
-    for (auto& buffer : _mvpUniformBuffers)
-        buffer.init(_vrd->device, _vrd->physicalDevice, sizeof(glm::mat4));
-
     // create duck model
     std::vector<TexVertex> vertices;
     std::vector<uint32_t> indices;
@@ -46,15 +43,11 @@ ModelLayer::ModelLayer(VkRenderPass renderPass) : RenderLayer() {
             },
             .sampleCountMSAA = _vrd->sampleCount
     };
-    _graphicsPipeline = Factory::createGraphicsPipeline(_vrd->device, _swapchainExtent, renderPass, _pipelineLayout, props);
+    _vrd->pipelineBuilder->queueGraphicsPipeline(&_graphicsPipeline, renderPass, _pipelineLayout, props);
 }
 
 ModelLayer::~ModelLayer() {
-    // destroy the buffers
-    for (auto& buffer : _mvpUniformBuffers)
-        buffer.destroy(_vrd->device);
-
-    _texture.destroy(_vrd->device);
+    _texture.destroy(_vrd);
 }
 
 void ModelLayer::update(float dt, uint32_t commandBufferIndex, const glm::mat4& pv) {
@@ -68,7 +61,7 @@ void ModelLayer::update(float dt, uint32_t commandBufferIndex, const glm::mat4&
     );
 
     glm::mat4 mvp = pv * m;
-    VK_ASSERT(_mvpUniformBuffers[commandBufferIndex].setData(_vrd->device, glm::value_ptr(mvp), sizeof(mvp)), "Failed to dat");
+    _mvpOffset = _uploadArena->push(glm::value_ptr(mvp), sizeof(mvp));
 }
 
 void ModelLayer::onEvent(Event& event) {}
@@ -76,7 +69,7 @@ void ModelLayer::onEvent(Event& event) {}
 
 void ModelLayer::fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {
     // bind pipeline and render
-    bindPipelineAndDS(commandBuffer, commandBufferIndex);
+    bindPipelineAndDS(commandBuffer, commandBufferIndex, {_mvpOffset});
     _vertexBuffer.bind(commandBuffer);
     _indexBuffer.bind(commandBuffer);
     vkCmdDrawIndexed(commandBuffer, _indexBuffer.getIndexCount(), 1, 0, 0, 0);
@@ -93,11 +86,11 @@ void ModelLayer::createDescriptors() {
     // describe
     std::vector<Factory::Descriptor> descriptors = {
             {
-                .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
                 .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
                 .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
-                    VkDescriptorBufferInfo {_mvpUniformBuffers[0].getBuffer(), 0, _mvpUniformBuffers[0].getSize()},
-                    VkDescriptorBufferInfo {_mvpUniformBuffers[1].getBuffer(), 0, _mvpUniformBuffers[1].getSize()},
+                    VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, sizeof(glm::mat4)},
+                    VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, sizeof(glm::mat4)},
                 }
             },
             {
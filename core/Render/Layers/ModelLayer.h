@@ -5,7 +5,6 @@
 #pragma once
 
 #include "RenderLayer.h"
-#include "../Objects/UniformBuffer.h"
 #include "../Objects/ShaderStorageBuffer.h"
 #include "../Objects/Texture.h"
 #include "../Objects/VertexBuffer.h"
@@ -27,7 +26,7 @@ private:
 
 private:
     // Buffers
-    std::array<UniformBuffer, MAX_FRAMES_IN_FLIGHT> _mvpUniformBuffers{};
+    uint32_t _mvpOffset = 0; ///< dynamic offset of the mvp in the upload arena
     VertexBuffer _vertexBuffer{};
     IndexBuffer  _indexBuffer{};
 
@@ -5,146 +5,271 @@
 #include "MultiMeshLayer.h"
 
 #include "../Factory/FactoryVulkan.h"
+#include "../PipelineBuilder.h"
 #include "../Factory/FactoryModel.h"
 #include "../../Utils/UtilsMath.h"
+#include "../../Utils/UtilsMesh.h"
 #include "../../Application.h"
 #include "../../events/KeyEvent.h"
 #include "../../Utils/UtilsTemplate.h"
 
+#include <bit>
+#include <algorithm>
 
-MultiMeshLayer::MultiMeshLayer(VkRenderPass renderPass) {
+
+MultiMeshLayer::MultiMeshLayer(VkRenderPass renderPass) : _renderPass(renderPass) {
     // static assert making sure no padding is added to our struct, or else SSBO will be wrong (does not expect padding)
     static_assert(sizeof(Material) ==  sizeof(Material::ambientColor) +
                                        sizeof(Material::diffuseColor) +
                                        sizeof(Material::specularColor));
+    static_assert(sizeof(Vertex) == sizeof(Vertex::position) + sizeof(Vertex::normal) + sizeof(Vertex::uv));
+    static_assert(sizeof(utils::PackedVertex) == 16);
 
-    // init the uniform buffers
-    for (auto& buffer : _vpUniformBuffers)
-        buffer.init(_vrd->device, _vrd->physicalDevice, sizeof(glm::mat4));
-
-    std::shared_ptr<Scene> scene = getCurrentScene();
-    //FactoryModel::importFromFile("../../../core/Assets/Models/Nano/nanosuit.obj", _scene);
-    //FactoryModel::importFromFile("../../../core/Assets/Models/utahTeapot.fbx", _scene);
-    //FactoryModel::importFromFile("../../../core/Assets/Models/engine.fbx", _scene);
+    // the models are parsed on worker threads, they are added to the scene as soon as they are loaded (see update)
+    //_pendingImports.push_back({FactoryModel::loadFromFileAsync("../../../core/Assets/Models/Nano/nanosuit.obj")});
+    //_pendingImports.push_back({FactoryModel::loadFromFileAsync("../../../core/Assets/Models/utahTeapot.fbx")});
+    //_pendingImports.push_back({FactoryModel::loadFromFileAsync("../../../core/Assets/Models/engine.fbx")});
     // https://sketchfab.com/3d-models/low-poly-truck-car-drifter-f3750246b6564607afbefc61cb1683b1
 #define DRIFTER
 #ifdef DRIFTER
-    FactoryModel::importFromFile("../../../core/Assets/Models/Drifter/source/Jeep_done.fbx", scene);
     // nice little model but the default scale is stupid
-    auto& rootTransform = scene->getTransform(1);
-    rootTransform.scale *= 0.01f;
-    rootTransform.needUpdateModelMatrix = true;
-    scene->setDirtyTransform(1);
+    _pendingImports.push_back({FactoryModel::loadFromFileAsync("../../../core/Assets/Models/Drifter/source/Jeep_done.fbx"), 0.01f});
 #endif
 
-    FactoryModel::importFromFile("../../../core/Assets/Models/Bell Huey.fbx", scene);
-    //FactoryModel::importFromFile("../../../core/Assets/Models/duck/scene.gltf", _scene);
+    _pendingImports.push_back({FactoryModel::loadFromFileAsync("../../../core/Assets/Models/Bell Huey.fbx")});
+    //_pendingImports.push_back({FactoryModel::loadFromFileAsync("../../../core/Assets/Models/duck/scene.gltf")});
 
-    static_assert(sizeof(Vertex) == sizeof(Vertex::position) + sizeof(Vertex::normal) + sizeof(Vertex::uv));
+    // init the statue texture
+    //_texture.init("../../../core/Assets/Models/duck/textures/Duck_baseColor.png", _vrd->device, _vrd->physicalDevice, _vrd->graphicsQueue, _vrd->commandPool);
 
-    auto [vertices, vtxSize] = scene->getVerticesData();
-    auto [indices, idxSize] = scene->getIndicesData();
+    // create the selected mesh layer, it receives the scene buffers once the first model is loaded
+    _selectedMeshLayer = std::make_shared<SelectedMeshLayer>(renderPass);
 
-    // init the vertices ssbo
-    _vertices.init(_vrd, vtxSize, vertices);
+    // occlusion culling reads the farthest depth of the early pass from the pyramid
+    _depthPyramid.init(_vrd, _swapchainExtent, _depthImageView);
 
-    // init the indices ssbo
-    _indices.init(_vrd, idxSize, indices);
+    // pipeline statistics of the draws, compares the vertex shader invocations of indexed and non indexed draws
+    VkQueryPoolCreateInfo queryPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+            .queryCount = STATISTICS_QUERY_COUNT * MAX_FRAMES_IN_FLIGHT,
+            .pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+                                  VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+    };
+    VK_CHECK(vkCreateQueryPool(_vrd->device, &queryPoolCreateInfo, nullptr, &_statisticsQueryPool));
+}
 
-    // vector containing the indices of all meshes
-    std::vector<uint32_t> materialIndices;
+MultiMeshLayer::~MultiMeshLayer() {
+    // pending imports are left to finish on the workers, their result is discarded
+    destroySceneBuffers();
+    destroyCullingPipeline();
+    _depthPyramid.destroy(_vrd);
+    vkDestroyQueryPool(_vrd->device, _statisticsQueryPool, nullptr);
 
-    // add all meshes as indirect commands
-    std::vector<VkDrawIndirectCommand> indirectCommands;
-    const auto& meshes = scene->getMeshes();
-    for (uint32_t i = 0; i < meshes.size(); ++i){
-        indirectCommands.push_back({
-               .vertexCount = meshes[i].indexCount,
-               .instanceCount = 1,
-               .firstVertex = meshes[i].firstVertexIndex,
-               .firstInstance = i
-       });
-        materialIndices.push_back(meshes[i].materialIndex);
-    }
+    //_texture.destroy(_vrd);
+}
 
-    // set the commands in the command buffer
-    _indirectCommandBuffer.init(_vrd, utils::vectorSizeByte(indirectCommands),
-                                indirectCommands.data(), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+void MultiMeshLayer::fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {
+    // nothing to render until the first model is loaded
+    if (_drawCount == 0)
+        return;
+
+    // the early pass used the first query of the frame
+    uint32_t query = commandBufferIndex * STATISTICS_QUERY_COUNT + (usesEarlyPass() ? 1 : 0);
+    vkCmdBeginQuery(commandBuffer, _statisticsQueryPool, query, 0);
+
+    switch (_cullingMode) {
+        case CullingMode::NONE:
+            // draw all meshes
+            bindPipelineAndCamera(commandBuffer, commandBufferIndex);
+            if (_indexedDraws)
+                vkCmdDrawIndexedIndirect(commandBuffer, _indirectCommandBuffer.getBuffer(), 0, _drawCount, _commandSize);
+            else
+                vkCmdDrawIndirect(commandBuffer, _indirectCommandBuffer.getBuffer(), 0, _drawCount, _commandSize);
+            break;
+        case CullingMode::FRUSTUM:
+            drawVisibleCommands(commandBuffer, commandBufferIndex, _visibleCommands[commandBufferIndex]);
+            break;
+        case CullingMode::OCCLUSION:
+            // the meshes visible last frame were drawn in the early pass, draw the newly visible ones
+            drawVisibleCommands(commandBuffer, commandBufferIndex, _lateCommands[commandBufferIndex]);
+            break;
+    }
+    vkCmdEndQuery(commandBuffer, _statisticsQueryPool, query);
+}
 
-    // init the mesh metadata buffer
-    _meshMetadata.init(_vrd, utils::vectorSizeByte(materialIndices), materialIndices.data());
+void MultiMeshLayer::fillComputeCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {
+    // recorded before the other passes, the descriptors of the frame are refreshed here
+    refreshDescriptors(commandBufferIndex);
 
-    // init the transform buffers
-    for (auto& buffer : _meshTransformBuffers){
-        buffer.init(_vrd, meshes.size() * sizeof(glm::mat4));
-    }
+    // queries must be reset before being used, outside of a render pass
+    _statisticsQueryCount[commandBufferIndex] = _drawCount == 0 ? 0 : (usesEarlyPass() ? 2 : 1);
+    if (_drawCount != 0)
+        vkCmdResetQueryPool(commandBuffer, _statisticsQueryPool, commandBufferIndex * STATISTICS_QUERY_COUNT, STATISTICS_QUERY_COUNT);
 
-    // init the materials buffer
-    const auto& materials = scene->getMaterials();
-    _materialsSSBO.init(_vrd, utils::vectorSizeByte(materials), (void*)materials.data());
+    if (_drawCount == 0 || _cullingMode == CullingMode::NONE)
+        return;
 
-    // init the statue texture
-    //_texture.init("../../../core/Assets/Models/duck/textures/Duck_baseColor.png", _vrd->device, _vrd->physicalDevice, _vrd->graphicsQueue, _vrd->commandPool);
+    // reset the draw counts. The previous frame drawing from these buffers is done (waited on its fence)
+    vkCmdFillBuffer(commandBuffer, _visibleCommands[commandBufferIndex].getBuffer(), 0, sizeof(uint32_t), 0);
+    vkCmdFillBuffer(commandBuffer, _lateCommands[commandBufferIndex].getBuffer(), 0, sizeof(uint32_t), 0);
 
-    // create our graphics pipeline
-    createDescriptors();
-    Factory::GraphicsPipelineProps props = {
-            .shaders =  {
-                    .vertex = "multiV.spv",
-                    .fragment = "multiF.spv"
-            },
-            .sampleCountMSAA = _vrd->sampleCount
+    // the visibility is written by the late phase of the previous frame
+    VkMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
     };
-    _graphicsPipeline = Factory::createGraphicsPipeline(_vrd->device, _swapchainExtent, renderPass, _pipelineLayout, props);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-    // create the selected mesh layer
-    SelectedMeshLayer::Props selectedMeshProps = {
-        .vertices = _vertices,
-        .indices = _indices,
-        .meshTransformBuffers = _meshTransformBuffers
-    };
-    _selectedMeshLayer = std::make_shared<SelectedMeshLayer>(renderPass, selectedMeshProps);
+    dispatchCulling(commandBuffer, commandBufferIndex, usesEarlyPass() ? EARLY_PHASE : FRUSTUM_PHASE);
 }
 
-MultiMeshLayer::~MultiMeshLayer() {
-    // destroy the buffers
-    for (auto& buffer : _vpUniformBuffers)
-        buffer.destroy(_vrd->device);
+bool MultiMeshLayer::usesEarlyPass() {
+    return _drawCount != 0 && _cullingMode == CullingMode::OCCLUSION;
+}
 
-    for (auto& buffer : _meshTransformBuffers)
-        buffer.destroy(_vrd->device);
+void MultiMeshLayer::fillEarlyCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {
+    if (!usesEarlyPass())
+        return;
 
-    _indirectCommandBuffer.destroy(_vrd->device);
-    _vertices.destroy(_vrd->device);
-    _indices.destroy(_vrd->device);
-    _meshMetadata.destroy(_vrd->device);
-    _materialsSSBO.destroy(_vrd->device);
+    // meshes visible last frame, they fill the depth used to build the pyramid
+    uint32_t query = commandBufferIndex * STATISTICS_QUERY_COUNT;
+    vkCmdBeginQuery(commandBuffer, _statisticsQueryPool, query, 0);
+    drawVisibleCommands(commandBuffer, commandBufferIndex, _visibleCommands[commandBufferIndex]);
+    vkCmdEndQuery(commandBuffer, _statisticsQueryPool, query);
+}
+
+void MultiMeshLayer::fillLateComputeCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {
+    if (!usesEarlyPass())
+        return;
 
-    //_texture.destroy(_vrd->device);
+    // test all meshes against the depth of the early pass, the visibility is updated for the next frame
+    _depthPyramid.build(commandBuffer);
+    dispatchCulling(commandBuffer, commandBufferIndex, LATE_PHASE);
 }
 
-void MultiMeshLayer::fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {
+void MultiMeshLayer::dispatchCulling(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex, CullingPhase phase) {
+    // one invocation per mesh, the visible meshes append their command
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout, 0, 1,
+                            &_cullDescriptorSets[commandBufferIndex], 1, &_cullingDataOffset);
+
+    CullingPush push = {.meshCount = _drawCount, .phase = phase, .commandSize = _commandSize / (uint32_t)sizeof(uint32_t)};
+    vkCmdPushConstants(commandBuffer, _cullPipelineLayout, _cullingPC.stageFlags, _cullingPC.offset, _cullingPC.size, &push);
+    vkCmdDispatch(commandBuffer, (_drawCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+    // the draw counts and the commands are read by the indirect draws
+    VkMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void MultiMeshLayer::bindPipelineAndCamera(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {
     Camera* camera = Application::getApp()->getRenderer()->getCamera();
-    // bind pipeline
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
+    // bind pipeline and descriptor sets, with the offsets of this frame's data in the upload arena
+    bindPipelineAndDS(commandBuffer, commandBufferIndex, {_vpOffset});
 
-    // push the camera pos and bind descriptor sets
+    // push the camera pos
     vkCmdPushConstants(commandBuffer, _pipelineLayout, _cameraPosPC.stageFlags, _cameraPosPC.offset, _cameraPosPC.size,
                        camera->getPosition());
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout,
-                            0, 1, &_descriptorSets[commandBufferIndex], 0, nullptr);
 
-    // render
-    vkCmdDrawIndirect(commandBuffer, _indirectCommandBuffer.getBuffer(), 0,
-                      getCurrentScene()->getMeshes().size(), sizeof(VkDrawIndirectCommand));
+    // the vertex shader reads the vertex index from gl_VertexIndex
+    if (_indexedDraws)
+        vkCmdBindIndexBuffer(commandBuffer, _indices.getBuffer(), 0, _indexType);
+}
+
+void MultiMeshLayer::drawVisibleCommands(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex, const DeviceSSBO& commands) {
+    bindPipelineAndCamera(commandBuffer, commandBufferIndex);
+
+    // render the visible meshes, their count is read from the buffer written by the culling
+    if (_indexedDraws)
+        vkCmdDrawIndexedIndirectCount(commandBuffer, commands.getBuffer(), VISIBLE_COMMANDS_OFFSET, commands.getBuffer(), 0,
+                                      _drawCount, _commandSize);
+    else
+        vkCmdDrawIndirectCount(commandBuffer, commands.getBuffer(), VISIBLE_COMMANDS_OFFSET, commands.getBuffer(), 0,
+                               _drawCount, _commandSize);
 }
 
 void MultiMeshLayer::update(float dt, uint32_t commandBufferIndex, const glm::mat4& pv) {
+    // the GPU is done with this frame in flight, its queries are about to be reset
+    readPipelineStatistics(commandBufferIndex);
+    releaseRetired();
+
+    mergeLoadedModels();
+    if (_drawCount == 0)
+        return;
+
     getCurrentScene()->propagateTransforms();
-    glm::mat4 nec = pv; // TODO : necessary??
-    VK_ASSERT(_vpUniformBuffers[commandBufferIndex].setData(_vrd->device, glm::value_ptr(nec), sizeof(pv)), "Failed to dat");
-    const auto& transforms = getCurrentScene()->getWorldTransforms(RenderNode::MESH);
-    _meshTransformBuffers[commandBufferIndex].setData(_vrd, (void*)transforms.data(), utils::vectorSizeByte(transforms));
+
+    // upload this frame's data in the upload arena, and the changed transforms in the buffers of the frame
+    _vpOffset = _uploadArena->push(glm::value_ptr(pv), sizeof(pv));
+    // the lods error is projected with the vertical scale of the projection, P[1][1] = 1 / tan(fov / 2)
+    Camera* camera = Application::getApp()->getRenderer()->getCamera();
+    CullingData cullingData = {
+            .pv = pv,
+            .frustumPlanes = utils::getFrustumPlanes(pv),
+            .cameraPosition = glm::vec4(*camera->getPosition(), 1.f),
+            .lodScale = std::abs(camera->getProjectionMatrix()[5]) * 0.5f * (float)_swapchainExtent.height,
+            .lodThreshold = _lodThreshold
+    };
+    _cullingDataOffset = _uploadArena->push(&cullingData, sizeof(cullingData));
+    uploadMeshTransforms(commandBufferIndex);
+}
+
+void MultiMeshLayer::uploadMeshTransforms(uint32_t commandBufferIndex) {
+    // the transforms changed by the propagation are stale in the buffers of every frame in flight
+    std::shared_ptr<Scene> scene = getCurrentScene();
+    const auto& dirtyBits = scene->getDirtyMeshTransforms();
+    for (auto& staleBits : _staleTransforms){
+        staleBits.resize(dirtyBits.size(), 0);
+        for (uint32_t word = 0; word < staleBits.size() && word < dirtyBits.size(); ++word)
+            staleBits[word] |= dirtyBits[word];
+    }
+    scene->clearDirtyMeshTransforms();
+
+    // copy the runs of consecutive stale meshes of this frame. The meshes the scene or the buffers don't hold yet stay
+    // stale, they are copied once the merged scene is uploaded
+    const auto& transforms = scene->getWorldTransforms(RenderNode::MESH);
+    const auto& normalMatrices = scene->getMeshNormalMatrices();
+    auto& transformBuffer = _meshTransformBuffers[commandBufferIndex];
+    auto& normalMatrixBuffer = _normalMatrixBuffers[commandBufferIndex];
+    uint32_t capacity = std::min({(uint32_t)transforms.size(), (uint32_t)normalMatrices.size(),
+                                  (uint32_t)(transformBuffer.getSize() / sizeof(glm::mat4)),
+                                  (uint32_t)(normalMatrixBuffer.getSize() / sizeof(glm::mat3x4))});
+    _uploadedTransformsSize = 0;
+    uint32_t runBegin = 0, runEnd = 0;
+    auto copyRun = [&](){
+        if (runBegin == runEnd)
+            return;
+        uint32_t count = runEnd - runBegin;
+        VK_ASSERT(transformBuffer.setData(_vrd, transforms.data() + runBegin, count * sizeof(glm::mat4),
+                                          runBegin * sizeof(glm::mat4)) &&
+                  normalMatrixBuffer.setData(_vrd, normalMatrices.data() + runBegin, count * sizeof(glm::mat3x4),
+                                             runBegin * sizeof(glm::mat3x4)),
+                  "Failed to copy the mesh transforms");
+        _uploadedTransformsSize += count * (sizeof(glm::mat4) + sizeof(glm::mat3x4));
+    };
+    auto& staleBits = _staleTransforms[commandBufferIndex];
+    for (uint32_t word = 0; word < staleBits.size() && word * 64 < capacity; ++word){
+        // only the bits below the capacity are copied and cleared
+        uint64_t copied = capacity - word * 64 >= 64 ? ~0ull : (1ull << (capacity - word * 64)) - 1;
+        for (uint64_t bits = staleBits[word] & copied; bits != 0; bits &= bits - 1){
+            uint32_t meshIndex = word * 64 + std::countr_zero(bits);
+            if (meshIndex != runEnd){
+                copyRun();
+                runBegin = meshIndex;
+            }
+            runEnd = meshIndex + 1;
+        }
+        staleBits[word] &= ~copied;
+    }
+    copyRun();
 }
 
 void MultiMeshLayer::onEvent(Event& event) {
@@ -152,24 +277,114 @@ void MultiMeshLayer::onEvent(Event& event) {
 }
 
 void MultiMeshLayer::onImGuiRender() {
+    ImGui::Begin("Culling");
+    const char* cullingModes[] = {"None", "Frustum", "Frustum + occlusion"};
+    ImGui::Combo("GPU culling", (int*)&_cullingMode, cullingModes, IM_ARRAYSIZE(cullingModes));
+    ImGui::Text("Meshes %u", _drawCount);
+    ImGui::Text("Transforms uploaded %u bytes", _uploadedTransformsSize);
+    ImGui::DragFloat("LOD error (pixels)", &_lodThreshold, 0.05f, 0.f, 50.f);
+    ImGui::End();
+
+    // the commands and the pipelines depend on the draw mode, they are recreated when it changes
+    ImGui::Begin("Vertex cache");
+    if (ImGui::Checkbox("Indexed draws", &_indexedDraws) && _meshCount != 0)
+        updateSceneBuffers(true);
+    if (ImGui::Checkbox("Packed vertices", &_packedVertices) && _meshCount != 0)
+        updateSceneBuffers(true);
+    ImGui::Text("Vertex buffer %.2f MB", (double)_vertices.getSize() / (1024. * 1024.));
+    ImGui::Text("Index buffer %.2f MB (%s bits)", (double)_indices.getSize() / (1024. * 1024.),
+                _indexType == VK_INDEX_TYPE_UINT16 ? "16" : "32");
+    ImGui::Text("Primitives %llu", (unsigned long long)_statistics.primitives);
+    ImGui::Text("Vertex shader invocations %llu", (unsigned long long)_statistics.vertexInvocations);
+
+    // average cache miss ratio, transformed vertices per triangle (3 without reuse)
+    if (_statistics.primitives != 0)
+        ImGui::Text("ACMR %.3f", (double)_statistics.vertexInvocations / (double)_statistics.primitives);
+    ImGui::End();
+
 //    ImGui::Begin("Specular");
 //    ImGui::DragFloat("s", &_specularS, 0.1f, 0.f, 10.f);
 //
 //    ImGui::End();
 }
 
+void MultiMeshLayer::onSwapchainRecreated() {
+    // the pyramid follows the size of the depth attachment, the culling samples the new one
+    _depthPyramid.resize(_vrd, _swapchainExtent, _depthImageView);
+    if (_cullDescriptorSets[0] == nullptr)
+        return;
+
+    VkDescriptorImageInfo pyramidInfo = {
+            .sampler = _depthPyramid.getSampler(),
+            .imageView = _depthPyramid.getImageView(),
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+    };
+    std::array<VkWriteDescriptorSet, MAX_FRAMES_IN_FLIGHT> writes{};
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i){
+        writes[i] = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = _cullDescriptorSets[i],
+                .dstBinding = 7, // depth pyramid, see cull.comp
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .pImageInfo = &pyramidInfo,
+        };
+    }
+    vkUpdateDescriptorSets(_vrd->device, writes.size(), writes.data(), 0, nullptr);
+}
+
 std::shared_ptr<SelectedMeshLayer> MultiMeshLayer::getSelectedMeshLayer() {
     return _selectedMeshLayer;
 }
 
+void MultiMeshLayer::readPipelineStatistics(uint32_t commandBufferIndex) {
+    uint32_t queryCount = _statisticsQueryCount[commandBufferIndex];
+    if (queryCount == 0)
+        return;
+
+    // the results of each query are ordered by statistic bit : primitives, then vertex shader invocations
+    std::array<PipelineStatistics, STATISTICS_QUERY_COUNT> results{};
+    VkResult result = vkGetQueryPoolResults(_vrd->device, _statisticsQueryPool, commandBufferIndex * STATISTICS_QUERY_COUNT,
+                                            queryCount, sizeof(results), results.data(), sizeof(PipelineStatistics),
+                                            VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
+        return;
+
+    _statistics = {};
+    for (uint32_t i = 0; i < queryCount; ++i){
+        _statistics.primitives += results[i].primitives;
+        _statistics.vertexInvocations += results[i].vertexInvocations;
+    }
+}
+
 void MultiMeshLayer::createDescriptors() {
-    std::vector<Factory::Descriptor> descriptors = {
+    // create fragment push constant for camera pos
+    _cameraPosPC = {
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .offset = 0,               // must be multiple of 4 (offset into push constant block)
+            .size = sizeof(glm::vec3), // must be multiple of 4
+    };
+
+    // create descriptors
+    std::tie(_descriptorSetLayout, _pipelineLayout, _descriptorPool, _descriptorSets) =
+            Factory::createDescriptorSets(_vrd, getDescriptors(), {_cameraPosPC});
+}
+
+std::vector<Factory::Descriptor> MultiMeshLayer::getDescriptors() {
+    // each frame in flight reads its own copy of the transforms
+    std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT> transformsInfos{}, normalMatricesInfos{};
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i){
+        transformsInfos[i] = {_meshTransformBuffers[i].getBuffer(), 0, _meshTransformBuffers[i].getSize()};
+        normalMatricesInfos[i] = {_normalMatrixBuffers[i].getBuffer(), 0, _normalMatrixBuffers[i].getSize()};
+    }
+
+    return {
             {
-                    .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
                     .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
                     .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
-                            VkDescriptorBufferInfo {_vpUniformBuffers[0].getBuffer(), 0, _vpUniformBuffers[0].getSize()},
-                            VkDescriptorBufferInfo {_vpUniformBuffers[1].getBuffer(), 0, _vpUniformBuffers[1].getSize()},
+                            VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, sizeof(glm::mat4)},
+                            VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, sizeof(glm::mat4)},
                     }
             },
             {
@@ -191,10 +406,7 @@ void MultiMeshLayer::createDescriptors() {
             {
                     .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                     .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
-                    .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
-                            VkDescriptorBufferInfo {_meshTransformBuffers[0].getBuffer(), 0, _meshTransformBuffers[0].getSize()},
-                            VkDescriptorBufferInfo {_meshTransformBuffers[1].getBuffer(), 0, _meshTransformBuffers[1].getSize()},
-                    }
+                    .info = transformsInfos
             },
             {
                     .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
@@ -212,16 +424,487 @@ void MultiMeshLayer::createDescriptors() {
                             VkDescriptorBufferInfo {_materialsSSBO.getBuffer(), 0, _materialsSSBO.getSize()},
                     }
             },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
+                    .info = normalMatricesInfos
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
+                    .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
+                            VkDescriptorBufferInfo {_meshBounds.getBuffer(), 0, _meshBounds.getSize()},
+                            VkDescriptorBufferInfo {_meshBounds.getBuffer(), 0, _meshBounds.getSize()},
+                    }
+            },
     };
+}
 
-    // create fragment push constant for camera pos
-    _cameraPosPC = {
-            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-            .offset = 0,               // must be multiple of 4 (offset into push constant block)
-            .size = sizeof(glm::vec3), // must be multiple of 4
+void MultiMeshLayer::refreshDescriptors(uint32_t commandBufferIndex) {
+    if (!_outdatedDescriptors[commandBufferIndex])
+        return;
+
+    Factory::updateDescriptorSet(_vrd, _descriptorSets[commandBufferIndex], getDescriptors(), commandBufferIndex);
+    Factory::updateDescriptorSet(_vrd, _cullDescriptorSets[commandBufferIndex], getCullingDescriptors(), commandBufferIndex);
+    _outdatedDescriptors[commandBufferIndex] = false;
+}
+
+void MultiMeshLayer::createCullingPipeline() {
+    // number of meshes to test and culling phase
+    _cullingPC = {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(CullingPush),
     };
 
-    // create descriptors
-    std::tie(_descriptorSetLayout, _pipelineLayout, _descriptorPool, _descriptorSets) =
-            Factory::createDescriptorSets(_vrd, descriptors, {_cameraPosPC});
+    std::tie(_cullDescriptorSetLayout, _cullPipelineLayout, _cullDescriptorPool, _cullDescriptorSets) =
+            Factory::createDescriptorSets(_vrd, getCullingDescriptors(), {_cullingPC});
+    _vrd->pipelineBuilder->queueComputePipeline(&_cullPipeline, _cullPipelineLayout, "cullC.spv");
+}
+
+std::vector<Factory::Descriptor> MultiMeshLayer::getCullingDescriptors() {
+    // same inputs for both frames in flight except the transforms, each frame writes its own visible commands
+    std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT> transformsInfos{}, visibleCommandsInfos{}, lateCommandsInfos{};
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i){
+        transformsInfos[i] = {_meshTransformBuffers[i].getBuffer(), 0, _meshTransformBuffers[i].getSize()};
+        visibleCommandsInfos[i] = {_visibleCommands[i].getBuffer(), 0, _visibleCommands[i].getSize()};
+        lateCommandsInfos[i] = {_lateCommands[i].getBuffer(), 0, _lateCommands[i].getSize()};
+    }
+
+    return {
+            {
+                    .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                    .shaderStage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
+                            VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, sizeof(CullingData)},
+                            VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, sizeof(CullingData)},
+                    }
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .shaderStage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .info = transformsInfos
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .shaderStage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
+                            VkDescriptorBufferInfo {_meshBounds.getBuffer(), 0, _meshBounds.getSize()},
+                            VkDescriptorBufferInfo {_meshBounds.getBuffer(), 0, _meshBounds.getSize()},
+                    }
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .shaderStage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
+                            VkDescriptorBufferInfo {_indirectCommandBuffer.getBuffer(), 0, _indirectCommandBuffer.getSize()},
+                            VkDescriptorBufferInfo {_indirectCommandBuffer.getBuffer(), 0, _indirectCommandBuffer.getSize()},
+                    }
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .shaderStage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .info = visibleCommandsInfos
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .shaderStage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .info = lateCommandsInfos
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .shaderStage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
+                            VkDescriptorBufferInfo {_meshVisibility.getBuffer(), 0, _meshVisibility.getSize()},
+                            VkDescriptorBufferInfo {_meshVisibility.getBuffer(), 0, _meshVisibility.getSize()},
+                    }
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    .shaderStage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .info = std::vector<VkDescriptorImageInfo>{
+                            {
+                                .sampler = _depthPyramid.getSampler(),
+                                .imageView = _depthPyramid.getImageView(),
+                                .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+                            }
+                    }
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .shaderStage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
+                            VkDescriptorBufferInfo {_meshLods.getBuffer(), 0, _meshLods.getSize()},
+                            VkDescriptorBufferInfo {_meshLods.getBuffer(), 0, _meshLods.getSize()},
+                    }
+            },
+    };
+}
+
+void MultiMeshLayer::destroyCullingPipeline() {
+    if (_cullDescriptorSetLayout != nullptr)
+        vkDestroyDescriptorSetLayout(_vrd->device, _cullDescriptorSetLayout, nullptr);
+    if (_cullDescriptorPool != nullptr)
+        vkDestroyDescriptorPool(_vrd->device, _cullDescriptorPool, nullptr);
+    if (_cullPipelineLayout != nullptr)
+        vkDestroyPipelineLayout(_vrd->device, _cullPipelineLayout, nullptr);
+    if (_cullPipeline != nullptr)
+        vkDestroyPipeline(_vrd->device, _cullPipeline, nullptr);
+
+    _cullDescriptorSetLayout = nullptr;
+    _cullDescriptorPool = nullptr;
+    _cullDescriptorSets = {nullptr};
+    _cullPipelineLayout = nullptr;
+    _cullPipeline = nullptr;
+}
+
+void MultiMeshLayer::mergeLoadedModels() {
+    std::shared_ptr<Scene> scene = getCurrentScene();
+
+    // the appended meshes are drawn once their upload is done
+    if (_sceneUploadPending && _vrd->uploadService->isComplete(_sceneUploadValue))
+        finishSceneUpload();
+
+    // the meshes can also be removed from the scene by the editor, the mesh indices changed
+    if (scene->getMeshesVersion() != _meshesVersion)
+        updateSceneBuffers(true);
+
+    // the next models are merged once the previous ones are uploaded
+    if (_sceneUploadPending)
+        return;
+
+    bool sceneChanged = false;
+    for (auto it = _pendingImports.begin(); it != _pendingImports.end();){
+        // still loading, check again next frame
+        if (it->model.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+            ++it;
+            continue;
+        }
+
+        // merge the model in the scene on this thread, the future rethrows the loading errors
+        try {
+            int rootEntity = FactoryModel::addToScene(*it->model.get(), scene);
+            if (rootEntity != -1 && it->scale != 1.f){
+                auto& rootTransform = scene->getTransform(rootEntity);
+                rootTransform.scale *= it->scale;
+                rootTransform.needUpdateModelMatrix = true;
+                scene->setDirtyTransform(rootEntity);
+            }
+            sceneChanged = true;
+        }
+        catch (const std::exception& e) {
+            SPDLOG_ERROR("Failed to import model : {}", e.what());
+        }
+        it = _pendingImports.erase(it);
+    }
+
+    if (sceneChanged)
+        updateSceneBuffers(false);
+}
+
+void MultiMeshLayer::updateSceneBuffers(bool rebuild) {
+    // the buffers of the previous update must be in place before being appended to or replaced
+    if (_sceneUploadPending){
+        _vrd->uploadService->wait(_sceneUploadValue);
+        finishSceneUpload();
+    }
+
+    std::shared_ptr<Scene> scene = getCurrentScene();
+    _meshesVersion = scene->getMeshesVersion();
+    const auto& meshes = scene->getMeshes();
+    auto [vertices, vtxSize] = scene->getVerticesData();
+    auto [indices, idxSize] = scene->getIndicesData();
+    const auto& materials = scene->getMaterials();
+    uint32_t meshCount = meshes.size();
+    uint32_t vertexCount = vtxSize / sizeof(Vertex);
+    uint32_t indexCount = idxSize / sizeof(uint32_t);
+
+    // the relative indices of the meshes fit on 16 bits unless a mesh has more than 65536 vertices. The appended indices
+    // must have the type of the buffer
+    bool shortIndices = std::all_of(meshes.begin(), meshes.end(), [](const MeshComponent& mesh){
+        return mesh.vertexCount <= UINT16_MAX + 1;
+    });
+    VkIndexType indexType = shortIndices ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    if (_meshCount != 0 && indexType != _indexType)
+        rebuild = true;
+
+    // the frames in flight keep reading the previous buffers, the new ones are uploaded from the first mesh
+    if (rebuild)
+        retireSceneBuffers();
+    if (meshes.empty() || vertexCount == 0 || indexCount == 0)
+        return;
+    _indexType = indexType;
+    _commandSize = _indexedDraws ? sizeof(VkDrawIndexedIndirectCommand) : sizeof(VkDrawIndirectCommand);
+
+    // uploads the elements [first, count) of the buffer, given by getData(begin, end). The frames in flight only read
+    // the elements before first. A buffer too small is replaced by one twice as big, uploaded from the first element,
+    // that the frames read once the upload is done
+    uint64_t uploadValue = 0;
+    auto append = [&](DeviceSSBO& buffer, uint32_t first, uint32_t count, auto&& getData, VkBufferUsageFlags usage = 0){
+        if (first >= count)
+            return;
+        using T = typename std::invoke_result_t<decltype(getData), uint32_t, uint32_t>::value_type;
+        if (count * sizeof(T) <= buffer.getSize()){
+            auto data = getData(first, count);
+            uploadValue = std::max(uploadValue, _vrd->uploadService->uploadBuffer(buffer.getBuffer(), data.data(),
+                                                                                  utils::vectorSizeByte(data), first * sizeof(T)));
+            return;
+        }
+        DeviceSSBO grownBuffer;
+        grownBuffer.init(_vrd, std::max<uint32_t>(count * sizeof(T), 2 * buffer.getSize()), nullptr, usage);
+        auto data = getData(0, count);
+        uploadValue = std::max(uploadValue, _vrd->uploadService->uploadBuffer(grownBuffer.getBuffer(), data.data(),
+                                                                              utils::vectorSizeByte(data)));
+        _pendingBuffers.push_back({.target = &buffer, .buffer = grownBuffer});
+    };
+
+    if (_packedVertices){
+        // the vertices are quantized in the bounds of their mesh, the vertices shared by instances of a mesh are packed once
+        append(_vertices, _vertexCount, vertexCount, [&](uint32_t begin, uint32_t end){
+            std::vector<utils::PackedVertex> packedVertices(end - begin);
+            std::vector<bool> packed(end - begin, false);
+            for (const MeshComponent& mesh : meshes){
+                if (mesh.vertexOffset + mesh.vertexCount <= begin || mesh.vertexOffset >= end)
+                    continue;
+                for (uint32_t i = mesh.firstVertexIndex; i < mesh.firstVertexIndex + mesh.indexCount; ++i){
+                    uint32_t index = mesh.vertexOffset + indices[i];
+                    if (index < begin || index >= end || packed[index - begin])
+                        continue;
+                    const Vertex& vertex = vertices[index];
+                    packedVertices[index - begin] = utils::packVertex(vertex.position, vertex.normal, vertex.uv, mesh.boundingSphere);
+                    packed[index - begin] = true;
+                }
+            }
+            return packedVertices;
+        });
+    }
+    else
+        append(_vertices, _vertexCount, vertexCount, [&](uint32_t begin, uint32_t end){
+            return std::vector<Vertex>(vertices + begin, vertices + end);
+        });
+    if (shortIndices){
+        // padded to a multiple of 4 bytes, the vertex shader reads them by pairs for non indexed draws
+        append(_indices, _indexCount, indexCount + indexCount % 2, [&](uint32_t begin, uint32_t end){
+            std::vector<uint16_t> shortIndices(end - begin, 0);
+            for (uint32_t i = begin; i < end && i < indexCount; ++i)
+                shortIndices[i - begin] = indices[i];
+            return shortIndices;
+        }, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    }
+    else
+        append(_indices, _indexCount, indexCount, [&](uint32_t begin, uint32_t end){
+            return std::vector<uint32_t>(indices + begin, indices + end);
+        }, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+    // add the meshes as indirect commands. The indices are relative to the vertex offset of the mesh
+    if (_indexedDraws){
+        append(_indirectCommandBuffer, _meshCount, meshCount, [&](uint32_t begin, uint32_t end){
+            std::vector<VkDrawIndexedIndirectCommand> commands;
+            for (uint32_t i = begin; i < end; ++i){
+                commands.push_back({
+                        .indexCount = meshes[i].indexCount,
+                        .instanceCount = 1,
+                        .firstIndex = meshes[i].firstVertexIndex,
+                        .vertexOffset = (int32_t)meshes[i].vertexOffset,
+                        .firstInstance = i
+                });
+            }
+            return commands;
+        }, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    }
+    else {
+        append(_indirectCommandBuffer, _meshCount, meshCount, [&](uint32_t begin, uint32_t end){
+            std::vector<VkDrawIndirectCommand> commands;
+            for (uint32_t i = begin; i < end; ++i){
+                commands.push_back({
+                        .vertexCount = meshes[i].indexCount,
+                        .instanceCount = 1,
+                        .firstVertex = meshes[i].firstVertexIndex,
+                        .firstInstance = i
+                });
+            }
+            return commands;
+        }, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    }
+
+    append(_meshMetadata, _meshCount, meshCount, [&](uint32_t begin, uint32_t end){
+        std::vector<MeshMetadata> meshMetadata;
+        for (uint32_t i = begin; i < end; ++i)
+            meshMetadata.push_back({.materialIndex = meshes[i].materialIndex, .vertexOffset = meshes[i].vertexOffset});
+        return meshMetadata;
+    });
+
+    // the culling pass reads all the commands and writes the visible ones in the commands of the frame in flight
+    append(_meshBounds, _meshCount, meshCount, [&](uint32_t begin, uint32_t end){
+        std::vector<glm::vec4> boundingSpheres;
+        for (uint32_t i = begin; i < end; ++i)
+            boundingSpheres.push_back(meshes[i].boundingSphere);
+        return boundingSpheres;
+    });
+    append(_meshLods, _meshCount, meshCount, [&](uint32_t begin, uint32_t end){
+        std::vector<std::array<MeshLod, MAX_MESH_LODS>> meshLods;
+        for (uint32_t i = begin; i < end; ++i)
+            meshLods.push_back(meshes[i].lods);
+        return meshLods;
+    });
+
+    // no new mesh is visible at first, they are tested by the late phase of the first frame drawing them
+    append(_meshVisibility, _meshCount, meshCount, [](uint32_t begin, uint32_t end){
+        return std::vector<uint32_t>(end - begin, 0);
+    });
+
+    append(_materialsSSBO, _materialCount, materials.size(), [&](uint32_t begin, uint32_t end){
+        return std::vector<Material>(materials.begin() + begin, materials.begin() + end);
+    });
+
+    _meshCount = meshCount;
+    _vertexCount = vertexCount;
+    _indexCount = indexCount;
+    _materialCount = materials.size();
+    _sceneUploadValue = uploadValue;
+    _sceneUploadPending = true;
+
+    // the rebuilt buffers are drawn right away, the next frame waits on their upload
+    if (rebuild){
+        _vrd->uploadService->requireForFrame(uploadValue);
+        finishSceneUpload();
+    }
+}
+
+void MultiMeshLayer::finishSceneUpload() {
+    _sceneUploadPending = false;
+
+    // the frames in flight read the replaced buffers until they are done
+    for (auto& pendingBuffer : _pendingBuffers){
+        retireBuffer(*pendingBuffer.target);
+        *pendingBuffer.target = pendingBuffer.buffer;
+    }
+    _pendingBuffers.clear();
+
+    // the buffers of each frame in flight are grown for the new meshes
+    std::shared_ptr<Scene> scene = getCurrentScene();
+    const auto& transforms = scene->getWorldTransforms(RenderNode::MESH);
+    const auto& normalMatrices = scene->getMeshNormalMatrices();
+    uint32_t commandsSize = VISIBLE_COMMANDS_OFFSET + _commandSize * _meshCount;
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i){
+        if (commandsSize > _visibleCommands[i].getSize()){
+            uint32_t size = std::max(commandsSize, 2 * _visibleCommands[i].getSize());
+            retireBuffer(_visibleCommands[i]);
+            retireBuffer(_lateCommands[i]);
+            _visibleCommands[i].init(_vrd, size, nullptr, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+            _lateCommands[i].init(_vrd, size, nullptr, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+        }
+
+        // the new buffers get the current transforms, the frames then copy the ones changed since
+        if (_meshCount * sizeof(glm::mat4) > _meshTransformBuffers[i].getSize()){
+            uint32_t capacity = std::max<uint32_t>(_meshCount, 2 * _meshTransformBuffers[i].getSize() / sizeof(glm::mat4));
+            uint32_t count = std::min<uint32_t>(capacity, transforms.size());
+            retireBuffer(_meshTransformBuffers[i]);
+            retireBuffer(_normalMatrixBuffers[i]);
+            _meshTransformBuffers[i].init(_vrd, capacity * sizeof(glm::mat4));
+            _normalMatrixBuffers[i].init(_vrd, capacity * sizeof(glm::mat3x4));
+            VK_ASSERT(_meshTransformBuffers[i].setData(_vrd, transforms.data(), count * sizeof(glm::mat4), 0) &&
+                      _normalMatrixBuffers[i].setData(_vrd, normalMatrices.data(), count * sizeof(glm::mat3x4), 0),
+                      "Failed to copy the mesh transforms");
+        }
+    }
+    _drawCount = _meshCount;
+
+    // the pipeline layouts never change. Each descriptor set is updated once the GPU is done with its frame in flight
+    if (_pipelineLayout == nullptr){
+        createDescriptors();
+        createCullingPipeline();
+    }
+    else
+        _outdatedDescriptors.fill(true);
+
+    // the vertex shader reads the vertex index from the index buffer or from the indices ssbo (16 or 32 bits), and
+    // decodes the packed vertices if enabled. The pipeline is only recreated if one of them changed
+    std::array<VkBool32, 3> vertexSpecData = {_indexedDraws, _packedVertices, _indexType == VK_INDEX_TYPE_UINT16};
+    std::array<VkSpecializationMapEntry, 3> vertexSpecEntries{};
+    for (uint32_t i = 0; i < vertexSpecEntries.size(); ++i)
+        vertexSpecEntries[i] = {.constantID = i, .offset = i * (uint32_t)sizeof(VkBool32), .size = sizeof(VkBool32)};
+    VkSpecializationInfo vertexSpec = {
+            .mapEntryCount = vertexSpecEntries.size(),
+            .pMapEntries = vertexSpecEntries.data(),
+            .dataSize = sizeof(vertexSpecData),
+            .pData = vertexSpecData.data()
+    };
+    Factory::GraphicsPipelineProps props = {
+            .shaders =  {
+                    .vertex = "multiV.spv",
+                    .vertexSpec = &vertexSpec,
+                    .fragment = "multiF.spv"
+            },
+            .sampleCountMSAA = _vrd->sampleCount
+    };
+    VkPipeline pipeline = nullptr;
+    bool pipelineChanged = _graphicsPipeline == nullptr || vertexSpecData != _vertexSpecData;
+    if (pipelineChanged)
+        _vrd->pipelineBuilder->queueGraphicsPipeline(&pipeline, _renderPass, _pipelineLayout, props);
+
+    // share the buffers with the selected mesh layer. The pipelines of both layers are built concurrently
+    SelectedMeshLayer::Props selectedMeshProps = {
+        .vertices = _vertices,
+        .indices = _indices,
+        .meshBounds = _meshBounds,
+        .meshTransforms = _meshTransformBuffers,
+        .indexedDraws = _indexedDraws,
+        .packedVertices = _packedVertices,
+        .indexType = _indexType
+    };
+    _selectedMeshLayer->setSceneBuffers(selectedMeshProps);
+    _vrd->pipelineBuilder->wait();
+
+    if (pipelineChanged){
+        VkPipeline previousPipeline = _graphicsPipeline;
+        if (previousPipeline != nullptr)
+            retire([device = _vrd->device, previousPipeline](){ vkDestroyPipeline(device, previousPipeline, nullptr); });
+        _graphicsPipeline = pipeline;
+        _vertexSpecData = vertexSpecData;
+    }
+}
+
+void MultiMeshLayer::retireSceneBuffers() {
+    retireBuffer(_indirectCommandBuffer);
+    retireBuffer(_vertices);
+    retireBuffer(_indices);
+    retireBuffer(_meshMetadata);
+    retireBuffer(_materialsSSBO);
+    retireBuffer(_meshBounds);
+    retireBuffer(_meshLods);
+    retireBuffer(_meshVisibility);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i){
+        retireBuffer(_visibleCommands[i]);
+        retireBuffer(_lateCommands[i]);
+        retireBuffer(_meshTransformBuffers[i]);
+        retireBuffer(_normalMatrixBuffers[i]);
+    }
+    _meshCount = 0;
+    _vertexCount = 0;
+    _indexCount = 0;
+    _materialCount = 0;
+    _drawCount = 0;
+}
+
+void MultiMeshLayer::destroySceneBuffers() {
+    for (auto& pendingBuffer : _pendingBuffers)
+        pendingBuffer.buffer.destroy(_vrd);
+    _pendingBuffers.clear();
+
+    _indirectCommandBuffer.destroy(_vrd);
+    _vertices.destroy(_vrd);
+    _indices.destroy(_vrd);
+    _meshMetadata.destroy(_vrd);
+    _materialsSSBO.destroy(_vrd);
+    _meshBounds.destroy(_vrd);
+    _meshLods.destroy(_vrd);
+    _meshVisibility.destroy(_vrd);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i){
+        _visibleCommands[i].destroy(_vrd);
+        _lateCommands[i].destroy(_vrd);
+        _meshTransformBuffers[i].destroy(_vrd);
+        _normalMatrixBuffers[i].destroy(_vrd);
+    }
+    _drawCount = 0;
 }
\ No newline at end of file
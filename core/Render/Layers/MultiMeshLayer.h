@@ -6,12 +6,15 @@
 
 
 #include "RenderLayer.h"
-#include "../Objects/UniformBuffer.h"
 #include "../Objects/ShaderStorageBuffer.h"
 #include "../Objects/Texture.h"
+#include "../Objects/DepthPyramid.h"
 #include "../../Scene/Scene.h"
+#include "../Factory/FactoryModel.h"
 #include "SelectedMeshLayer.h"
 
+#include <future>
+
 
 class MultiMeshLayer : public RenderLayer {
 public:
@@ -20,27 +23,187 @@ public:
 
 
     virtual void fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) override;
+    virtual void fillComputeCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) override;
+    virtual bool usesEarlyPass() override;
+    virtual void fillEarlyCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) override;
+    virtual void fillLateComputeCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) override;
     virtual void update(float dt, uint32_t commandBufferIndex, const glm::mat4& pv) override;
     virtual void onEvent(Event& event) override;
     virtual void onImGuiRender() override;
+    virtual void onSwapchainRecreated() override;
 
     std::shared_ptr<SelectedMeshLayer> getSelectedMeshLayer();
 
 private:
+    /// creates the descriptors of the graphics pipeline, the layouts never change
     void createDescriptors();
+    std::vector<Factory::Descriptor> getDescriptors();
+
+    /// creates the culling compute pipeline and its descriptors. Must be called after the scene buffers are created
+    void createCullingPipeline();
+    void destroyCullingPipeline();
+    std::vector<Factory::Descriptor> getCullingDescriptors();
+
+    /// phase of the culling compute shader, must match cull.comp
+    enum CullingPhase : uint32_t {
+        FRUSTUM_PHASE = 0,  ///< appends the meshes in the frustum to the visible commands
+        EARLY_PHASE,        ///< appends the meshes in the frustum visible last frame to the visible commands
+        LATE_PHASE,         ///< tests the meshes against the depth pyramid, appends the newly visible ones to the late commands
+    };
+    void dispatchCulling(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex, CullingPhase phase);
+
+    /// binds the pipeline, the descriptors of the frame and the index buffer (indexed draws), pushes the camera position
+    void bindPipelineAndCamera(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex);
+
+    /// binds the pipeline and draws the commands of the buffer, preceded by their count
+    void drawVisibleCommands(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex, const DeviceSSBO& commands);
+
+    /// points the descriptor sets of the frame in flight to the current scene buffers, if they were replaced. The GPU
+    /// must be done with the frame
+    void refreshDescriptors(uint32_t commandBufferIndex);
+
+    /// adds the models done loading to the scene and appends them to the scene buffers. The scene buffers are rebuilt
+    /// if meshes were removed
+    void mergeLoadedModels();
+
+    /// copies the mesh transforms and normal matrices that are stale in the buffers of the frame in flight
+    void uploadMeshTransforms(uint32_t commandBufferIndex);
+
+    /// reads the pipeline statistics of the last completed frame, if available
+    void readPipelineStatistics(uint32_t commandBufferIndex);
+
+    /// uploads the meshes added to the scene since the last call after the ones in the buffers. They are drawn once the
+    /// upload is done (see finishSceneUpload), the frames don't wait on it. If rebuild is true, the buffers are replaced
+    /// and uploaded from the whole scene, the next frame waits on the upload (meshes removed, draw mode changed)
+    void updateSceneBuffers(bool rebuild);
+
+    /// swaps in the buffers replaced by the last update, grows the buffers of the frames in flight and draws the
+    /// uploaded meshes. The pipelines are only recreated if the way the vertices are read changed
+    void finishSceneUpload();
+
+    /// the buffers are destroyed once the frames in flight are done with them
+    void retireSceneBuffers();
+    void destroySceneBuffers();
 
 private:
+    /// model being loaded on a worker thread
+    struct PendingImport {
+        std::future<std::shared_ptr<ImportedModel>> model;
+        float scale = 1.f;  ///< scale applied to the root of the model once added to the scene
+    };
+    std::vector<PendingImport> _pendingImports;
+
+    VkRenderPass _renderPass = nullptr;
+    uint32_t _drawCount = 0;                ///< number of meshes drawn, 0 until the first model is uploaded
+    uint32_t _meshesVersion = 0;            ///< meshes version of the scene when the buffers were updated
+
+    // The scene buffers grow geometrically. Appended meshes are uploaded after the ones already drawn, a buffer too small
+    // is replaced by a bigger one once its upload is done. The frames in flight keep reading the previous buffers
+    uint32_t _meshCount = 0;                ///< meshes in the buffers, drawn once the upload is done
+    uint32_t _vertexCount = 0;              ///< scene vertices in the vertex buffer
+    uint32_t _indexCount = 0;               ///< scene indices in the index buffer
+    uint32_t _materialCount = 0;            ///< scene materials in the materials buffer
+    bool _sceneUploadPending = false;       ///< the last appended meshes are being uploaded
+    uint64_t _sceneUploadValue = 0;         ///< upload value of the last appended meshes
+    struct PendingBuffer {
+        DeviceSSBO* target;                 ///< scene buffer replaced once the upload is done
+        DeviceSSBO buffer;
+    };
+    std::vector<PendingBuffer> _pendingBuffers;
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> _outdatedDescriptors = {false}; ///< the sets still point to replaced buffers
+    std::array<VkBool32, 3> _vertexSpecData = {VK_FALSE};   ///< specialization of the vertex shader of the pipeline
+
     // Buffers
-    std::array<UniformBuffer, MAX_FRAMES_IN_FLIGHT> _vpUniformBuffers{};
-    std::array<HostSSBO, MAX_FRAMES_IN_FLIGHT> _meshTransformBuffers{};
+    uint32_t _vpOffset = 0;                 ///< dynamic offset of the projection view matrix in the upload arena
     DeviceSSBO _vertices{};
     DeviceSSBO _indices{};
     DeviceSSBO _indirectCommandBuffer{};
-    DeviceSSBO _meshMetadata{};
+    DeviceSSBO _meshMetadata{};             ///< MeshMetadata of each mesh
     DeviceSSBO _materialsSSBO{};
 
     VkPushConstantRange _cameraPosPC{};
 
+    // The mesh transforms and normal matrices persist in a host visible buffer per frame in flight. A frame only copies
+    // the ones changed since its buffers were last written, a static scene uploads nothing
+    std::array<HostSSBO, MAX_FRAMES_IN_FLIGHT> _meshTransformBuffers{};
+    std::array<HostSSBO, MAX_FRAMES_IN_FLIGHT> _normalMatrixBuffers{};
+    std::array<std::vector<uint64_t>, MAX_FRAMES_IN_FLIGHT> _staleTransforms{}; ///< stale bit of each mesh, per frame
+    uint32_t _uploadedTransformsSize = 0;   ///< bytes of transforms and normal matrices copied by the last frame
+
+    /// per mesh data read by the vertex shader, must match multi.vert
+    struct MeshMetadata {
+        uint32_t materialIndex;
+        uint32_t vertexOffset;  ///< added to the pulled indices of the non indexed draws
+    };
+
+    // Indexed draws use the indices as an index buffer, so the post transform vertex cache can reuse the transformed
+    // vertices shared by adjacent triangles. Non indexed draws pull the index in the vertex shader and transform every
+    // corner of every triangle. Changing the mode recreates the scene buffers (commands and pipelines depend on it)
+    bool _indexedDraws = true;
+    uint32_t _commandSize = sizeof(VkDrawIndexedIndirectCommand);  ///< stride of the indirect draw commands
+
+    // The indices are relative to the vertex offset of their mesh. They are stored on 16 bits if every mesh has at most
+    // 65536 vertices (the usual case), halving the index buffer
+    VkIndexType _indexType = VK_INDEX_TYPE_UINT32;
+
+    // Packed vertices are 16 bytes instead of 32 (see utils::PackedVertex), decoded by the vertex shader with the bounds
+    // of their mesh. The scene keeps the full precision vertices
+    bool _packedVertices = true;
+
+    // vertex shader invocations and assembled primitives of the draws, per frame in flight. Query 0 is the early pass,
+    // query 1 the main pass
+    VkQueryPool _statisticsQueryPool = nullptr;
+    struct PipelineStatistics {
+        uint64_t primitives = 0;
+        uint64_t vertexInvocations = 0;
+    };
+    PipelineStatistics _statistics{};               ///< statistics of the last completed frame
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> _statisticsQueryCount = {0}; ///< number of queries written by the frame
+    static constexpr uint32_t STATISTICS_QUERY_COUNT = 2;  ///< queries per frame in flight
+
+    // GPU culling. Every frame, a compute pass tests the meshes against the frustum and writes the commands of the
+    // visible meshes in the indirect buffer of the frame in flight, drawn with vkCmdDrawIndirectCount.
+    // Occlusion culling is done in two phases. The meshes visible last frame are drawn in the early pass, a depth pyramid
+    // is built from its depth and all meshes are tested against it. The newly visible ones are drawn in the main pass
+    enum class CullingMode : int {
+        NONE = 0,
+        FRUSTUM,
+        OCCLUSION
+    };
+    CullingMode _cullingMode = CullingMode::OCCLUSION;
+
+    /// culling inputs uploaded every frame
+    struct CullingData {
+        glm::mat4 pv;
+        std::array<glm::vec4, 6> frustumPlanes;
+        glm::vec4 cameraPosition;
+        float lodScale;                     ///< pixels covered by one world unit at a distance of 1
+        float lodThreshold;                 ///< max error of the selected lod, in pixels
+    };
+    uint32_t _cullingDataOffset = 0;        ///< dynamic offset of the culling data in the upload arena
+    DeviceSSBO _meshBounds{};               ///< bounding sphere of each mesh, in the mesh space
+    DeviceSSBO _meshLods{};                 ///< MAX_MESH_LODS lods per mesh, selected by the culling pass (not without culling)
+    float _lodThreshold = 1.f;              ///< the culling pass selects the coarsest lod with a smaller error, in pixels
+    DeviceSSBO _meshVisibility{};           ///< 1 if the mesh was visible last frame (occlusion culling)
+    std::array<DeviceSSBO, MAX_FRAMES_IN_FLIGHT> _visibleCommands{}; ///< draw count, followed by the visible draw commands
+    std::array<DeviceSSBO, MAX_FRAMES_IN_FLIGHT> _lateCommands{};    ///< draw count, followed by the newly visible draw commands
+    DepthPyramid _depthPyramid{};
+
+    struct CullingPush {
+        uint32_t meshCount;
+        CullingPhase phase;
+        uint32_t commandSize;   ///< number of uints of a draw command
+    };
+    VkPushConstantRange _cullingPC{};
+    VkDescriptorSetLayout _cullDescriptorSetLayout = nullptr;
+    VkDescriptorPool _cullDescriptorPool = nullptr;
+    std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> _cullDescriptorSets = {nullptr};
+    VkPipelineLayout _cullPipelineLayout = nullptr;
+    VkPipeline _cullPipeline = nullptr;
+
+    static constexpr uint32_t CULL_WORKGROUP_SIZE = 64;            ///< must match the local size of cull.comp
+    static constexpr VkDeviceSize VISIBLE_COMMANDS_OFFSET = 16;    ///< offset of the visible commands, after the draw count
+
     ///< Selected mesh layer
     std::shared_ptr<SelectedMeshLayer> _selectedMeshLayer = nullptr;
 
@@ -12,11 +12,20 @@ RenderLayer::RenderLayer() {
         Renderer* renderer = Application::getApp()->getRenderer();
         _vrd = renderer->getRenderDevice();
         _swapchainExtent = renderer->getSwapchainExtent();
+        _uploadArena = renderer->getUploadArena();
+        _depthImageView = renderer->getDepthImageView();
         _currentScene = std::make_shared<Scene>("NanoWorld");
     }
 }
 
 RenderLayer::~RenderLayer() {
+    // the renderer idles the GPU before destroying the layers
+    for (auto& retired : _retired)
+        retired.destroy();
+    destroyPipelineAndDescriptors();
+}
+
+void RenderLayer::destroyPipelineAndDescriptors() {
     // destroy descriptors
     if (_descriptorSetLayout != nullptr)
         vkDestroyDescriptorSetLayout(_vrd->device, _descriptorSetLayout, nullptr);
@@ -28,15 +37,40 @@ RenderLayer::~RenderLayer() {
         vkDestroyPipelineLayout(_vrd->device, _pipelineLayout, nullptr);
     if (_graphicsPipeline != nullptr)
         vkDestroyPipeline(_vrd->device, _graphicsPipeline, nullptr);
+
+    _descriptorSetLayout = nullptr;
+    _descriptorPool = nullptr;
+    _descriptorSets = {nullptr};
+    _pipelineLayout = nullptr;
+    _graphicsPipeline = nullptr;
+}
+
+void RenderLayer::retire(std::function<void()> destroy) {
+    _retired.push_back({.frame = _frameCount, .destroy = std::move(destroy)});
+}
+
+void RenderLayer::releaseRetired() {
+    // each frame waits on the fence of its frame in flight, after MAX_FRAMES_IN_FLIGHT frames all of them did
+    ++_frameCount;
+    while (!_retired.empty() && _retired.front().frame + MAX_FRAMES_IN_FLIGHT <= _frameCount){
+        _retired.front().destroy();
+        _retired.pop_front();
+    }
 }
 
 /// Binds the graphics pipeline and the descriptor set at the given command buffer index
-void RenderLayer::bindPipelineAndDS(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {
+void RenderLayer::bindPipelineAndDS(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex,
+                                    std::initializer_list<uint32_t> dynamicOffsets) {
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout,
-                            0, 1, &_descriptorSets[commandBufferIndex], 0, nullptr);
+                            0, 1, &_descriptorSets[commandBufferIndex], dynamicOffsets.size(), dynamicOffsets.begin());
 }
 
 std::shared_ptr<Scene> RenderLayer::getCurrentScene() {
     return _currentScene;
+}
+
+void RenderLayer::setSwapchainResources(VkExtent2D swapchainExtent, VkImageView depthImageView) {
+    _swapchainExtent = swapchainExtent;
+    _depthImageView = depthImageView;
 }
\ No newline at end of file
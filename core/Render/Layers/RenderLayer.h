@@ -7,10 +7,13 @@
 #include "../VulkanRenderDevice.hpp"
 #include "../../events/Event.h"
 #include "../Factory/FactoryVulkan.h"
+#include "../Objects/UploadArena.h"
 #include "../../Scene/Scene.h"
 
 #include <vulkan/vulkan_core.h>
 #include <glm/glm.hpp>
+#include <deque>
+#include <functional>
 
 
 class RenderLayer {
@@ -23,22 +26,66 @@ public:
 
     // TODO : it is a bit redundant to pass both the command buffer and the index or we don't care?
     virtual void fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) = 0;
+
+    /// Records work that must happen outside of the render pass (compute dispatches, transfers). Called for all layers
+    /// before the render pass begins
+    virtual void fillComputeCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {}
+
+    /// Returns true if the layer draws in the early pass. The early pass is only recorded if a layer uses it
+    virtual bool usesEarlyPass() { return false; }
+
+    /// Records the draws of the early pass, a render pass ending before the main one and sharing its attachments
+    virtual void fillEarlyCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {}
+
+    /// Records work between the early and the main pass. The depth of the early pass can be sampled by compute shaders
+    /// (DEPTH_STENCIL_READ_ONLY_OPTIMAL layout)
+    virtual void fillLateComputeCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {}
     virtual void onImGuiRender() = 0;
 
+    /// Called once the swapchain and the attachments are recreated (window resize), with the GPU idle. The viewport and
+    /// scissor are dynamic, only the resources sized from or bound to the attachments must be recreated
+    virtual void onSwapchainRecreated() {}
+
     static std::shared_ptr<Scene> getCurrentScene();
 
+    /// updates the swapchain extent and depth view shared by the layers, before onSwapchainRecreated is called
+    static void setSwapchainResources(VkExtent2D swapchainExtent, VkImageView depthImageView);
+
 protected:
     explicit RenderLayer();
 
     // Reusable helper methods for render layers
 
-    /// Binds the graphics pipeline and the descriptor set at the given command buffer index
-    void bindPipelineAndDS(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex);
+    /// Binds the graphics pipeline and the descriptor set at the given command buffer index. The dynamic offsets
+    /// must be given in binding order for all the dynamic descriptors of the set
+    void bindPipelineAndDS(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex,
+                           std::initializer_list<uint32_t> dynamicOffsets = {});
+
+    /// Destroys the descriptors and the graphics pipeline (if created). The GPU must not be using them anymore
+    void destroyPipelineAndDescriptors();
+
+    /// Defers the destruction of resources that the frames in flight can still be using, instead of idling the GPU
+    void retire(std::function<void()> destroy);
+
+    /// Destroys the retired resources once every frame in flight waited on its fence since. Must be called once per
+    /// frame, from update
+    void releaseRetired();
+
+    /// Retires the buffer (ex: a DeviceSSBO) and resets it
+    template<typename Buffer>
+    void retireBuffer(Buffer& buffer) {
+        if (buffer.getBuffer() == nullptr)
+            return;
+        retire([vrd = _vrd, buffer]() mutable { buffer.destroy(vrd); });
+        buffer = Buffer{};
+    }
 
 
 protected:
     static inline VulkanRenderDevice* _vrd = nullptr;
     static inline VkExtent2D _swapchainExtent{};
+    static inline UploadArena* _uploadArena = nullptr; ///< per frame upload memory, owned by the renderer
+    static inline VkImageView _depthImageView = nullptr; ///< depth aspect of the multisampled depth attachment
 
     // descriptors
     VkDescriptorSetLayout _descriptorSetLayout = nullptr;
@@ -51,6 +98,13 @@ protected:
 
 private:
     static inline std::shared_ptr<Scene> _currentScene = nullptr;
+
+    struct RetiredResource {
+        uint64_t frame;                 ///< frame count when retired
+        std::function<void()> destroy;
+    };
+    std::deque<RetiredResource> _retired;
+    uint64_t _frameCount = 0;           ///< number of releaseRetired calls
 };
 
 
@@ -5,6 +5,7 @@
 #include "SelectedMeshLayer.h"
 
 #include "../Factory/FactoryVulkan.h"
+#include "../PipelineBuilder.h"
 #include "../Factory/FactoryModel.h"
 #include "../../Utils/UtilsVulkan.h"
 #include "../../Utils/UtilsTemplate.h"
@@ -16,58 +17,95 @@
 // The currently used produces bad results for meshes with transforms not centered at the mesh center. The transform of the mesh
 // could corrected to be at its center : https://github.com/alexandrelipp/Velcro/issues/22
 
-SelectedMeshLayer::SelectedMeshLayer(VkRenderPass renderPass, const Props& props) {
-    // init the uniform buffers
-    for (auto& buffer : _vpUniformBuffers)
-        buffer.init(_vrd->device, _vrd->physicalDevice, sizeof(glm::mat4));
+SelectedMeshLayer::SelectedMeshLayer(VkRenderPass renderPass) : _renderPass(renderPass) {}
+
+SelectedMeshLayer::~SelectedMeshLayer() {}
+
+void SelectedMeshLayer::setSceneBuffers(const Props& props) {
+    // the pipeline only depends on how the vertices and indices are read
+    bool pipelineChanged = _graphicsPipeline == nullptr || props.indexedDraws != _props.indexedDraws ||
+                           props.packedVertices != _props.packedVertices || props.indexType != _props.indexType;
+    _props = props;
+    _indexedDraws = props.indexedDraws;
+    _indexBuffer = props.indices.getBuffer();
+    _indexType = props.indexType;
+
+    if (_pipelineLayout == nullptr){
+        // push constant for factor of outline thickness and vertex offset of the mesh
+        _meshPC = {
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                .offset = 0,
+                .size = sizeof(MeshPush),
+        };
+
+        // create descriptors, the layouts never change
+        std::tie(_descriptorSetLayout, _pipelineLayout, _descriptorPool, _descriptorSets) =
+                Factory::createDescriptorSets(_vrd, getDescriptors(), {_meshPC});
+    }
+    else {
+        // the frames in flight still read the previous buffers, each set is updated before its frame is recorded
+        _outdatedDescriptors.fill(true);
+    }
+
+    if (pipelineChanged){
+        // the previous pipeline is destroyed once the frames in flight are done with it
+        VkPipeline previousPipeline = _graphicsPipeline;
+        _graphicsPipeline = createPipeline();
+        if (previousPipeline != nullptr)
+            retire([device = _vrd->device, previousPipeline](){ vkDestroyPipeline(device, previousPipeline, nullptr); });
+    }
+
+    // the selected subtree might contain meshes of the new buffers
+    setSelectedEntity(_selectedEntity);
+}
 
+std::vector<Factory::Descriptor> SelectedMeshLayer::getDescriptors() const {
     // describe descriptors
-    std::vector<Factory::Descriptor> descriptors = {
+    return {
             {
-                    .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                    .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
                     .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
                     .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
-                            VkDescriptorBufferInfo {_vpUniformBuffers[0].getBuffer(), 0, _vpUniformBuffers[0].getSize()},
-                            VkDescriptorBufferInfo {_vpUniformBuffers[1].getBuffer(), 0, _vpUniformBuffers[1].getSize()},
+                            VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, sizeof(glm::mat4)},
+                            VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, sizeof(glm::mat4)},
                     }
             },
             {
                     .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                     .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
                     .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
-                            VkDescriptorBufferInfo {props.vertices.getBuffer(), 0, props.vertices.getSize()},
-                            VkDescriptorBufferInfo {props.vertices.getBuffer(), 0, props.vertices.getSize()},
+                            VkDescriptorBufferInfo {_props.vertices.getBuffer(), 0, _props.vertices.getSize()},
+                            VkDescriptorBufferInfo {_props.vertices.getBuffer(), 0, _props.vertices.getSize()},
                     }
             },
             {
                     .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                     .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
                     .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
-                            VkDescriptorBufferInfo {props.indices.getBuffer(), 0, props.indices.getSize()},
-                            VkDescriptorBufferInfo {props.indices.getBuffer(), 0, props.indices.getSize()},
+                            VkDescriptorBufferInfo {_props.indices.getBuffer(), 0, _props.indices.getSize()},
+                            VkDescriptorBufferInfo {_props.indices.getBuffer(), 0, _props.indices.getSize()},
                     }
             },
             {
                     .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                     .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
                     .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
-                            VkDescriptorBufferInfo {props.meshTransformBuffers[0].getBuffer(), 0, props.meshTransformBuffers[0].getSize()},
-                            VkDescriptorBufferInfo {props.meshTransformBuffers[1].getBuffer(), 0, props.meshTransformBuffers[1].getSize()},
+                            VkDescriptorBufferInfo {_props.meshTransforms[0].getBuffer(), 0, _props.meshTransforms[0].getSize()},
+                            VkDescriptorBufferInfo {_props.meshTransforms[1].getBuffer(), 0, _props.meshTransforms[1].getSize()},
+                    }
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
+                    .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
+                            VkDescriptorBufferInfo {_props.meshBounds.getBuffer(), 0, _props.meshBounds.getSize()},
+                            VkDescriptorBufferInfo {_props.meshBounds.getBuffer(), 0, _props.meshBounds.getSize()},
                     }
             },
     };
+}
 
-    // push constant for factor of outline thickness
-    _scaleFactor = {
-            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-            .offset = 0,
-            .size = sizeof(float),
-    };
-
-    // create descriptors
-    std::tie(_descriptorSetLayout, _pipelineLayout, _descriptorPool, _descriptorSets) =
-            Factory::createDescriptorSets(_vrd, descriptors, {_scaleFactor});
-
+VkPipeline SelectedMeshLayer::createPipeline() {
     // Fill up front stencil state as described by the spec :
     // https://www.khronos.org/registry/vulkan/specs/1.3/html/chap26.html#fragops-stencil
     VkStencilOpState frontStencilState = {
@@ -88,6 +126,20 @@ SelectedMeshLayer::SelectedMeshLayer(VkRenderPass renderPass, const Props& props
         mapEntries[i].size = sizeof(float);
     }
 
+    // the vertex shader reads the vertex index from the index buffer or from the indices ssbo (16 or 32 bits), and
+    // decodes the packed vertices if enabled
+    std::array<VkBool32, 3> vertexSpecData = {_props.indexedDraws, _props.packedVertices,
+                                              _props.indexType == VK_INDEX_TYPE_UINT16};
+    std::array<VkSpecializationMapEntry, 3> vertexSpecEntries{};
+    for (uint32_t i = 0; i < vertexSpecEntries.size(); ++i)
+        vertexSpecEntries[i] = {.constantID = i, .offset = i * (uint32_t)sizeof(VkBool32), .size = sizeof(VkBool32)};
+    VkSpecializationInfo vertexSpecializationInfo = {
+            .mapEntryCount = vertexSpecEntries.size(),
+            .pMapEntries = vertexSpecEntries.data(),
+            .dataSize = sizeof(vertexSpecData),
+            .pData = vertexSpecData.data()
+    };
+
     // add data
     VkSpecializationInfo specializationInfo = {
             .mapEntryCount = mapEntries.size(),
@@ -101,6 +153,7 @@ SelectedMeshLayer::SelectedMeshLayer(VkRenderPass renderPass, const Props& props
     Factory::GraphicsPipelineProps factoryProps = {
             .shaders =  {
                     .vertex = "SelectedMeshV.spv",
+                    .vertexSpec = &vertexSpecializationInfo,
                     .fragment = "SelectedMeshF.spv",
                     .fragmentSpec = &specializationInfo
             },
@@ -112,21 +165,17 @@ SelectedMeshLayer::SelectedMeshLayer(VkRenderPass renderPass, const Props& props
                     VK_DYNAMIC_STATE_STENCIL_OP, // we dynamically change the stencil operation
                     }
     };
-    _graphicsPipeline = Factory::createGraphicsPipeline(_vrd->device, _swapchainExtent, renderPass, _pipelineLayout, factoryProps);
-
-}
-
-SelectedMeshLayer::~SelectedMeshLayer() {
-    // destroy the buffers
-    for (auto& buffer : _vpUniformBuffers)
-        buffer.destroy(_vrd->device);
+    VkPipeline pipeline = nullptr;
+    _vrd->pipelineBuilder->queueGraphicsPipeline(&pipeline, _renderPass, _pipelineLayout, factoryProps);
+    _vrd->pipelineBuilder->wait();
+    return pipeline;
 }
 
 void SelectedMeshLayer::update(float dt, uint32_t commandBufferIndex, const glm::mat4& pv) {
-    if (_selectedEntity == -1 || _selectedMeshes.empty() )
-        return;
-    // upload projection view matrix
-    _vpUniformBuffers[commandBufferIndex].setData(_vrd->device, (void*)&pv, sizeof(pv));
+    releaseRetired();
+
+    // upload projection view matrix. Always uploaded (cheap), the selection can change before the command buffer is filled
+    _vpOffset = _uploadArena->push(&pv, sizeof(pv));
 }
 
 void SelectedMeshLayer::onEvent(Event& event) {
@@ -155,6 +204,13 @@ void SelectedMeshLayer::onEvent(Event& event) {
                 case KeyCode::R:
                     _operation = ImGuizmo::OPERATION::ROTATE;
                     break;
+                case KeyCode::Delete:
+                    // the multi mesh layer recreates the scene buffers if meshes were removed
+                    if (_selectedEntity > 0){
+                        getCurrentScene()->removeSceneNode(_selectedEntity);
+                        setSelectedEntity(-1);
+                    }
+                    break;
                 default:
                     break;
             }
@@ -172,12 +228,20 @@ void SelectedMeshLayer::onEvent(Event& event) {
 }
 
 void SelectedMeshLayer::fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex) {
-    // nothing to do if no selected entity
-    if (_selectedEntity == -1 || _selectedMeshes.empty() )
+    // nothing to do if no selected entity or if the scene buffers are not set
+    if (_selectedEntity == -1 || _selectedMeshes.empty() || _graphicsPipeline == nullptr)
         return;
 
+    // the GPU is done with this frame in flight, its descriptor set can point to the current scene buffers
+    if (_outdatedDescriptors[commandBufferIndex]){
+        Factory::updateDescriptorSet(_vrd, _descriptorSets[commandBufferIndex], getDescriptors(), commandBufferIndex);
+        _outdatedDescriptors[commandBufferIndex] = false;
+    }
+
     // bind the layer
-    bindPipelineAndDS(commandBuffer, commandBufferIndex);
+    bindPipelineAndDS(commandBuffer, commandBufferIndex, {_vpOffset});
+    if (_indexedDraws)
+        vkCmdBindIndexBuffer(commandBuffer, _indexBuffer, 0, _indexType);
 
     // at the beginning of the render pass, the stencil buffer is cleared with 0's
 
@@ -188,59 +252,41 @@ void SelectedMeshLayer::fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_
     // 1. Render Mesh with stencil test that always fail but write to stencil
     // 2. Render scaled up mesh. Only outlined pixels will pass the stencil test
     // 3. Decrement (effectively clearing) stencil for next mesh
-    for (auto mesh : _selectedMeshes) {
-        // render mesh at its scale
-        float value = 1.f;
-        vkCmdPushConstants(commandBuffer, _pipelineLayout, _scaleFactor.stageFlags, _scaleFactor.offset, _scaleFactor.size,
-                           &value);
-        // will always fail, but will write to stencil buffer
+    for (int entity : _selectedMeshes) {
+        // render mesh at its scale. Will always fail, but will write to stencil buffer
         vkCmdSetStencilOp(commandBuffer, VK_STENCIL_FACE_FRONT_BIT,
                           VK_STENCIL_OP_INCREMENT_AND_CLAMP, // Fail OP -> increment stencil value
                           VK_STENCIL_OP_INCREMENT_AND_CLAMP, // Pass OP (never happens)
                           VK_STENCIL_OP_KEEP,                // Depth fail OP (never happens, no depth test)
                           VK_COMPARE_OP_GREATER);            // Always fail : Reference is 0 (nothing greater then 0)
 
-        vkCmdDraw(commandBuffer, mesh->indexCount, 1, mesh->firstVertexIndex, mesh->meshIndex);
-
-        // scale up mesh by the factor
-        value = MAG_OUTLINE_FACTOR;
-        vkCmdPushConstants(commandBuffer, _pipelineLayout, _scaleFactor.stageFlags, _scaleFactor.offset, _scaleFactor.size,
-                           &value);
+        drawMesh(commandBuffer, entity, 1.f);
 
-        // will only pass for pixels in outline
+        // scale up mesh by the factor, will only pass for pixels in outline
         vkCmdSetStencilOp(commandBuffer, VK_STENCIL_FACE_FRONT_BIT,
                           VK_STENCIL_OP_DECREMENT_AND_CLAMP,    // Pass OP -> decrement stencil value for next mesh
                           VK_STENCIL_OP_DECREMENT_AND_CLAMP,    // Fail OP -> decrement stencil value for next mesh
                           VK_STENCIL_OP_KEEP,                   // Depth fail OP (never happens, no depth test)
                           VK_COMPARE_OP_EQUAL);                 // Reference is 0. Only the pixels with a stencil value of 0
                                                                 // (outline pixels) will pass
-        vkCmdDraw(commandBuffer, mesh->indexCount, 1, mesh->firstVertexIndex, mesh->meshIndex);
+        drawMesh(commandBuffer, entity, MAG_OUTLINE_FACTOR);
     }
 
 #else
 
-    // render mesh at its scale
-    float value = 1.f;
-    vkCmdPushConstants(commandBuffer, _pipelineLayout, _scaleFactor.stageFlags, _scaleFactor.offset, _scaleFactor.size,
-                       &value);
-    // will always fail, but will write to stencil buffer
+    // render mesh at its scale. Will always fail, but will write to stencil buffer
     vkCmdSetStencilOp(commandBuffer, VK_STENCIL_FACE_FRONT_BIT, VK_STENCIL_OP_INCREMENT_AND_CLAMP,
                       VK_STENCIL_OP_INCREMENT_AND_CLAMP,
                       VK_STENCIL_OP_KEEP, VK_COMPARE_OP_GREATER);
-    for (auto mesh : _selectedMeshes) {
-        vkCmdDraw(commandBuffer, mesh->indexCount, 1, mesh->firstVertexIndex, mesh->meshIndex);
+    for (int entity : _selectedMeshes) {
+        drawMesh(commandBuffer, entity, 1.f);
     }
 
-    // scale up mesh by the factor
-    value = MAG_OUTLINE_FACTOR;
-    vkCmdPushConstants(commandBuffer, _pipelineLayout, _scaleFactor.stageFlags, _scaleFactor.offset, _scaleFactor.size,
-                       &value);
-
-    // will only pass for pixels in outline
+    // scale up mesh by the factor, will only pass for pixels in outline
     vkCmdSetStencilOp(commandBuffer, VK_STENCIL_FACE_FRONT_BIT, VK_STENCIL_OP_KEEP, VK_STENCIL_OP_REPLACE,
                       VK_STENCIL_OP_KEEP, VK_COMPARE_OP_EQUAL);
-    for (auto mesh : _selectedMeshes) {
-        vkCmdDraw(commandBuffer, mesh->indexCount, 1, mesh->firstVertexIndex, mesh->meshIndex);
+    for (int entity : _selectedMeshes) {
+        drawMesh(commandBuffer, entity, MAG_OUTLINE_FACTOR);
     }
 #endif
 }
@@ -296,15 +342,30 @@ void SelectedMeshLayer::setSelectedEntity(int selectedEntity) {
     if (selectedEntity == -1)
         return;
 
-    // append all mesh components that are child of the selected entity
-    getCurrentScene()->traverseRecursive(_selectedEntity, [this](int entity){
-        MeshComponent* mesh = getCurrentScene()->getMesh(entity);
-        if (mesh != nullptr)
-            _selectedMeshes.push_back(mesh);
+    // append all the entities with a mesh in the subtree of the selected entity
+    getCurrentScene()->traverse(_selectedEntity, [this](int entity){
+        if (getCurrentScene()->getMesh(entity) != nullptr)
+            _selectedMeshes.push_back(entity);
     });
     SPDLOG_INFO("Selected mesh name {}", getCurrentScene()->getName(selectedEntity));
 }
 
+void SelectedMeshLayer::drawMesh(VkCommandBuffer commandBuffer, int entity, float factor) {
+    const MeshComponent* mesh = getCurrentScene()->getMesh(entity);
+    if (mesh == nullptr)
+        return;
+
+    MeshPush push = {.factor = factor, .vertexOffset = mesh->vertexOffset};
+    vkCmdPushConstants(commandBuffer, _pipelineLayout, _meshPC.stageFlags, _meshPC.offset, _meshPC.size, &push);
+
+    // the first instance selects the mesh transform
+    if (_indexedDraws)
+        vkCmdDrawIndexed(commandBuffer, mesh->indexCount, 1, mesh->firstVertexIndex, (int32_t)mesh->vertexOffset,
+                         mesh->meshIndex);
+    else
+        vkCmdDraw(commandBuffer, mesh->indexCount, 1, mesh->firstVertexIndex, mesh->meshIndex);
+}
+
 void SelectedMeshLayer::displayHierarchy(int entity) {
     if (entity == -1)
         return;
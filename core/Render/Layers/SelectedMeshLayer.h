@@ -5,7 +5,6 @@
 #pragma once
 
 #include "RenderLayer.h"
-#include "../Objects/UniformBuffer.h"
 #include "../Objects/ShaderStorageBuffer.h"
 #include "../Objects/Texture.h"
 #include "../../Scene/Scene.h"
@@ -19,11 +18,15 @@ public:
     struct Props{
         DeviceSSBO vertices;
         DeviceSSBO indices;
-        std::array<HostSSBO, MAX_FRAMES_IN_FLIGHT> meshTransformBuffers{};
+        DeviceSSBO meshBounds;           ///< bounding sphere of each mesh, decodes the packed vertices
+        std::array<HostSSBO, MAX_FRAMES_IN_FLIGHT> meshTransforms; ///< mesh transforms of each frame in flight
+        bool indexedDraws = false;       ///< the indices are bound as an index buffer instead of being pulled
+        bool packedVertices = false;     ///< the vertices are utils::PackedVertex
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32; ///< the indices are relative to the vertex offset of their mesh
     };
 
 public:
-    SelectedMeshLayer(VkRenderPass renderPass, const Props& props);
+    explicit SelectedMeshLayer(VkRenderPass renderPass);
 
     virtual ~SelectedMeshLayer();
 
@@ -35,17 +38,47 @@ public:
 
     void setSelectedEntity(int selectedEntity);
 
+    /// Sets the scene buffers of the multi mesh layer, nothing is rendered until called. The descriptors point to the
+    /// new buffers from the next recorded frames, the pipeline is only recreated if the way the buffers are read changed
+    void setSceneBuffers(const Props& props);
+
 private:
     // Methods to display selected entity
     void displayHierarchy(int entity);
     void displayGuizmo(int selectedEntity);
 
+    /// draws the mesh of the entity with the mesh transform scaled by the factor, indexed or not. Nothing is drawn if
+    /// the entity has no mesh anymore
+    void drawMesh(VkCommandBuffer commandBuffer, int entity, float factor);
+
+    /// descriptors of the scene buffers
+    std::vector<Factory::Descriptor> getDescriptors() const;
+
+    /// builds the graphics pipeline reading the scene buffers as described by the props
+    VkPipeline createPipeline();
+
 private:
-    // Buffers
-    std::array<UniformBuffer, MAX_FRAMES_IN_FLIGHT> _vpUniformBuffers{};
-    VkPushConstantRange _scaleFactor{};
+    VkRenderPass _renderPass = nullptr;
+
+    uint32_t _vpOffset = 0;                 ///< dynamic offset of the projection view matrix in the upload arena
+    VkPushConstantRange _meshPC{};
+
+    Props _props{};                         ///< scene buffers of the multi mesh layer
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> _outdatedDescriptors = {false}; ///< the set still points to replaced buffers
+
+    /// must match SelectedMesh.vert
+    struct MeshPush {
+        float factor;           ///< scale factor of the mesh, > 1 for the outline
+        uint32_t vertexOffset;  ///< added to the pulled indices of the non indexed draws
+    };
+
+    // index buffer of the scene, only bound for indexed draws
+    bool _indexedDraws = false;
+    VkBuffer _indexBuffer = nullptr;
+    VkIndexType _indexType = VK_INDEX_TYPE_UINT32;
 
-    std::vector<MeshComponent*> _selectedMeshes;
+    /// entities with a mesh in the selected subtree. Their meshes are looked up when recording, the scene can move them
+    std::vector<int> _selectedMeshes;
     int _selectedEntity = -1;
 
     // current operation done with the guizmo (translate, rotate or scale)
@@ -4,6 +4,7 @@
 
 #include "TextLayer.h"
 #include "../../Utils/UtilsFile.h"
+#include "../PipelineBuilder.h"
 #include "backends/imgui_impl_vulkan.h"
 #include "../../Utils/UtilsTemplate.h"
 
@@ -30,28 +31,23 @@ TextLayer::TextLayer(VkRenderPass renderPass) : _renderPass(renderPass) {
     // create buffers
     _vertexBuffer.init(_vrd, vertices.data(), utils::vectorSizeByte(vertices));
     _indexBuffer.init(_vrd, VK_INDEX_TYPE_UINT16, indices.data(), indices.size());
-    for (auto& buffer : _charMVPs){
-        buffer.init(_vrd, sizeof(glm::mat4) * MAX_CHAR, nullptr);
-    }
-    for (auto& buffer : _texCoords)
-        buffer.init(_vrd, MAX_CHAR * sizeof(glm::vec2) * 4, nullptr);
 
     // describe descriptors
     std::vector<Factory::Descriptor> descriptors = {
             {
-                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
                     .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
                     .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
-                            VkDescriptorBufferInfo {_charMVPs[0].getBuffer(), 0, _charMVPs[0].getSize()},
-                            VkDescriptorBufferInfo {_charMVPs[1].getBuffer(), 0, _charMVPs[1].getSize()},
+                            VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, MVPS_SIZE},
+                            VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, MVPS_SIZE},
                     }
             },
             {
-                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
                 .shaderStage = VK_SHADER_STAGE_VERTEX_BIT,
                 .info = std::array<VkDescriptorBufferInfo, MAX_FRAMES_IN_FLIGHT>{
-                        VkDescriptorBufferInfo {_texCoords[0].getBuffer(), 0, _texCoords[0].getSize()},
-                        VkDescriptorBufferInfo {_texCoords[1].getBuffer(), 0, _texCoords[1].getSize()},
+                        VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, TEX_COORDS_SIZE},
+                        VkDescriptorBufferInfo {_uploadArena->getBuffer(), 0, TEX_COORDS_SIZE},
                 }
             },
             {
@@ -75,12 +71,7 @@ TextLayer::TextLayer(VkRenderPass renderPass) : _renderPass(renderPass) {
 }
 
 TextLayer::~TextLayer() {
-    VkDevice device = _vrd->device;
-    _texture.destroy(device);
-    for (auto& buffer : _texCoords)
-        buffer.destroy(device);
-    for (auto& buffer : _charMVPs)
-        buffer.destroy(device);
+    _texture.destroy(_vrd);
 }
 
 void TextLayer::update(float dt, uint32_t commandBufferIndex, const glm::mat4& pv) {
@@ -130,9 +121,14 @@ void TextLayer::update(float dt, uint32_t commandBufferIndex, const glm::mat4& p
         offset += _scale * rect.w;
     }
 
-    // upload data to ssbos
-    _texCoords[commandBufferIndex].setData(_vrd, coords.data(), utils::vectorSizeByte(coords));
-    _charMVPs[commandBufferIndex].setData(_vrd, mvps.data(), utils::vectorSizeByte(mvps));
+    // upload data to the upload arena. The full range is allocated since the descriptors are bound with a fixed size
+    UploadArena::Allocation texCoords = _uploadArena->allocate(TEX_COORDS_SIZE);
+    memcpy(texCoords.data, coords.data(), utils::vectorSizeByte(coords));
+    _texCoordsOffset = texCoords.offset;
+
+    UploadArena::Allocation charMVPs = _uploadArena->allocate(MVPS_SIZE);
+    memcpy(charMVPs.data, mvps.data(), utils::vectorSizeByte(mvps));
+    _charMVPsOffset = charMVPs.offset;
 }
 
 void TextLayer::onEvent(Event& event) {}
@@ -141,7 +137,7 @@ void TextLayer::fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t comman
     // nothing to do if not chars
     if(_chars.empty())
         return;
-    bindPipelineAndDS(commandBuffer, commandBufferIndex);
+    bindPipelineAndDS(commandBuffer, commandBufferIndex, {_charMVPsOffset, _texCoordsOffset});
     _vertexBuffer.bind(commandBuffer);
     _indexBuffer.bind(commandBuffer);
     // draw instance (1 instance/char)
@@ -192,6 +188,7 @@ void TextLayer::onImGuiRender() {
         // destroy pipeline and create a new one
         vkDestroyPipeline(_vrd->device, _graphicsPipeline, nullptr);
         createGraphicsPipeline();
+        _vrd->pipelineBuilder->wait();
     }
 
     // image of the msdf
@@ -234,19 +231,19 @@ void TextLayer::createGraphicsPipeline() {
             .vertexInputBinding = &bindingDescription,
             .vertexInputAttributes = inputDescriptions,
             .shaders =  {
-                    .vertex = "TextV.spv",
-                    .fragment = "TextF.spv",
+                    .vertex = "textV.spv",
+                    .fragment = "textF.spv",
                     .fragmentSpec = &specializationInfo
             },
             .sampleCountMSAA = _vrd->sampleCount
     };
-    _graphicsPipeline = Factory::createGraphicsPipeline(_vrd->device, _swapchainExtent, _renderPass, _pipelineLayout, props);
+    _vrd->pipelineBuilder->queueGraphicsPipeline(&_graphicsPipeline, _renderPass, _pipelineLayout, props);
 }
 
 void TextLayer::regenerateTexture() {
     // destroy old msdf after waiting for idle
     vkDeviceWaitIdle(_vrd->device);
-    _texture.destroy(_vrd->device);
+    _texture.destroy(_vrd);
 
     // generate a new atlas with updated params (will recreate the texture)
     generateAtlasMSDF(FONT_FILENAME);
@@ -37,13 +37,15 @@ private:
 
 private:
     static constexpr uint32_t MAX_CHAR = 200;
+    static constexpr uint32_t MVPS_SIZE = MAX_CHAR * sizeof(glm::mat4);
+    static constexpr uint32_t TEX_COORDS_SIZE = MAX_CHAR * sizeof(glm::vec2) * 4;
     static constexpr char FONT_FILENAME[] = "../../../core/Assets/Fonts/Roboto/Roboto-Regular.ttf";
 
 private:
     VkRenderPass _renderPass = nullptr; ///< cached render pass for pipeline recreation
     ///< Tex coords of all the chars. NOTE:  Could be on device and no recomputed every frame
-    std::array<HostSSBO, MAX_FRAMES_IN_FLIGHT> _texCoords{}; ///< Coords of all char (4 / char)
-    std::array<HostSSBO, MAX_FRAMES_IN_FLIGHT> _charMVPs{};  ///< MVP's of all chars (1 / char)
+    uint32_t _texCoordsOffset = 0; ///< dynamic offset of the coords of all char (4 / char) in the upload arena
+    uint32_t _charMVPsOffset = 0;  ///< dynamic offset of the MVP's of all chars (1 / char) in the upload arena
 
     // renderer objects
     VertexBuffer  _vertexBuffer{};
@@ -64,7 +64,7 @@ TrueTypeFontLayer::TrueTypeFontLayer(VkRenderPass renderPass) {
             .enableDepthTest = VK_FALSE,
             .sampleCountMSAA = _vrd->sampleCount
     };
-    _graphicsPipeline = Factory::createGraphicsPipeline(_vrd->device, _swapchainExtent, renderPass, _pipelineLayout, props);
+    _graphicsPipeline = Factory::createGraphicsPipeline(_vrd, renderPass, _pipelineLayout, props);
 
 
 
@@ -75,8 +75,7 @@ TrueTypeFontLayer::TrueTypeFontLayer(VkRenderPass renderPass) {
 }
 
 TrueTypeFontLayer::~TrueTypeFontLayer() {
-    VkDevice device = Application::getApp()->getRenderer()->getRenderDevice()->device;
-    _texture.destroy(device);
+    _texture.destroy(Application::getApp()->getRenderer()->getRenderDevice());
 }
 
 void TrueTypeFontLayer::update(float dt, uint32_t commandBufferIndex, const glm::mat4& pv) {
@@ -0,0 +1,249 @@
+#include "MemoryAllocator.h"
+
+#include "../Utils/UtilsVulkan.h"
+
+
+void MemoryAllocator::init(VkDevice device, VkPhysicalDevice physicalDevice) {
+    _device = device;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &_memoryProperties);
+}
+
+void MemoryAllocator::destroy() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_allocationCount != 0)
+        SPDLOG_ERROR("{} allocations were not freed before destroying the allocator", _allocationCount);
+
+    for (auto& pool : _pools){
+        for (auto& block : pool.blocks){
+            // freeing the memory implicitly unmaps it
+            if (block.memory != nullptr)
+                vkFreeMemory(_device, block.memory, nullptr);
+        }
+    }
+    _pools.clear();
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // find the memory type and the pool associated with it
+    uint32_t memoryTypeIndex = utils::findMemoryType(_memoryProperties, requirements.memoryTypeBits, properties);
+    uint32_t poolIndex = getPoolIndex(memoryTypeIndex, linear);
+    Pool& pool = _pools[poolIndex];
+
+    MemoryAllocation allocation = {
+            .size = requirements.size,
+            .poolIndex = poolIndex,
+    };
+    ++_allocationCount;
+    _usedBytes += requirements.size;
+
+    // buddies are aligned on their size, so the alignment is respected if the buddy is at least as big as the alignment
+    uint32_t order = sizeToOrder(std::max(requirements.size, requirements.alignment));
+
+    // too big for a block, use a dedicated allocation
+    if (order > pool.maxOrder){
+        VkMemoryAllocateInfo allocateInfo = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                .allocationSize = requirements.size,
+                .memoryTypeIndex = memoryTypeIndex
+        };
+        VK_CHECK(vkAllocateMemory(_device, &allocateInfo, nullptr, &allocation.memory));
+        allocation.mapped = mapMemory(allocation.memory, memoryTypeIndex);
+        allocation.order = DEDICATED_ORDER;
+
+        ++_dedicatedCount;
+        _dedicatedBytes += requirements.size;
+        return allocation;
+    }
+
+    // try to allocate in one of the existing blocks
+    allocation.order = order;
+    for (uint32_t i = 0; i < pool.blocks.size(); ++i){
+        Block& block = pool.blocks[i];
+        if (block.memory != nullptr && allocateFromBlock(block, order, pool.maxOrder, allocation.offset)){
+            allocation.memory = block.memory;
+            allocation.mapped = block.mapped == nullptr ? nullptr : block.mapped + allocation.offset;
+            allocation.blockIndex = i;
+            return allocation;
+        }
+    }
+
+    // no space left, create a new block (reuse the slot of a freed block if one exists)
+    uint32_t blockIndex = 0;
+    while (blockIndex < pool.blocks.size() && pool.blocks[blockIndex].memory != nullptr)
+        ++blockIndex;
+    if (blockIndex == pool.blocks.size())
+        pool.blocks.emplace_back();
+
+    Block& block = pool.blocks[blockIndex];
+    createBlock(pool, block);
+    VK_ASSERT(allocateFromBlock(block, order, pool.maxOrder, allocation.offset), "Failed to allocate from a new block");
+    allocation.memory = block.memory;
+    allocation.mapped = block.mapped == nullptr ? nullptr : block.mapped + allocation.offset;
+    allocation.blockIndex = blockIndex;
+    return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation& allocation) {
+    if (allocation.memory == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    --_allocationCount;
+    _usedBytes -= allocation.size;
+
+    // dedicated allocation own their memory
+    if (allocation.order == DEDICATED_ORDER){
+        vkFreeMemory(_device, allocation.memory, nullptr);
+        --_dedicatedCount;
+        _dedicatedBytes -= allocation.size;
+        allocation = {};
+        return;
+    }
+
+    Pool& pool = _pools[allocation.poolIndex];
+    Block& block = pool.blocks[allocation.blockIndex];
+    block.usedBytes -= orderToSize(allocation.order);
+
+    // merge with the buddy as long as it is free
+    VkDeviceSize offset = allocation.offset;
+    uint32_t order = allocation.order;
+    while (order < pool.maxOrder){
+        VkDeviceSize buddy = offset ^ orderToSize(order);
+        auto it = block.freeLists[order].find(buddy);
+        if (it == block.freeLists[order].end())
+            break;
+        block.freeLists[order].erase(it);
+        offset = std::min(offset, buddy);
+        ++order;
+    }
+    block.freeLists[order].insert(offset);
+
+    // release the block if empty, unless it is the only empty block of the pool (prevents allocating a block
+    // every time a temporary buffer, like a staging buffer, is created and destroyed)
+    if (block.usedBytes == 0){
+        for (uint32_t i = 0; i < pool.blocks.size(); ++i){
+            if (i != allocation.blockIndex && pool.blocks[i].memory != nullptr && pool.blocks[i].usedBytes == 0){
+                vkFreeMemory(_device, block.memory, nullptr);
+                block = {};
+                break;
+            }
+        }
+    }
+
+    allocation = {};
+}
+
+MemoryAllocator::Stats MemoryAllocator::getStats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Stats stats = {
+            .dedicatedCount = _dedicatedCount,
+            .allocationCount = _allocationCount,
+            .allocatedBytes = _dedicatedBytes,
+            .usedBytes = _usedBytes,
+            .reservedBytes = _dedicatedBytes,
+    };
+
+    VkDeviceSize freeBytes = 0, largestFree = 0;
+    for (auto& pool : _pools){
+        for (auto& block : pool.blocks){
+            if (block.memory == nullptr)
+                continue;
+            ++stats.blockCount;
+            stats.allocatedBytes += pool.blockSize;
+            stats.reservedBytes += block.usedBytes;
+
+            // sum the free buddies and keep track of the largest one
+            for (uint32_t order = 0; order < block.freeLists.size(); ++order){
+                if (block.freeLists[order].empty())
+                    continue;
+                freeBytes += block.freeLists[order].size() * orderToSize(order);
+                largestFree = std::max(largestFree, orderToSize(order));
+            }
+        }
+    }
+    stats.fragmentation = freeBytes == 0 ? 0.f : 1.f - (float)largestFree / (float)freeBytes;
+    return stats;
+}
+
+//////////////////////// PRIVATE METHODS ///////////////////////////////////
+
+uint32_t MemoryAllocator::getPoolIndex(uint32_t memoryTypeIndex, bool linear) {
+    for (uint32_t i = 0; i < _pools.size(); ++i){
+        if (_pools[i].memoryTypeIndex == memoryTypeIndex && _pools[i].linear == linear)
+            return i;
+    }
+
+    // create the pool. Blocks are smaller on small heaps (fe : device local and host visible heap of 256 MB)
+    VkDeviceSize heapSize = _memoryProperties.memoryHeaps[_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+    Pool pool = {
+            .memoryTypeIndex = memoryTypeIndex,
+            .linear = linear,
+            .blockSize = BLOCK_SIZE
+    };
+    while (pool.blockSize > heapSize / 8 && pool.blockSize > MIN_ALLOCATION_SIZE)
+        pool.blockSize /= 2;
+    pool.maxOrder = sizeToOrder(pool.blockSize);
+
+    _pools.push_back(pool);
+    return _pools.size() - 1;
+}
+
+bool MemoryAllocator::allocateFromBlock(Block& block, uint32_t order, uint32_t maxOrder, VkDeviceSize& offset) {
+    // find the smallest free buddy big enough
+    uint32_t current = order;
+    while (current <= maxOrder && block.freeLists[current].empty())
+        ++current;
+    if (current > maxOrder)
+        return false;
+
+    // take the lowest free offset (keeps allocations packed at the beginning of the block)
+    offset = *block.freeLists[current].begin();
+    block.freeLists[current].erase(block.freeLists[current].begin());
+
+    // split the buddy until it has the requested order. The upper halves are added to the free lists
+    while (current > order){
+        --current;
+        block.freeLists[current].insert(offset + orderToSize(current));
+    }
+
+    block.usedBytes += orderToSize(order);
+    return true;
+}
+
+void MemoryAllocator::createBlock(Pool& pool, Block& block) {
+    VkMemoryAllocateInfo allocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = pool.blockSize,
+            .memoryTypeIndex = pool.memoryTypeIndex
+    };
+    VK_CHECK(vkAllocateMemory(_device, &allocateInfo, nullptr, &block.memory));
+    block.mapped = (uint8_t*)mapMemory(block.memory, pool.memoryTypeIndex);
+    block.usedBytes = 0;
+
+    // the whole block is free
+    block.freeLists.assign(pool.maxOrder + 1, {});
+    block.freeLists[pool.maxOrder].insert(0);
+}
+
+void* MemoryAllocator::mapMemory(VkDeviceMemory memory, uint32_t memoryTypeIndex) {
+    if (!(_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+        return nullptr;
+
+    // host visible memory stays mapped for its whole lifetime
+    void* mapped = nullptr;
+    VK_CHECK(vkMapMemory(_device, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+    return mapped;
+}
+
+uint32_t MemoryAllocator::sizeToOrder(VkDeviceSize size) {
+    uint32_t order = 0;
+    while (orderToSize(order) < size)
+        ++order;
+    return order;
+}
+
+VkDeviceSize MemoryAllocator::orderToSize(uint32_t order) {
+    return MIN_ALLOCATION_SIZE << order;
+}
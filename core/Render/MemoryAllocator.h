@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <set>
+#include <mutex>
+
+/// Sub-allocation of device memory returned by the MemoryAllocator. The resource must be bound at memory + offset
+struct MemoryAllocation {
+    VkDeviceMemory memory = nullptr;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;          ///< requested size
+    void* mapped = nullptr;         ///< pointer to the allocation if the memory is host visible (persistently mapped)
+
+    // used by the allocator to free the allocation
+    uint32_t poolIndex = 0;
+    uint32_t blockIndex = 0;
+    uint32_t order = 0;             ///< buddy order of the allocation. DEDICATED_ORDER if the allocation owns its memory
+};
+
+/// Block based device memory allocator. Memory is allocated in large blocks (one vkAllocateMemory per block) and
+/// sub-allocated with a buddy allocator. Blocks are pooled by memory type and by resource kind (linear for buffers,
+/// optimal for images) so bufferImageGranularity never needs to be considered. Host visible blocks are mapped once
+/// at creation. Requests larger than a block get a dedicated allocation
+class MemoryAllocator {
+public:
+    struct Stats {
+        uint32_t blockCount = 0;
+        uint32_t dedicatedCount = 0;
+        uint32_t allocationCount = 0;
+        VkDeviceSize allocatedBytes = 0;    ///< memory allocated from the device (blocks + dedicated)
+        VkDeviceSize usedBytes = 0;         ///< memory requested by the resources
+        VkDeviceSize reservedBytes = 0;     ///< memory reserved by the buddy allocations (used + internal fragmentation)
+        float fragmentation = 0.f;          ///< external fragmentation of the free memory : 1 - largest free range / total free
+    };
+
+    static constexpr VkDeviceSize BLOCK_SIZE = 64 * 1024 * 1024;   ///< default size of a block, must be a power of 2
+    static constexpr VkDeviceSize MIN_ALLOCATION_SIZE = 256;       ///< size of the smallest buddy (order 0)
+    static constexpr uint32_t DEDICATED_ORDER = UINT32_MAX;
+
+public:
+    MemoryAllocator() = default;
+
+    void init(VkDevice device, VkPhysicalDevice physicalDevice);
+    void destroy();
+
+    /// Allocates memory for a resource with the given requirements. Linear is true for buffers, false for optimal images
+    MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear);
+    void free(MemoryAllocation& allocation);
+
+    Stats getStats();
+
+private:
+    struct Block {
+        VkDeviceMemory memory = nullptr;
+        uint8_t* mapped = nullptr;
+        VkDeviceSize usedBytes = 0;                        ///< reserved bytes in the block
+        std::vector<std::set<VkDeviceSize>> freeLists;     ///< offsets of the free buddies, per order
+    };
+
+    struct Pool {
+        uint32_t memoryTypeIndex = 0;
+        bool linear = true;
+        VkDeviceSize blockSize = BLOCK_SIZE;
+        uint32_t maxOrder = 0;                             ///< order of a whole block
+        std::vector<Block> blocks;                         ///< freed blocks have a null memory and are reused
+    };
+
+private:
+    uint32_t getPoolIndex(uint32_t memoryTypeIndex, bool linear);
+    bool allocateFromBlock(Block& block, uint32_t order, uint32_t maxOrder, VkDeviceSize& offset);
+    void createBlock(Pool& pool, Block& block);
+    void* mapMemory(VkDeviceMemory memory, uint32_t memoryTypeIndex);
+
+    static uint32_t sizeToOrder(VkDeviceSize size);
+    static VkDeviceSize orderToSize(uint32_t order);
+
+private:
+    VkDevice _device = nullptr;
+    VkPhysicalDeviceMemoryProperties _memoryProperties{};
+
+    std::vector<Pool> _pools;
+    std::mutex _mutex;  ///< allocations can be done from upload/loading threads
+
+    // dedicated allocations stats
+    uint32_t _dedicatedCount = 0;
+    VkDeviceSize _dedicatedBytes = 0;
+    uint32_t _allocationCount = 0;
+    VkDeviceSize _usedBytes = 0;
+};
@@ -0,0 +1,193 @@
+#include "DepthPyramid.h"
+
+#include "../Factory/FactoryVulkan.h"
+#include "../PipelineBuilder.h"
+#include "../../Utils/UtilsVulkan.h"
+
+
+void DepthPyramid::init(VulkanRenderDevice* vrd, VkExtent2D extent, VkImageView depthView) {
+    createImages(vrd, extent);
+
+    // the culling reads exact texels of a level, no filtering. The levels are limited by the view
+    VkSamplerCreateInfo samplerCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .magFilter = VK_FILTER_NEAREST,
+            .minFilter = VK_FILTER_NEAREST,
+            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .minLod = 0.f,
+            .maxLod = VK_LOD_CLAMP_NONE,
+            .borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+            .unnormalizedCoordinates = VK_FALSE,
+    };
+    VK_CHECK(vkCreateSampler(vrd->device, &samplerCreateInfo, nullptr, &_sampler));
+
+    // the depth attachment and all the levels, selected with the level push constant
+    std::vector<Factory::Descriptor> descriptors = {
+            {
+                    .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    .shaderStage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .info = std::vector<VkDescriptorImageInfo>{
+                            {.sampler = _sampler, .imageView = depthView, .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL}
+                    }
+            },
+            {
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    .shaderStage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .info = getLevelInfos()
+            },
+    };
+
+    _levelPC = {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(uint32_t),
+    };
+
+    std::tie(_descriptorSetLayout, _pipelineLayout, _descriptorPool, _descriptorSets) =
+            Factory::createDescriptorSets(vrd, descriptors, {_levelPC});
+    vrd->pipelineBuilder->queueComputePipeline(&_pipeline, _pipelineLayout, "depthPyramidC.spv");
+}
+
+void DepthPyramid::destroy(VulkanRenderDevice* vrd) {
+    if (_image == nullptr)
+        return;
+
+    vkDestroyPipeline(vrd->device, _pipeline, nullptr);
+    vkDestroyPipelineLayout(vrd->device, _pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(vrd->device, _descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(vrd->device, _descriptorSetLayout, nullptr);
+
+    vkDestroySampler(vrd->device, _sampler, nullptr);
+    destroyImages(vrd);
+}
+
+void DepthPyramid::resize(VulkanRenderDevice* vrd, VkExtent2D extent, VkImageView depthView) {
+    destroyImages(vrd);
+    createImages(vrd, extent);
+
+    // only the first set is used
+    VkDescriptorImageInfo depthInfo = {.sampler = _sampler, .imageView = depthView,
+                                       .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+    std::vector<VkDescriptorImageInfo> levelInfos = getLevelInfos();
+    std::array<VkWriteDescriptorSet, 2> writes = {
+            VkWriteDescriptorSet{
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = _descriptorSets[0],
+                    .dstBinding = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    .pImageInfo = &depthInfo,
+            },
+            VkWriteDescriptorSet{
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = _descriptorSets[0],
+                    .dstBinding = 1,
+                    .descriptorCount = (uint32_t)levelInfos.size(),
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                    .pImageInfo = levelInfos.data(),
+            },
+    };
+    vkUpdateDescriptorSets(vrd->device, writes.size(), writes.data(), 0, nullptr);
+}
+
+void DepthPyramid::createImages(VulkanRenderDevice* vrd, VkExtent2D extent) {
+    // largest power of 2 smaller or equal to the extent, so every level is exactly half of the previous one
+    auto previousPow2 = [](uint32_t value){
+        uint32_t result = 1;
+        while (result * 2 <= value)
+            result *= 2;
+        return result;
+    };
+    _extent = {previousPow2(extent.width), previousPow2(extent.height)};
+    _levelCount = 1;
+    while ((std::max(_extent.width, _extent.height) >> _levelCount) > 0)
+        ++_levelCount;
+    VK_ASSERT(_levelCount <= MAX_LEVELS, "Depth pyramid has too many levels");
+
+    // the pyramid is written as a storage image and sampled by the culling
+    std::tie(_image, _allocation) = Factory::createImage(vrd, VK_SAMPLE_COUNT_1_BIT, _extent.width, _extent.height,
+                                                         VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+                                                         VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _levelCount);
+    _imageView = Factory::createImageView(vrd->device, _image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, _levelCount);
+    for (uint32_t i = 0; i < _levelCount; ++i)
+        _levelViews[i] = Factory::createImageView(vrd->device, _image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, i, 1);
+}
+
+void DepthPyramid::destroyImages(VulkanRenderDevice* vrd) {
+    for (uint32_t i = 0; i < _levelCount; ++i)
+        vkDestroyImageView(vrd->device, _levelViews[i], nullptr);
+    vkDestroyImageView(vrd->device, _imageView, nullptr);
+    Factory::destroyImage(vrd, _image, _allocation);
+
+    _image = nullptr;
+    _imageView = nullptr;
+    _levelViews = {nullptr};
+    _levelCount = 0;
+}
+
+std::vector<VkDescriptorImageInfo> DepthPyramid::getLevelInfos() const {
+    std::vector<VkDescriptorImageInfo> levelInfos(MAX_LEVELS);
+    for (uint32_t i = 0; i < MAX_LEVELS; ++i)
+        levelInfos[i] = {.sampler = nullptr, .imageView = _levelViews[std::min(i, _levelCount - 1)],
+                         .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+    return levelInfos;
+}
+
+void DepthPyramid::build(VkCommandBuffer commandBuffer) {
+    // the previous content is discarded, every texel is written. Waits for the previous culling to be done reading it
+    VkImageMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = _image,
+            .subresourceRange = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = 0,
+                    .levelCount = _levelCount,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1
+            }
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &_descriptorSets[0], 0, nullptr);
+
+    // level 0 is reduced from the depth attachment, the others from the previous level
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    for (uint32_t level = 0; level < _levelCount; ++level){
+        uint32_t width = std::max(_extent.width >> level, 1u);
+        uint32_t height = std::max(_extent.height >> level, 1u);
+        vkCmdPushConstants(commandBuffer, _pipelineLayout, _levelPC.stageFlags, _levelPC.offset, _levelPC.size, &level);
+        vkCmdDispatch(commandBuffer, (width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+        // the level is read by the next level and by the culling
+        barrier.subresourceRange.baseMipLevel = level;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+    }
+}
+
+VkImageView DepthPyramid::getImageView() const {
+    return _imageView;
+}
+
+VkSampler DepthPyramid::getSampler() const {
+    return _sampler;
+}
+
+uint32_t DepthPyramid::getLevelCount() const {
+    return _levelCount;
+}
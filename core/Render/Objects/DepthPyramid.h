@@ -0,0 +1,61 @@
+#pragma once
+
+#include "../VulkanRenderDevice.hpp"
+#include "../MemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+#include <array>
+#include <vector>
+
+/// Hierarchical depth buffer (HiZ) used for occlusion culling. Every texel holds the farthest depth of the area it
+/// covers. Level 0 is the largest power of 2 smaller than the depth attachment, the following levels are reduced from
+/// the previous one (2x2 -> 1). Built on the GPU with a compute shader, one dispatch per level
+class DepthPyramid {
+public:
+    DepthPyramid() = default;
+
+    /// depthView is the view of the depth aspect of the (multisampled) depth attachment of size extent
+    void init(VulkanRenderDevice* vrd, VkExtent2D extent, VkImageView depthView);
+    void destroy(VulkanRenderDevice* vrd);
+
+    /// recreates the pyramid for the new depth attachment. The pipeline is kept, the descriptors are rewritten. The
+    /// GPU must not be using the pyramid
+    void resize(VulkanRenderDevice* vrd, VkExtent2D extent, VkImageView depthView);
+
+    /// Records the reduction of the depth attachment. The depth must be in DEPTH_STENCIL_READ_ONLY_OPTIMAL layout with its
+    /// writes available to the compute stage. Once done, the pyramid can be sampled by compute shaders
+    void build(VkCommandBuffer commandBuffer);
+
+    [[nodiscard]] VkImageView getImageView() const;   ///< view of all levels, always in GENERAL layout
+    [[nodiscard]] VkSampler getSampler() const;       ///< nearest filtering, clamped to edge
+    [[nodiscard]] uint32_t getLevelCount() const;
+
+    static constexpr uint32_t MAX_LEVELS = 16;
+
+private:
+    void createImages(VulkanRenderDevice* vrd, VkExtent2D extent);
+    void destroyImages(VulkanRenderDevice* vrd);
+
+    /// storage image infos of the levels. Always MAX_LEVELS, padded with the last level so the descriptor set layout
+    /// (and the pipeline) does not depend on the size
+    std::vector<VkDescriptorImageInfo> getLevelInfos() const;
+
+private:
+    VkImage _image = nullptr;
+    MemoryAllocation _allocation{};
+    VkImageView _imageView = nullptr;
+    std::array<VkImageView, MAX_LEVELS> _levelViews = {nullptr}; ///< one view per level, bound as storage images
+    VkSampler _sampler = nullptr;
+    VkExtent2D _extent{};
+    uint32_t _levelCount = 0;
+
+    // reduction pipeline. The descriptors do not change between frames, only the first set is used
+    VkDescriptorSetLayout _descriptorSetLayout = nullptr;
+    VkDescriptorPool _descriptorPool = nullptr;
+    std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> _descriptorSets = {nullptr};
+    VkPipelineLayout _pipelineLayout = nullptr;
+    VkPipeline _pipeline = nullptr;
+    VkPushConstantRange _levelPC{};
+
+    static constexpr uint32_t WORKGROUP_SIZE = 8; ///< must match the local size of depthPyramid.comp
+};
@@ -6,6 +6,7 @@
 
 
 #include "../VulkanRenderDevice.hpp"
+#include "../MemoryAllocator.h"
 
 class IndexBuffer {
 public:
@@ -24,7 +25,7 @@ private:
 
 private:
     VkBuffer        _buffer       = nullptr;
-    VkDeviceMemory  _deviceMemory = nullptr;
+    MemoryAllocation _allocation{};
     VkIndexType     _indexType    = VK_INDEX_TYPE_NONE_KHR;
     uint32_t        _indexCount   = 0;
 };
\ No newline at end of file
@@ -13,7 +13,7 @@ void ShaderStorageBuffer::init(VulkanRenderDevice* vrd, bool hostVisible,
     VkMemoryPropertyFlags memFlags = hostVisible ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT :
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     _size = size;
-    std::tie(_buffer, _bufferMemory) = Factory::createBuffer(vrd->device, vrd->physicalDevice, _size,
+    std::tie(_buffer, _allocation) = Factory::createBuffer(vrd, _size,
                           VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | additionalUsage,
                           memFlags);
 
@@ -22,11 +22,8 @@ void ShaderStorageBuffer::init(VulkanRenderDevice* vrd, bool hostVisible,
         VK_ASSERT(setData(vrd, data, size), "Failed to set SSBO data at init");
 }
 
-void ShaderStorageBuffer::destroy(VkDevice device) {
-    vkFreeMemory(device, _bufferMemory, nullptr);
-    vkDestroyBuffer(device, _buffer, nullptr);
-
-    _bufferMemory = nullptr;
+void ShaderStorageBuffer::destroy(VulkanRenderDevice* vrd) {
+    Factory::destroyBuffer(vrd, _buffer, _allocation);
     _buffer = nullptr;
 }
 
@@ -48,10 +45,15 @@ bool HostSSBO::setData(VulkanRenderDevice* vrd, void* data, uint32_t size) {
         return false;
 
     // if the buffer is host visible, simply copy memory (no need for a staging buffer)
-    void* dst = nullptr;
-    VK_CHECK(vkMapMemory(vrd->device, _bufferMemory, 0, size, 0, &dst));
-    memcpy(dst, data, size);
-    vkUnmapMemory(vrd->device, _bufferMemory);
+    memcpy(_allocation.mapped, data, size);
+    return true;
+}
+
+bool HostSSBO::setData(VulkanRenderDevice* vrd, const void* data, uint32_t size, uint32_t offset) {
+    if ((uint64_t)offset + size > _size)
+        return false;
+
+    memcpy((uint8_t*)_allocation.mapped + offset, data, size);
     return true;
 }
 
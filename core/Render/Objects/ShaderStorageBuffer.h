@@ -6,6 +6,7 @@
 
 #include <vulkan/vulkan.h>
 #include "../VulkanRenderDevice.hpp"
+#include "../MemoryAllocator.h"
 
 
 class ShaderStorageBuffer {
@@ -15,7 +16,7 @@ protected:
 public:
     virtual bool setData(VulkanRenderDevice* vrd, void* data, uint32_t size) = 0;
 
-    void destroy(VkDevice device);
+    void destroy(VulkanRenderDevice* vrd);
 
     [[nodiscard]] uint32_t getSize() const;
     [[nodiscard]] VkBuffer getBuffer() const;
@@ -26,7 +27,7 @@ protected:
 
 protected:
     VkBuffer _buffer = nullptr;
-    VkDeviceMemory _bufferMemory = nullptr;
+    MemoryAllocation _allocation{}; ///< persistently mapped if host visible
     uint32_t _size = 0;
 };
 
@@ -36,6 +37,9 @@ public:
 
     void init(VulkanRenderDevice* vrd, uint32_t size, void* data = nullptr, VkBufferUsageFlags additionalUsage = 0);
     virtual bool setData(VulkanRenderDevice* vrd, void* data, uint32_t size) override;
+
+    /// copies the data at the offset of the buffer, the rest of the buffer is kept
+    bool setData(VulkanRenderDevice* vrd, const void* data, uint32_t size, uint32_t offset);
 };
 
 class DeviceSSBO : public ShaderStorageBuffer {
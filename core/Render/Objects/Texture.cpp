@@ -7,6 +7,7 @@
 #include "../Factory/FactoryVulkan.h"
 #include "../../Utils/UtilsFile.h"
 #include "../../Utils/UtilsVulkan.h"
+#include "../UploadService.h"
 
 // TODO : extract in file if used elsewhere
 #define STB_IMAGE_IMPLEMENTATION
@@ -21,62 +22,15 @@ void Texture::init(const Texture::TextureDesc& desc, VulkanRenderDevice& renderD
     VK_ASSERT(imageSize == desc.data.size(), "Invalid data");
 
 
-    // create staging buffer for transfer
-    auto stagingBuffer = Factory::createBuffer(renderDevice.device, renderDevice.physicalDevice, imageSize,
-                                               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-
-    // copy pixels to staging buffer
-    void* dst = nullptr;
-    VK_CHECK(vkMapMemory(renderDevice.device, stagingBuffer.second, 0, imageSize, 0, &dst));
-    memcpy(dst, desc.data.data(), imageSize);
-    vkUnmapMemory(renderDevice.device, stagingBuffer.second);
-
     // create the image with its associated memory
-    std::tie(_image, _imageMemory) = Factory::createImage(&renderDevice, VK_SAMPLE_COUNT_1_BIT, desc.width, desc.height, desc.imageFormat,
+    std::tie(_image, _imageAllocation) = Factory::createImage(&renderDevice, VK_SAMPLE_COUNT_1_BIT, desc.width, desc.height, desc.imageFormat,
                                                           VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                                                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    // transition image layout UNDEFINED -> DST_OPTIMAL
-    utils::transitionImageLayout(renderDevice.device, renderDevice.graphicsQueue, renderDevice.commandPool, _image, desc.imageFormat,
-                                 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-    // copy staging buffer -> image. Note : this should probably be extracted in a utils generic function
-    utils::executeOnQueueSync(renderDevice.graphicsQueue, renderDevice.device, renderDevice.commandPool,
-                              [&, this](VkCommandBuffer commandBuffer){
-                                  VkBufferImageCopy imageRegion = {
-                                          .bufferOffset = 0,
-                                          .bufferRowLength = 0,     // would matter if data was not tightly pacted
-                                          .bufferImageHeight = 0,   // would matter if data was not tightly pacted
-                                          .imageSubresource = {
-                                                  .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                                                  .mipLevel = 0,
-                                                  .baseArrayLayer = 0,
-                                                  .layerCount = 1
-                                          },
-                                          .imageOffset = {
-                                                  .x = 0,
-                                                  .y = 0,
-                                                  .z = 0,
-                                          },
-                                          .imageExtent = {
-                                                  .width = desc.width,
-                                                  .height = desc.height,
-                                                  .depth = 1,
-                                          }
-                                  };
-                                  vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.first, _image,
-                                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageRegion);
-                              });
-
-
-    // transition from DST_OPTIMAL -> SHADER_READ_ONLY_OPTIMAL
-    utils::transitionImageLayout(renderDevice.device, renderDevice.graphicsQueue, renderDevice.commandPool, _image, desc.imageFormat,
-                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    // delete the staging buffer after the transfer
-    vkFreeMemory(renderDevice.device, stagingBuffer.second, nullptr);
-    vkDestroyBuffer(renderDevice.device, stagingBuffer.first, nullptr);
+    // batch the layout transitions and the copy with the other uploads. The image is ready before the next frame is rendered
+    uint64_t uploadValue = renderDevice.uploadService->uploadImage(_image, desc.data.data(), imageSize, desc.width, desc.height,
+                                                                   formatToSize(desc.imageFormat));
+    renderDevice.uploadService->requireForFrame(uploadValue);
 
     _imageView = Factory::createImageView(renderDevice.device, _image, desc.imageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
 
@@ -133,16 +87,14 @@ void Texture::init(const std::string& filePath, VulkanRenderDevice& renderDevice
     init(desc, renderDevice, createSampler);
 }
 
-void Texture::destroy(VkDevice device) {
+void Texture::destroy(VulkanRenderDevice* vrd) {
     if (_sampler != nullptr)
-        vkDestroySampler(device, _sampler, nullptr);
-    vkDestroyImageView(device, _imageView, nullptr);
-    vkFreeMemory(device, _imageMemory, nullptr);
-    vkDestroyImage(device, _image, nullptr);
+        vkDestroySampler(vrd->device, _sampler, nullptr);
+    vkDestroyImageView(vrd->device, _imageView, nullptr);
+    Factory::destroyImage(vrd, _image, _imageAllocation);
 
     _sampler = nullptr;
     _imageView = nullptr;
-    _imageMemory = nullptr;
     _image = nullptr;
 }
 
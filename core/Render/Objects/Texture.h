@@ -5,6 +5,7 @@
 #pragma once
 
 #include "../VulkanRenderDevice.hpp"
+#include "../MemoryAllocator.h"
 
 #include <vulkan/vulkan.h>
 #include <string>
@@ -23,7 +24,7 @@ public:
     void init(const TextureDesc& desc,     VulkanRenderDevice& renderDevice, bool createSampler);
     void init(const std::string& filePath, VulkanRenderDevice& renderDevice, bool createSampler);
 
-    void destroy(VkDevice device);
+    void destroy(VulkanRenderDevice* vrd);
 
     VkSampler getSampler();
     VkImageView getImageView();
@@ -32,7 +33,7 @@ private:
     static uint32_t formatToSize(VkFormat format);
     VkImage _image = nullptr;
     VkImageView _imageView = nullptr;
-    VkDeviceMemory _imageMemory = nullptr;
+    MemoryAllocation _imageAllocation{};
     VkSampler _sampler = nullptr; // TODO : we really want to store the sampler in the texture ??
 };
 
@@ -2,17 +2,14 @@
 
 #include "../Factory/FactoryVulkan.h"
 
-void UniformBuffer::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t size){
+void UniformBuffer::init(VulkanRenderDevice* vrd, uint32_t size){
     _size = size;
-    std::tie(_buffer, _bufferMemory) = Factory::createBuffer(device, physicalDevice, size,
+    std::tie(_buffer, _allocation) = Factory::createBuffer(vrd, size,
 		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 }
 
-void UniformBuffer::destroy(VkDevice device){
-	vkDestroyBuffer(device, _buffer, nullptr);
-	vkFreeMemory(device, _bufferMemory, nullptr);
-
-	_bufferMemory = nullptr;
+void UniformBuffer::destroy(VulkanRenderDevice* vrd){
+	Factory::destroyBuffer(vrd, _buffer, _allocation);
 	_buffer = nullptr;
 }
 
@@ -27,12 +24,7 @@ VkBuffer UniformBuffer::getBuffer() {
 bool UniformBuffer::setData(VkDevice device, void* data, uint32_t size) {
 	if (size > _size)
 		return false;
-	void* pData = nullptr;
-	VK_CHECK(vkMapMemory(device, _bufferMemory, 0, size, 0, &pData));
-	memcpy(pData, data, size);
-
-	vkUnmapMemory(device, _bufferMemory);
-
+	memcpy(_allocation.mapped, data, size);
 	return true;
 }
 
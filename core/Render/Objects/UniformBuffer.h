@@ -1,13 +1,15 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include "../VulkanRenderDevice.hpp"
+#include "../MemoryAllocator.h"
 
 class UniformBuffer {
 public:
 	UniformBuffer() = default;
 	
-	void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t size);
-	void destroy(VkDevice device);
+	void init(VulkanRenderDevice* vrd, uint32_t size);
+	void destroy(VulkanRenderDevice* vrd);
 
 	uint32_t getSize();
 	VkBuffer getBuffer();
@@ -16,6 +18,6 @@ public:
 
 private:
 	VkBuffer _buffer = nullptr;
-	VkDeviceMemory _bufferMemory = nullptr;
+	MemoryAllocation _allocation{}; ///< host visible, persistently mapped
 	uint32_t _size{};
 };
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "UploadArena.h"
+
+#include "../Factory/FactoryVulkan.h"
+
+
+void UploadArena::init(VulkanRenderDevice* vrd, uint32_t frameSize) {
+    // dynamic offsets must respect the alignment of the descriptor type they are used with
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vrd->physicalDevice, &properties);
+    _alignment = std::max(properties.limits.minUniformBufferOffsetAlignment, properties.limits.minStorageBufferOffsetAlignment);
+
+    // make sure every frame region starts at an aligned offset
+    _frameSize = (frameSize + _alignment - 1) & ~(_alignment - 1);
+
+    // the allocation is persistently mapped by the allocator (coherent, no flush needed)
+    std::tie(_buffer, _allocation) = Factory::createBuffer(vrd, _frameSize * MAX_FRAMES_IN_FLIGHT,
+                           VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    _mapped = (uint8_t*)_allocation.mapped;
+}
+
+void UploadArena::destroy(VulkanRenderDevice* vrd) {
+    Factory::destroyBuffer(vrd, _buffer, _allocation);
+    _mapped = nullptr;
+    _buffer = nullptr;
+}
+
+void UploadArena::beginFrame(uint32_t frameIndex) {
+    _frameStart = frameIndex * _frameSize;
+    _cursor = 0;
+}
+
+UploadArena::Allocation UploadArena::allocate(uint32_t size) {
+    VK_ASSERT(_cursor + size <= _frameSize, "Upload arena is out of memory for the current frame");
+    Allocation allocation = {
+            .data = _mapped + _frameStart + _cursor,
+            .offset = _frameStart + _cursor
+    };
+
+    // next allocation starts at the next aligned offset
+    _cursor = (_cursor + size + _alignment - 1) & ~(_alignment - 1);
+    return allocation;
+}
+
+uint32_t UploadArena::push(const void* data, uint32_t size) {
+    Allocation allocation = allocate(size);
+    memcpy(allocation.data, data, size);
+    return allocation.offset;
+}
+
+VkBuffer UploadArena::getBuffer() const {
+    return _buffer;
+}
+
+uint32_t UploadArena::getFrameSize() const {
+    return _frameSize;
+}
+
+uint32_t UploadArena::getUsedSize() const {
+    return _cursor;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../VulkanRenderDevice.hpp"
+#include "../MemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+/// Linear allocator over one persistently mapped host visible buffer, used for data uploaded every frame (uniforms,
+/// per frame SSBOs). The buffer is split in one region per frame in flight. Every frame, the region of the current frame
+/// is reset and layers sub-allocate from it. Allocations are bound with dynamic offsets (UNIFORM_BUFFER_DYNAMIC and
+/// STORAGE_BUFFER_DYNAMIC descriptors), so no map/unmap nor per buffer memory is needed
+class UploadArena {
+public:
+    struct Allocation {
+        void* data = nullptr;   ///< mapped pointer to the allocation, valid until the frame region is reused
+        uint32_t offset = 0;    ///< offset of the allocation in the buffer. To be used as dynamic offset
+    };
+
+public:
+    UploadArena() = default;
+
+    void init(VulkanRenderDevice* vrd, uint32_t frameSize);
+    void destroy(VulkanRenderDevice* vrd);
+
+    /// Resets the region of the given frame in flight. Must only be called once the GPU is done with the frame
+    void beginFrame(uint32_t frameIndex);
+
+    /// Sub-allocates size bytes in the current frame region. Offset is aligned for both uniform and storage buffers
+    Allocation allocate(uint32_t size);
+
+    /// Allocates and copies the data. Returns the dynamic offset of the data
+    uint32_t push(const void* data, uint32_t size);
+
+    [[nodiscard]] VkBuffer getBuffer() const;
+    [[nodiscard]] uint32_t getFrameSize() const;
+    [[nodiscard]] uint32_t getUsedSize() const; ///< bytes used in the current frame region
+
+private:
+    VkBuffer _buffer = nullptr;
+    MemoryAllocation _allocation{};
+    uint8_t* _mapped = nullptr;     ///< pointer to the whole buffer, mapped for the lifetime of the arena
+
+    uint32_t _frameSize = 0;        ///< size of the region of a single frame in flight
+    uint32_t _alignment = 1;        ///< min alignment of the dynamic offsets
+    uint32_t _frameStart = 0;       ///< offset of the region of the current frame
+    uint32_t _cursor = 0;           ///< offset of the next allocation, relative to _frameStart
+};
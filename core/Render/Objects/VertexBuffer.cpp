@@ -12,13 +12,12 @@ VertexBuffer::~VertexBuffer() {
     // NOTE : This destructor does not obey the rule of 3 : The destructor frees resources not created by the constructor.
     // DO NOT use this class in container like the vector. Reallocation of the buffer will destroy GPU resources still in use
     VulkanRenderDevice* vrd = Application::getApp()->getRenderer()->getRenderDevice();
-    vkFreeMemory(vrd->device, _deviceMemory, nullptr);
-    vkDestroyBuffer(vrd->device, _buffer, nullptr);
+    Factory::destroyBuffer(vrd, _buffer, _allocation);
 }
 
 void VertexBuffer::init(VulkanRenderDevice* vrd, void* data, uint32_t size) {
     // create buffer and memory
-    std::tie(_buffer, _deviceMemory) = Factory::createBuffer(vrd->device, vrd->physicalDevice, size,
+    std::tie(_buffer, _allocation) = Factory::createBuffer(vrd, size,
                                                              VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
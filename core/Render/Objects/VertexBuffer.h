@@ -9,6 +9,7 @@
 
 #include <vulkan/vulkan.h>
 #include "../VulkanRenderDevice.hpp"
+#include "../MemoryAllocator.h"
 
 
 class VertexBuffer {
@@ -30,7 +31,7 @@ public:
 
 private:
     VkBuffer _buffer = nullptr;
-    VkDeviceMemory _deviceMemory = nullptr;
+    MemoryAllocation _allocation{};
 };
 
 // templates are mysterious :
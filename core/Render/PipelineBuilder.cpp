@@ -0,0 +1,111 @@
+#include "PipelineBuilder.h"
+
+#include "../Utils/ThreadPool.h"
+
+#include <cstring>
+
+
+PipelineBuilder::Specialization::Specialization(const VkSpecializationInfo& source) :
+        entries(source.pMapEntries, source.pMapEntries + source.mapEntryCount),
+        data((const uint8_t*)source.pData, (const uint8_t*)source.pData + source.dataSize){
+    info = {
+            .mapEntryCount = (uint32_t)entries.size(),
+            .pMapEntries = entries.data(),
+            .dataSize = data.size(),
+            .pData = data.data()
+    };
+}
+
+void PipelineBuilder::init(VulkanRenderDevice* vrd) {
+    _vrd = vrd;
+}
+
+void PipelineBuilder::queueGraphicsPipeline(VkPipeline* pipeline, VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
+                                            const Factory::GraphicsPipelineProps& props) {
+    // the props only point to the caller's data, copy it
+    auto copy = std::make_shared<Factory::GraphicsPipelineProps>(props);
+    std::shared_ptr<VkVertexInputBindingDescription> binding = nullptr;
+    if (props.vertexInputBinding != nullptr){
+        binding = std::make_shared<VkVertexInputBindingDescription>(*props.vertexInputBinding);
+        copy->vertexInputBinding = binding.get();
+    }
+    std::shared_ptr<Specialization> vertexSpec = nullptr;
+    if (props.shaders.vertexSpec != nullptr){
+        vertexSpec = std::make_shared<Specialization>(*props.shaders.vertexSpec);
+        copy->shaders.vertexSpec = &vertexSpec->info;
+    }
+    std::shared_ptr<Specialization> fragmentSpec = nullptr;
+    if (props.shaders.fragmentSpec != nullptr){
+        fragmentSpec = std::make_shared<Specialization>(*props.shaders.fragmentSpec);
+        copy->shaders.fragmentSpec = &fragmentSpec->info;
+    }
+
+    VulkanRenderDevice* vrd = _vrd;
+    queue([=](){
+        *pipeline = Factory::createGraphicsPipeline(vrd, renderPass, pipelineLayout, *copy);
+    });
+}
+
+void PipelineBuilder::queueComputePipeline(VkPipeline* pipeline, VkPipelineLayout pipelineLayout,
+                                           const std::string& shaderFile, const VkSpecializationInfo* specializationInfo) {
+    std::shared_ptr<Specialization> spec = nullptr;
+    if (specializationInfo != nullptr)
+        spec = std::make_shared<Specialization>(*specializationInfo);
+
+    VulkanRenderDevice* vrd = _vrd;
+    queue([=](){
+        *pipeline = Factory::createComputePipeline(vrd, pipelineLayout, shaderFile, spec ? &spec->info : nullptr);
+    });
+}
+
+void PipelineBuilder::wait() {
+    // build the pipelines not started yet on this thread, the workers can be busy with long tasks (model imports)
+    for (auto& job : _jobs){
+        if (!job->claimed.exchange(true))
+            run(*job);
+    }
+
+    // wait for the builds started by the workers. Every future is waited before rethrowing, the jobs reference
+    // the layers' pipeline handles
+    std::exception_ptr exception = nullptr;
+    for (auto& result : _results){
+        try {
+            result.get();
+        }
+        catch (...) {
+            if (exception == nullptr)
+                exception = std::current_exception();
+        }
+    }
+    _jobs.clear();
+    _results.clear();
+    if (exception != nullptr)
+        std::rethrow_exception(exception);
+}
+
+uint32_t PipelineBuilder::getPendingCount() {
+    return (uint32_t)_jobs.size();
+}
+
+void PipelineBuilder::queue(std::function<void()> build) {
+    auto job = std::make_shared<Job>();
+    job->build = std::move(build);
+    _results.push_back(job->done.get_future());
+    _jobs.push_back(job);
+
+    // the job is skipped by the worker if the render thread claimed it first
+    ThreadPool::global().submit([job](){
+        if (!job->claimed.exchange(true))
+            run(*job);
+    });
+}
+
+void PipelineBuilder::run(Job& job) {
+    try {
+        job.build();
+        job.done.set_value();
+    }
+    catch (...) {
+        job.done.set_exception(std::current_exception());
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "VulkanRenderDevice.hpp"
+#include "Factory/FactoryVulkan.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <functional>
+
+/// Builds the pipelines concurrently on the global thread pool. The layers queue their pipelines (usually all of them
+/// at init) and the render thread waits for the batch before using them. The builds share the device pipeline cache
+/// and shader library. A build not started by a worker when wait is called is done by the calling thread, so the
+/// render thread never waits behind the other tasks of the pool.
+/// NOTE : must be called from the render thread
+class PipelineBuilder {
+public:
+    PipelineBuilder() = default;
+
+    void init(VulkanRenderDevice* vrd);
+
+    /// queues the build of the pipeline, written in *pipeline before wait returns. The props (and the vertex binding
+    /// and specialization infos they point to) are copied, they can be released after the call
+    void queueGraphicsPipeline(VkPipeline* pipeline, VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
+                               const Factory::GraphicsPipelineProps& props);
+    void queueComputePipeline(VkPipeline* pipeline, VkPipelineLayout pipelineLayout, const std::string& shaderFile,
+                              const VkSpecializationInfo* specializationInfo = nullptr);
+
+    /// blocks until every queued pipeline is built. Rethrows the first build error
+    void wait();
+
+    uint32_t getPendingCount();
+
+private:
+    /// copy of a specialization info, the pointers refer to the copied entries and data
+    struct Specialization {
+        std::vector<VkSpecializationMapEntry> entries;
+        std::vector<uint8_t> data;
+        VkSpecializationInfo info{};
+
+        explicit Specialization(const VkSpecializationInfo& source);
+    };
+
+    struct Job {
+        std::function<void()> build;
+        std::atomic<bool> claimed = false;  ///< set by the thread running the build, a worker or the render thread
+        std::promise<void> done;
+    };
+
+    void queue(std::function<void()> build);
+    static void run(Job& job);
+
+private:
+    VulkanRenderDevice* _vrd = nullptr;
+    std::vector<std::shared_ptr<Job>> _jobs;
+    std::vector<std::future<void>> _results;
+};
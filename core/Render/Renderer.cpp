@@ -17,6 +17,8 @@
 #include "Layers/TextLayer.h"
 
 #include <imgui/imgui.h>
+#include <chrono>
+#include <algorithm>
 
 
 Renderer::Renderer(float initialAspectRatio) : _camera(initialAspectRatio),
@@ -25,39 +27,38 @@ Renderer::Renderer(float initialAspectRatio) : _camera(initialAspectRatio),
 Renderer::~Renderer() {
     VK_CHECK(vkDeviceWaitIdle(_vrd.device));
 
+    // the cache holds every pipeline created during the run
+    Factory::savePipelineCache(_vrd.device, _vrd.physicalDevice, _vrd.pipelineCache, PIPELINE_CACHE_FILE);
+
     // destroy sync objects
-    vkDestroyFence(_vrd.device, _renderFinishedFence, nullptr);
+    for (auto& fence : _inFlightFences)
+        vkDestroyFence(_vrd.device, fence, nullptr);
     for (auto& semaphore : _imageAvailSpres)
         vkDestroySemaphore(_vrd.device, semaphore, nullptr);
     for (auto& semaphore : _renderFinishedSpres)
         vkDestroySemaphore(_vrd.device, semaphore, nullptr);
 
-    for (auto fb : _frameBuffers)
-        vkDestroyFramebuffer(_vrd.device, fb, nullptr);
     vkDestroyRenderPass(_vrd.device, _renderPass, nullptr);
+    vkDestroyRenderPass(_vrd.device, _earlyRenderPass, nullptr);
+    vkDestroyRenderPass(_vrd.device, _loadRenderPass, nullptr);
 
     // clear render layer vector to trigger destructors (they should not be referenced elswhere)
     _renderLayers.clear();
     _imGuiLayer = nullptr;
+    _uploadArena.destroy(&_vrd);
+    _uploadService.destroy();
 
     vkFreeCommandBuffers(_vrd.device, _vrd.commandPool, _vrd.commandBuffers.size(), _vrd.commandBuffers.data());
     vkDestroyCommandPool(_vrd.device, _vrd.commandPool, nullptr);
-    for (auto view : _swapchainImageViews) {
-        vkDestroyImageView(_vrd.device, view, nullptr);
-    }
-
-    // free depth buffer
-    vkDestroyImageView(_vrd.device, _depthBuffer.imageView, nullptr);
-    vkDestroyImage(_vrd.device, _depthBuffer.image, nullptr);
-    vkFreeMemory(_vrd.device, _depthBuffer.deviceMemory, nullptr);
 
-    // free color buffer
-    vkDestroyImageView(_vrd.device, _colorBuffer.imageView, nullptr);
-    vkDestroyImage(_vrd.device, _colorBuffer.image, nullptr);
-    vkFreeMemory(_vrd.device, _colorBuffer.deviceMemory, nullptr);
+    // free the framebuffers, the attachments and the swapchain image views
+    destroySwapchainResources();
 
     vkDestroySwapchainKHR(_vrd.device, _swapchain, nullptr);
     vkDestroySurfaceKHR(_vrd.instance, _surface, nullptr);
+    _allocator.destroy();
+    _shaderLibrary.destroy();
+    vkDestroyPipelineCache(_vrd.device, _vrd.pipelineCache, nullptr);
     vkDestroyDevice(_vrd.device, nullptr);
 #ifdef VELCRO_DEBUG
     Factory::freeDebugCallbacks(_vrd.instance, _messenger, _reportCallback);
@@ -67,6 +68,13 @@ Renderer::~Renderer() {
 
 bool Renderer::init() {
     OPTICK_EVENT();
+    // startup timing breakdown, logged at the end
+    using Clock = std::chrono::steady_clock;
+    auto getElapsedMs = [](Clock::time_point start){
+        return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+    };
+    auto initStart = Clock::now();
+
     // create the context
     createInstance();
 
@@ -76,6 +84,8 @@ bool Renderer::init() {
     features.samplerAnisotropy = VK_TRUE;
     features.multiDrawIndirect = VK_TRUE;
     features.drawIndirectFirstInstance = VK_TRUE;
+    features.pipelineStatisticsQuery = VK_TRUE; // vertex cache statistics of the multi mesh layer
+    features.shaderStorageImageArrayDynamicIndexing = VK_TRUE; // depth pyramid levels
     //features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
 
     // pick a physical device (gpu)
@@ -85,7 +95,18 @@ bool Renderer::init() {
     // create a logical device (interface to gpu)
     utils::printQueueFamiliesInfo(_vrd.physicalDevice);
     _vrd.graphicsQueueFamilyIndex = utils::getQueueFamilyIndex(_vrd.physicalDevice, VK_QUEUE_GRAPHICS_BIT);
-    _vrd.device = Factory::createDevice(_vrd.physicalDevice, _vrd.graphicsQueueFamilyIndex, features);
+    _vrd.transferQueueFamilyIndex = utils::getTransferQueueFamilyIndex(_vrd.physicalDevice);
+    _vrd.device = Factory::createDevice(_vrd.physicalDevice, _vrd.graphicsQueueFamilyIndex, _vrd.transferQueueFamilyIndex, features);
+    _vrd.pipelineCache = Factory::createPipelineCache(_vrd.device, _vrd.physicalDevice, PIPELINE_CACHE_FILE);
+    _shaderLibrary.init(_vrd.device);
+    _vrd.shaderLibrary = &_shaderLibrary;
+    _pipelineBuilder.init(&_vrd);
+    _vrd.pipelineBuilder = &_pipelineBuilder;
+    float deviceMs = getElapsedMs(initStart);
+
+    // every buffer and image is sub-allocated from the allocator's memory blocks
+    _allocator.init(_vrd.device, _vrd.physicalDevice);
+    _vrd.allocator = &_allocator;
 
     // create surface
     VK_CHECK(glfwCreateWindowSurface(_vrd.instance, Application::getApp()->getWindow(), nullptr, &_surface));
@@ -95,53 +116,35 @@ bool Renderer::init() {
     VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(_vrd.physicalDevice, _vrd.graphicsQueueFamilyIndex, _surface, &presentationSupport));
     VK_ASSERT(presentationSupport == VK_TRUE, "Graphics queue does not support presentation");
 
-    // retreive queue handle
+    // retreive queue handles. The transfer queue is the graphics queue if the families are the same
     vkGetDeviceQueue(_vrd.device, _vrd.graphicsQueueFamilyIndex, 0, &_vrd.graphicsQueue);
+    vkGetDeviceQueue(_vrd.device, _vrd.transferQueueFamilyIndex, 0, &_vrd.transferQueue);
+    SPDLOG_INFO("Uploads use queue family {}", _vrd.transferQueueFamilyIndex);
+
+    // uploads to device local memory are batched and submitted on the transfer queue
+    _uploadService.init(&_vrd);
+    _vrd.uploadService = &_uploadService;
 
     // get the max sample count. Note : we could decrease this number for better performance
     _vrd.sampleCount = utils::getMaximumSampleCount(_vrd.physicalDevice);
 
     // pick a format and a present mode for the surface
-    VkSurfaceFormatKHR surfaceFormat = utils::pickSurfaceFormat(_vrd.physicalDevice, _surface);
-
-    // create the swapchain
-    createSwapchain(surfaceFormat);
-    VK_ASSERT(_swapchain != nullptr, "Failed to create swapchain");
-
-    // retreive images from the swapchain after making sure the count is correct. Note : images are freed automatically when the SP is destroyed
-    uint32_t count;
-    VK_CHECK(vkGetSwapchainImagesKHR(_vrd.device, _swapchain, &count, nullptr));
-    VK_ASSERT(count == FB_COUNT, "images count in swapchain does not match FB count");
-    VK_CHECK(vkGetSwapchainImagesKHR(_vrd.device, _swapchain, &count, _swapchainImages.data()));
-
-    // create image views from the fetched images
-    VkImageAspectFlags flags = VK_IMAGE_ASPECT_COLOR_BIT;
-    for (int i = 0; i < FB_COUNT; ++i) {
-        _swapchainImageViews[i] = Factory::createImageView(_vrd.device, _swapchainImages[i], surfaceFormat.format, flags);
-    }
-
-    // create color buffer attachment
-    _colorBuffer.format = surfaceFormat.format;
-    std::tie(_colorBuffer.image, _colorBuffer.deviceMemory)
-            = Factory::createImage(&_vrd, _vrd.sampleCount, _swapchainExtent.width, _swapchainExtent.height, _colorBuffer.format,
-                               VK_IMAGE_TILING_OPTIMAL,
-                               VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    _colorBuffer.imageView = Factory::createImageView(_vrd.device, _colorBuffer.image, _colorBuffer.format, VK_IMAGE_ASPECT_COLOR_BIT);
+    auto swapchainStart = Clock::now();
+    _surfaceFormat = utils::pickSurfaceFormat(_vrd.physicalDevice, _surface);
 
     // find format for depth buffer
     _depthBuffer.format = utils::findSupportedFormat(_vrd.physicalDevice,
                  // Note : UNORM is a float in the range [0, 1], perfect for depth buffer
                  {VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT},
                                                      VK_IMAGE_TILING_OPTIMAL,
-                                                     VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+                                                     VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
     VK_ASSERT(utils::hasStencilComponent(_depthBuffer.format), "Stencil not supported");
+    _colorBuffer.format = _surfaceFormat.format;
 
-    // create depth buffer attachment
-    std::tie(_depthBuffer.image, _depthBuffer.deviceMemory) = Factory::createImage(&_vrd, _vrd.sampleCount, _swapchainExtent.width,
-               _swapchainExtent.height,_depthBuffer.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    _depthBuffer.imageView = Factory::createImageView(_vrd.device, _depthBuffer.image, _depthBuffer.format, VK_IMAGE_ASPECT_DEPTH_BIT);
+    // create the swapchain, its image views and the color and depth attachments
+    createSwapchain(_surfaceFormat, nullptr);
+    VK_ASSERT(_swapchain != nullptr, "Failed to create swapchain");
+    createSwapchainResources();
 
     // create command pool
     VkCommandPoolCreateInfo commandPoolCreateInfo = {
@@ -162,8 +165,18 @@ bool Renderer::init() {
     };
     VK_CHECK(vkAllocateCommandBuffers(_vrd.device, &allocateInfo, _vrd.commandBuffers.data()));
 
-    // create the main render pass
-    createRenderPass(surfaceFormat.format);
+    // create the main render pass. Occlusion culling splits it in an early pass followed by the main pass
+    _renderPass = createRenderPass(_surfaceFormat.format, false, false);
+    _earlyRenderPass = createRenderPass(_surfaceFormat.format, false, true);
+    _loadRenderPass = createRenderPass(_surfaceFormat.format, true, false);
+
+    // create the upload arena before the layers, they sub-allocate their per frame data from it
+    _uploadArena.init(&_vrd, UPLOAD_ARENA_FRAME_SIZE);
+    float swapchainMs = getElapsedMs(swapchainStart);
+
+    // the layers queue their pipelines, built on the workers while the next layers are created
+    auto layersStart = Clock::now();
+    float pipelinesStartMs = Factory::getPipelineCreationTime() * 1000.f;
 
     // push all layers
     _renderLayers.push_back(std::make_shared<ModelLayer>(_renderPass));
@@ -182,30 +195,29 @@ bool Renderer::init() {
     // finish with imgui layer (overlay)
     _imGuiLayer = std::make_shared<ImGuiLayer>(_renderPass);
     _renderLayers.push_back(_imGuiLayer);
+    uint32_t queuedPipelines = _pipelineBuilder.getPendingCount();
+    auto pipelinesWaitStart = Clock::now();
+    _pipelineBuilder.wait();
+    float pipelinesWaitMs = getElapsedMs(pipelinesWaitStart);
+    float layersMs = getElapsedMs(layersStart);
+    // summed over the threads, can exceed the time spent in the layers
+    float pipelinesMs = Factory::getPipelineCreationTime() * 1000.f - pipelinesStartMs;
 
     // create framebuffers
-    for (int i = 0; i < FB_COUNT; ++i) {
-        std::array<VkImageView, 3> attachments = {_colorBuffer.imageView, _depthBuffer.imageView, _swapchainImageViews[i]};
-        VkFramebufferCreateInfo framebufferCI = {
-        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-        .flags = 0u,
-        .renderPass = _renderPass,
-        .attachmentCount = attachments.size(),
-        .pAttachments = attachments.data(),
-        .width = _swapchainExtent.width,
-        .height = _swapchainExtent.height,
-        .layers = 1,
-        };
-        VK_CHECK(vkCreateFramebuffer(_vrd.device, &framebufferCI, nullptr, &_frameBuffers[i]));
-    }
+    createFramebuffers();
 
     // create sync objects
-    _renderFinishedFence = Factory::createFence(_vrd.device, true); // starts signaled
+    for (auto& fence : _inFlightFences)
+        fence = Factory::createFence(_vrd.device, true); // starts signaled
     for (auto& semaphore : _imageAvailSpres)
         semaphore = Factory::createSemaphore(_vrd.device);
     for (auto& semaphore : _renderFinishedSpres)
         semaphore = Factory::createSemaphore(_vrd.device);
 
+    SPDLOG_INFO("Renderer startup {:.1f} ms : instance and device {:.1f} ms, swapchain and attachments {:.1f} ms, "
+                "layers {:.1f} ms (pipelines {:.1f} ms over the threads, {} queued, {:.1f} ms waited, {} shader modules)",
+                getElapsedMs(initStart), deviceMs, swapchainMs, layersMs, pipelinesMs, queuedPipelines, pipelinesWaitMs,
+                _shaderLibrary.getModuleCount());
     return true;
 }
 
@@ -217,9 +229,22 @@ VkExtent2D Renderer::getSwapchainExtent() {
     return _swapchainExtent;
 }
 
+UploadArena* Renderer::getUploadArena() {
+    return &_uploadArena;
+}
+
+VkImageView Renderer::getDepthImageView() {
+    return _depthBuffer.imageView;
+}
+
 void Renderer::onEvent(Event& e) {
+    // the swapchain is recreated at the next frame. The resize is always propagated (camera aspect ratio)
+    bool resize = e.getType() == Event::Type::WINDOW_RESIZE;
+    if (resize)
+        _swapchainOutdated = true;
+
     // events are not propagated to camera and layers if imgui wants focus
-    if (_imguiFocus)
+    if (_imguiFocus && !resize)
         return;
 
     _camera.onEvent(e);
@@ -239,14 +264,40 @@ void Renderer::draw(float dt) {
     if (!_imguiFocus)
         _camera.update(dt);
 
-    // wait until the fence is signaled (ready to use)
-    VK_CHECK(vkWaitForFences(_vrd.device, 1, &_renderFinishedFence, VK_TRUE, UINT64_MAX));
+    // the window was resized or the last present reported the swapchain as outdated
+    if (_swapchainOutdated && !recreateSwapchain())
+        return;
 
-    // then unsignal the fence for next use
-    VK_CHECK(vkResetFences(_vrd.device, 1, &_renderFinishedFence));
+    // wait until the GPU is done with the ressources of this frame in flight (command buffer, uniform buffers, ...).
+    // The other frames in flight can still be processed by the GPU while we record this one
+    float fenceWaitTime = waitForFence(_inFlightFences[_currentFiFIndex]);
 
     uint32_t imageIndex;
-    VK_CHECK(vkAcquireNextImageKHR(_vrd.device, _swapchain, UINT64_MAX, _imageAvailSpres[_currentFiFIndex], nullptr, &imageIndex));
+    VkResult acquireResult = vkAcquireNextImageKHR(_vrd.device, _swapchain, UINT64_MAX, _imageAvailSpres[_currentFiFIndex],
+                                                   nullptr, &imageIndex);
+    if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR){
+        // no image was acquired (the semaphore is not signaled), the frame is skipped
+        recreateSwapchain();
+        return;
+    }
+    // a suboptimal image can still be presented, the swapchain is recreated at the next frame
+    if (acquireResult == VK_SUBOPTIMAL_KHR)
+        _swapchainOutdated = true;
+    else {
+        VK_CHECK(acquireResult);
+    }
+
+    // the acquired image can still be in use by another frame in flight if images are returned out of order
+    if (_imagesInFlight[imageIndex] != nullptr && _imagesInFlight[imageIndex] != _inFlightFences[_currentFiFIndex])
+        fenceWaitTime += waitForFence(_imagesInFlight[imageIndex]);
+    _imagesInFlight[imageIndex] = _inFlightFences[_currentFiFIndex];
+    _fpsCounter.addFenceWaitTime(fenceWaitTime);
+
+    // unsignal the fence for next use. Only done once we know we will submit work that signals it
+    VK_CHECK(vkResetFences(_vrd.device, 1, &_inFlightFences[_currentFiFIndex]));
+
+    // the GPU is done with this frame in flight, its upload region can be reused
+    _uploadArena.beginFrame(_currentFiFIndex);
 
     // update render layers with delta time
     glm::mat4 pv = *_camera.getPVMatrix();
@@ -262,13 +313,29 @@ void Renderer::draw(float dt) {
     // record command buffer at image index No need to reset the command buffer, beginCommandBuffer does it implicitally
     recordCommandBuffer(_currentFiFIndex, _frameBuffers[imageIndex]);
 
-    // semaphore check to occur before writing to the color attachment
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-
+    // submit the uploads recorded since the last frame. The GPU only waits on the ones this frame reads (0 is always
+    // reached), the others complete in the background. The CPU never waits
+    _uploadService.flush();
+    uint64_t uploadValue = _uploadService.takeFrameRequirement();
+
+    // image semaphore check to occur before writing to the color attachment, uploads must be done before being read
+    std::array<VkSemaphore, 2> waitSemaphores = {_imageAvailSpres[_currentFiFIndex], _uploadService.getTimelineSemaphore()};
+    std::array<uint64_t, 2> waitValues = {0, uploadValue}; // value is ignored for the binary semaphore
+    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                                          VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT };
+
+    VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = (uint32_t)waitValues.size(),
+        .pWaitSemaphoreValues = waitValues.data(),
+    };
     VkSubmitInfo submitInfo = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &_imageAvailSpres[_currentFiFIndex], // wait until signaled before starting
+        .pNext = &timelineSubmitInfo,
+        .waitSemaphoreCount = (uint32_t)waitSemaphores.size(),
+        .pWaitSemaphores = waitSemaphores.data(), // wait until signaled before starting
         .pWaitDstStageMask = waitStages,
         .commandBufferCount = 1,
         .pCommandBuffers = &_vrd.commandBuffers[_currentFiFIndex],
@@ -276,7 +343,7 @@ void Renderer::draw(float dt) {
         .pSignalSemaphores = &_renderFinishedSpres[_currentFiFIndex] // signaled when command buffer is done executing
     };
     // the fence will be signaled once all commands have completed execution
-    VK_CHECK(vkQueueSubmit(_vrd.graphicsQueue, 1, &submitInfo, _renderFinishedFence));
+    VK_CHECK(vkQueueSubmit(_vrd.graphicsQueue, 1, &submitInfo, _inFlightFences[_currentFiFIndex]));
 
     // present to the screen once done rendering
     VkPresentInfoKHR presentInfo = {
@@ -288,15 +355,34 @@ void Renderer::draw(float dt) {
         .pImageIndices = &imageIndex,
         .pResults = nullptr,
     };
-    VK_CHECK(vkQueuePresentKHR(_vrd.graphicsQueue, &presentInfo));
+    VkResult presentResult = vkQueuePresentKHR(_vrd.graphicsQueue, &presentInfo);
+    if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+        _swapchainOutdated = true;
+    else {
+        VK_CHECK(presentResult);
+    }
+
+    // move to the next frame in flight
+    _currentFiFIndex = (_currentFiFIndex + 1) % _framesInFlight;
 
-    // alternate index of the frame in flight currently being rendered
-    _currentFiFIndex = !_currentFiFIndex;
+    // changing the latency depth : wait for all frames to complete so the frames in flight indices restart from a known state
+    if (_requestedFramesInFlight != _framesInFlight){
+        VK_CHECK(vkDeviceWaitIdle(_vrd.device));
+        _framesInFlight = _requestedFramesInFlight;
+        _currentFiFIndex = 0;
+    }
 
     // wait for completion of all operation on graphics queue (not optimal, but good enough for now)
     //VK_CHECK(vkDeviceWaitIdle(_vrd.device));
 }
 
+float Renderer::waitForFence(VkFence fence) {
+    OPTICK_EVENT();
+    auto start = std::chrono::steady_clock::now();
+    VK_CHECK(vkWaitForFences(_vrd.device, 1, &fence, VK_TRUE, UINT64_MAX));
+    return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
 void Renderer::createInstance() {
     std::vector<const char*> extensions;
     uint32_t count;
@@ -353,7 +439,7 @@ void Renderer::createInstance() {
 #endif
 }
 
-void Renderer::createSwapchain(const VkSurfaceFormatKHR& surfaceFormat){
+void Renderer::createSwapchain(const VkSurfaceFormatKHR& surfaceFormat, VkSwapchainKHR oldSwapchain){
     VkSurfaceCapabilitiesKHR capabilites;
     VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_vrd.physicalDevice, _surface, &capabilites));
 
@@ -387,13 +473,119 @@ void Renderer::createSwapchain(const VkSurfaceFormatKHR& surfaceFormat){
             .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,    // blending mode with other surfaces
             .presentMode = presentMode,
             .clipped = VK_TRUE,
-            .oldSwapchain = nullptr,
+            .oldSwapchain = oldSwapchain,                           // resources of the old swapchain can be reused
     };
     VK_CHECK(vkCreateSwapchainKHR(_vrd.device, &createInfo, nullptr, &_swapchain));
 }
 
-void Renderer::createRenderPass(VkFormat swapchainFormat){
+void Renderer::createSwapchainResources() {
+    // retreive images from the swapchain after making sure the count is correct. Note : images are freed automatically when the SP is destroyed
+    uint32_t count;
+    VK_CHECK(vkGetSwapchainImagesKHR(_vrd.device, _swapchain, &count, nullptr));
+    VK_ASSERT(count == FB_COUNT, "images count in swapchain does not match FB count");
+    VK_CHECK(vkGetSwapchainImagesKHR(_vrd.device, _swapchain, &count, _swapchainImages.data()));
+
+    // create image views from the fetched images
+    VkImageAspectFlags flags = VK_IMAGE_ASPECT_COLOR_BIT;
+    for (int i = 0; i < FB_COUNT; ++i) {
+        _swapchainImageViews[i] = Factory::createImageView(_vrd.device, _swapchainImages[i], _surfaceFormat.format, flags);
+    }
+
+    // create color buffer attachment
+    std::tie(_colorBuffer.image, _colorBuffer.allocation)
+            = Factory::createImage(&_vrd, _vrd.sampleCount, _swapchainExtent.width, _swapchainExtent.height, _colorBuffer.format,
+                               VK_IMAGE_TILING_OPTIMAL,
+                               VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, // not transient, stored between the early and the main pass
+                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    _colorBuffer.imageView = Factory::createImageView(_vrd.device, _colorBuffer.image, _colorBuffer.format, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    // create depth buffer attachment
+    std::tie(_depthBuffer.image, _depthBuffer.allocation) = Factory::createImage(&_vrd, _vrd.sampleCount, _swapchainExtent.width,
+               _swapchainExtent.height,_depthBuffer.format, VK_IMAGE_TILING_OPTIMAL,
+               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, // sampled to build the depth pyramid
+                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    _depthBuffer.imageView = Factory::createImageView(_vrd.device, _depthBuffer.image, _depthBuffer.format, VK_IMAGE_ASPECT_DEPTH_BIT);
+}
+
+void Renderer::createFramebuffers() {
+    // the early and load passes are compatible with the main pass, they share the framebuffers
+    for (int i = 0; i < FB_COUNT; ++i) {
+        std::array<VkImageView, 3> attachments = {_colorBuffer.imageView, _depthBuffer.imageView, _swapchainImageViews[i]};
+        VkFramebufferCreateInfo framebufferCI = {
+        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        .flags = 0u,
+        .renderPass = _renderPass,
+        .attachmentCount = attachments.size(),
+        .pAttachments = attachments.data(),
+        .width = _swapchainExtent.width,
+        .height = _swapchainExtent.height,
+        .layers = 1,
+        };
+        VK_CHECK(vkCreateFramebuffer(_vrd.device, &framebufferCI, nullptr, &_frameBuffers[i]));
+    }
+}
+
+void Renderer::destroySwapchainResources() {
+    for (auto& fb : _frameBuffers){
+        vkDestroyFramebuffer(_vrd.device, fb, nullptr);
+        fb = nullptr;
+    }
+    for (auto& view : _swapchainImageViews) {
+        vkDestroyImageView(_vrd.device, view, nullptr);
+        view = nullptr;
+    }
+
+    // free depth buffer
+    vkDestroyImageView(_vrd.device, _depthBuffer.imageView, nullptr);
+    Factory::destroyImage(&_vrd, _depthBuffer.image, _depthBuffer.allocation);
+
+    // free color buffer
+    vkDestroyImageView(_vrd.device, _colorBuffer.imageView, nullptr);
+    Factory::destroyImage(&_vrd, _colorBuffer.image, _colorBuffer.allocation);
+}
+
+bool Renderer::recreateSwapchain() {
+    OPTICK_EVENT();
+    // a minimized window has no extent, wait until it is restored (or closed)
+    int width = 0, height = 0;
+    GLFWwindow* window = Application::getApp()->getWindow();
+    glfwGetFramebufferSize(window, &width, &height);
+    while (width == 0 || height == 0){
+        if (glfwWindowShouldClose(window))
+            return false;
+        glfwWaitEvents();
+        glfwGetFramebufferSize(window, &width, &height);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    VK_CHECK(vkDeviceWaitIdle(_vrd.device));
+    _swapchainOutdated = false;
+
+    // only the swapchain and the attachments are recreated, the render passes and the pipelines are kept
+    destroySwapchainResources();
+    VkSwapchainKHR oldSwapchain = _swapchain;
+    createSwapchain(_surfaceFormat, oldSwapchain);
+    vkDestroySwapchainKHR(_vrd.device, oldSwapchain, nullptr);
+    createSwapchainResources();
+    createFramebuffers();
+
+    // the GPU is idle, no image is used by a frame in flight
+    _imagesInFlight = {nullptr};
+
+    // the layers recreate their resources sized from the attachments
+    RenderLayer::setSwapchainResources(_swapchainExtent, _depthBuffer.imageView);
+    for (auto layer : _renderLayers)
+        layer->onSwapchainRecreated();
+
+    SPDLOG_INFO("Swapchain recreated ({}x{}) in {:.1f} ms", _swapchainExtent.width, _swapchainExtent.height,
+                std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return true;
+}
+
+VkRenderPass Renderer::createRenderPass(VkFormat swapchainFormat, bool loadAttachments, bool storeAttachments){
     std::array<VkAttachmentDescription, 3> attachments{};
+    VkAttachmentLoadOp loadOp = loadAttachments ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    VkAttachmentStoreOp storeOp = storeAttachments ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
     // attachment associated with _colorBuffer. It is a multisampled buffer that we first render too.
     // We will then resolove this buffer to a single sampled buffer (in swapchain) to present to screen
@@ -401,12 +593,14 @@ void Renderer::createRenderPass(VkFormat swapchainFormat){
       .flags = 0u,
       .format = swapchainFormat,
       .samples = _vrd.sampleCount,
-      .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR, // operation on color and depth at beginning of subpass : clear color buffer
+      .loadOp = loadOp, // operation on color and depth at beginning of subpass : clear color buffer (unless loaded)
       //  operation after subpass. We don't care since the image to be presented will be in the singled sampled swapchain buffer
-      .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      //  (unless stored for the main pass)
+      .storeOp = storeOp,
       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,   // no stencil component in this attachment
       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,  //no stencil component in this attachment
-      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED, // layout of the image subressource when subpass begin. We don't care ; we clear it anyway
+      // layout of the image subressource when subpass begin. We don't care ; we clear it anyway (unless loaded)
+      .initialLayout = loadAttachments ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
       // multisampled images cannot be presented directly. They are first resolved to an image then presented
       .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, // FIXME : This could probably be undefined as well since we don't use the attachment after rendering
     };
@@ -421,12 +615,13 @@ void Renderer::createRenderPass(VkFormat swapchainFormat){
         .flags = 0u,
         .format = _depthBuffer.format,
         .samples = _vrd.sampleCount,
-        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,      // clear depth component of at beginning of subpass
-        .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR, // clear stencil component at the beginning of subpass
-        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL // layout to be transitioned automatically when render pass instance ends
+        .loadOp = loadOp,          // clear depth component of at beginning of subpass
+        .storeOp = storeOp,        // stored depth is used to build the depth pyramid
+        .stencilLoadOp = loadOp,   // clear stencil component at the beginning of subpass
+        .stencilStoreOp = storeOp,
+        .initialLayout = loadAttachments ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+        // layout to be transitioned automatically when render pass instance ends. Stored depth is sampled by compute shaders
+        .finalLayout = storeAttachments ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
     };
 
     VkAttachmentReference depthRef = {
@@ -444,7 +639,8 @@ void Renderer::createRenderPass(VkFormat swapchainFormat){
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED, // layout of attachment at beggining of subpass
-        .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, // image ready for swapchain usage
+        // image ready for swapchain usage. Only presented after the main pass
+        .finalLayout = storeAttachments ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
     };
 
     // resolving from multi sample -> single sample in order to be presented
@@ -472,12 +668,35 @@ void Renderer::createRenderPass(VkFormat swapchainFormat){
             .dstSubpass = 0,
             .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
             .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            .srcAccessMask = 0,
+            .srcAccessMask = loadAttachments ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0u, // color written by the early pass
             .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
             .dependencyFlags = 0
+        },
+        // depth written by the early pass or read by the depth pyramid must be done before writing depth
+        /* VkSubpassDependency */ {
+            .srcSubpass = VK_SUBPASS_EXTERNAL,
+            .dstSubpass = 0,
+            .srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dependencyFlags = 0
         }
     };
 
+    // the stored depth is sampled by compute shaders after the early pass
+    if (storeAttachments){
+        dependencies.push_back({
+            .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+            .dependencyFlags = 0
+        });
+    }
+
     // create our render pass with one attachment and one subpass
     VkRenderPassCreateInfo renderPassCI = {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
@@ -490,7 +709,9 @@ void Renderer::createRenderPass(VkFormat swapchainFormat){
         .pDependencies = dependencies.data()
     };
 
-    VK_CHECK(vkCreateRenderPass(_vrd.device, &renderPassCI, nullptr, &_renderPass));
+    VkRenderPass renderPass = nullptr;
+    VK_CHECK(vkCreateRenderPass(_vrd.device, &renderPassCI, nullptr, &renderPass));
+    return renderPass;
 }
 
 void Renderer::recordCommandBuffer(uint32_t commandBufferIndex, VkFramebuffer framebuffer){
@@ -505,6 +726,10 @@ void Renderer::recordCommandBuffer(uint32_t commandBufferIndex, VkFramebuffer fr
     // begin command buffer implicitally resets the commands buffer : https://www.khronos.org/registry/vulkan/specs/1.3-extensions/man/html/VkCommandPoolCreateFlagBits.html
     VK_CHECK(vkBeginCommandBuffer(_vrd.commandBuffers[commandBufferIndex], &commandBufferCI));
 
+    // record the work of the layers that can't be done in a render pass (ex: culling)
+    for (auto layer : _renderLayers)
+        layer->fillComputeCommandBuffer(_vrd.commandBuffers[commandBufferIndex], commandBufferIndex);
+
     // being render pass
     VkRect2D renderArea = {
         .offset = {
@@ -531,7 +756,23 @@ void Renderer::recordCommandBuffer(uint32_t commandBufferIndex, VkFramebuffer fr
         .clearValueCount = sizeof(clearValues)/sizeof(VkClearValue),
         .pClearValues = clearValues,
     };
+    // the early pass is only recorded if a layer draws in it (occlusion culling)
+    bool earlyPass = std::any_of(_renderLayers.begin(), _renderLayers.end(), [](auto& layer){ return layer->usesEarlyPass(); });
+    if (earlyPass){
+        beginCI.renderPass = _earlyRenderPass;
+        vkCmdBeginRenderPass(_vrd.commandBuffers[commandBufferIndex], &beginCI, VK_SUBPASS_CONTENTS_INLINE);
+        setViewportAndScissor(_vrd.commandBuffers[commandBufferIndex]);
+        for (auto layer : _renderLayers)
+            layer->fillEarlyCommandBuffer(_vrd.commandBuffers[commandBufferIndex], commandBufferIndex);
+        vkCmdEndRenderPass(_vrd.commandBuffers[commandBufferIndex]);
+
+        // work depending on the early pass (ex: depth pyramid). The main pass then loads the attachments
+        for (auto layer : _renderLayers)
+            layer->fillLateComputeCommandBuffer(_vrd.commandBuffers[commandBufferIndex], commandBufferIndex);
+        beginCI.renderPass = _loadRenderPass;
+    }
     vkCmdBeginRenderPass(_vrd.commandBuffers[commandBufferIndex], &beginCI, VK_SUBPASS_CONTENTS_INLINE);
+    setViewportAndScissor(_vrd.commandBuffers[commandBufferIndex]);
 
     // record render commands from all the layers
     for (auto layer : _renderLayers)
@@ -544,6 +785,24 @@ void Renderer::recordCommandBuffer(uint32_t commandBufferIndex, VkFramebuffer fr
     VK_CHECK(vkEndCommandBuffer(_vrd.commandBuffers[commandBufferIndex]));
 }
 
+void Renderer::setViewportAndScissor(VkCommandBuffer commandBuffer) {
+    // every pipeline uses a dynamic viewport and scissor, covering the whole swapchain
+    VkViewport viewport = {
+            .x = 0.f,
+            .y = 0.f,
+            .width = (float)_swapchainExtent.width,
+            .height = (float)_swapchainExtent.height,
+            .minDepth = 0.f,
+            .maxDepth = 1.f,
+    };
+    VkRect2D scissor = {
+            .offset = {0, 0},
+            .extent = _swapchainExtent
+    };
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
 void Renderer::onImGuiRender() {
     // check if imgui wants capture (used to block event propagation)
     ImGuiIO& io = ImGui::GetIO();
@@ -552,6 +811,17 @@ void Renderer::onImGuiRender() {
     ImGui::Begin("Hello from Renderer");
     ImGui::Text("FPS (last 0.5s) %.2f", _fpsCounter.getFPS());
     ImGui::Text("Average FPS     %.2f", _fpsCounter.getAverageFPS());
+    ImGui::Text("CPU fence wait  %.3f ms", _fpsCounter.getFenceWaitTime() * 1000.f);
+    ImGui::Text("CPU/GPU overlap %.1f %%", _fpsCounter.getOverlap() * 100.f);
+    ImGui::SliderInt("Frames in flight", &_requestedFramesInFlight, 1, MAX_FRAMES_IN_FLIGHT);
+
+    // device memory usage
+    MemoryAllocator::Stats stats = _allocator.getStats();
+    constexpr float MB = 1024.f * 1024.f;
+    ImGui::Text("Memory blocks   %u (+%u dedicated)", stats.blockCount, stats.dedicatedCount);
+    ImGui::Text("Allocations     %u", stats.allocationCount);
+    ImGui::Text("Memory used     %.1f / %.1f MB", stats.usedBytes / MB, stats.allocatedBytes / MB);
+    ImGui::Text("Fragmentation   %.1f %%", stats.fragmentation * 100.f);
     if (ImGui::Button("Reset Camera"))
         _camera.reset();
     ImGui::End();
@@ -5,9 +5,14 @@
 #pragma once
 
 #include "VulkanRenderDevice.hpp"
+#include "MemoryAllocator.h"
+#include "UploadService.h"
+#include "ShaderLibrary.h"
+#include "PipelineBuilder.h"
 #include "Objects/UniformBuffer.h"
 #include "Objects/ShaderStorageBuffer.h"
 #include "Objects/Texture.h"
+#include "Objects/UploadArena.h"
 #include "Layers/RenderLayer.h"
 #include "Layers/ImGuiLayer.h"
 #include "../events/Event.h"
@@ -25,6 +30,8 @@ public:
 
     VulkanRenderDevice* getRenderDevice();
     VkExtent2D getSwapchainExtent();
+    UploadArena* getUploadArena();
+    VkImageView getDepthImageView();
 
     void draw(float dt);
     void onEvent(Event& e);
@@ -34,11 +41,26 @@ private:
 
     // creation
     void createInstance();
-    void createSwapchain(const VkSurfaceFormatKHR& surfaceFormat);
-    void createRenderPass(VkFormat swapchainFormat);
+    void createSwapchain(const VkSurfaceFormatKHR& surfaceFormat, VkSwapchainKHR oldSwapchain);
+    /// creates the swapchain image views and the color and depth attachments, sized from the swapchain extent
+    void createSwapchainResources();
+    void createFramebuffers();
+    /// destroys the framebuffers, the attachments and the swapchain image views. The GPU must be idle
+    void destroySwapchainResources();
+    /// recreates the swapchain and the resources depending on its size (window resize), the pipelines are kept. Blocks
+    /// while the window is minimized. Returns false if the window was closed meanwhile
+    bool recreateSwapchain();
+    /// creates a render pass using the color, depth and swapchain attachments. Loaded attachments start with the
+    /// content stored by the previous pass (early pass), stored attachments are kept for the next pass
+    VkRenderPass createRenderPass(VkFormat swapchainFormat, bool loadAttachments, bool storeAttachments);
+
+    // sync
+    float waitForFence(VkFence fence);
 
     // 
     void recordCommandBuffer(uint32_t commandBufferIndex, VkFramebuffer framebuffer);
+    /// sets the dynamic viewport and scissor of the pipelines to the swapchain extent
+    void setViewportAndScissor(VkCommandBuffer commandBuffer);
 
     void onImGuiRender();
 
@@ -52,9 +74,13 @@ private:
     std::array<VkImage, FB_COUNT> _swapchainImages = {nullptr};
     std::array<VkImageView, FB_COUNT> _swapchainImageViews = {nullptr};
     VkExtent2D _swapchainExtent = {0, 0};
+    VkSurfaceFormatKHR _surfaceFormat{};
+    bool _swapchainOutdated = false; ///< set on resize or when the swapchain no longer matches the surface, recreated at the next frame
 
     // other
     VkRenderPass _renderPass = nullptr;
+    VkRenderPass _earlyRenderPass = nullptr;    ///< clears and stores the attachments, only used if a layer draws in the early pass
+    VkRenderPass _loadRenderPass = nullptr;     ///< main pass following the early pass, loads its attachments
     VkSurfaceKHR _surface = nullptr;
     std::array<VkFramebuffer, FB_COUNT> _frameBuffers = {nullptr};
 
@@ -62,21 +88,43 @@ private:
     glm::vec4 _clearValue = { 0.3f, 0.5f, 0.5f, 1.f };
 
     // sync
-    VkFence _renderFinishedFence = nullptr; ///< signaled when the GPU is done rendering a frame
+    std::array<VkFence, MAX_FRAMES_IN_FLIGHT> _inFlightFences = {nullptr}; ///< signaled when the GPU is done rendering the frame in flight at index
+    std::array<VkFence, FB_COUNT> _imagesInFlight = {nullptr};             ///< fence of the frame in flight currently using the swapchain image at index
     std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> _imageAvailSpres = {nullptr};
     std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> _renderFinishedSpres = {nullptr};
-    bool _currentFiFIndex = true; ///< Index of the current frame in flight being recorded on CPU
+    uint32_t _currentFiFIndex = 0; ///< Index of the current frame in flight being recorded on CPU
+    uint32_t _framesInFlight = MAX_FRAMES_IN_FLIGHT; ///< latency depth, number of frames the CPU can record ahead of the GPU. In [1, MAX_FRAMES_IN_FLIGHT]
+    int _requestedFramesInFlight = MAX_FRAMES_IN_FLIGHT; ///< latency depth set from imgui, applied at the end of the frame
 
     /// AttachmentBuffer, used by multisampled color buffer and depth/stencil buffer
     struct AttachmentBuffer{
         VkImage image = nullptr;
         VkImageView imageView = nullptr;
-        VkDeviceMemory deviceMemory = nullptr;
+        MemoryAllocation allocation{};
         VkFormat format;
     };
     AttachmentBuffer _depthBuffer;
     AttachmentBuffer _colorBuffer;
 
+    // sub-allocates device memory for every buffer and image
+    MemoryAllocator _allocator{};
+
+    // batched uploads to device local buffers and images
+    UploadService _uploadService{};
+
+    // shader modules, created once and shared by the pipelines
+    ShaderLibrary _shaderLibrary{};
+
+    // the layers queue their pipelines, built concurrently on the worker threads
+    PipelineBuilder _pipelineBuilder{};
+
+    // the pipelines are created with a device wide cache, saved on shutdown and loaded by the next runs
+    static constexpr const char* PIPELINE_CACHE_FILE = "pipelines.vcache";
+
+    // per frame upload memory shared by the layers
+    static constexpr uint32_t UPLOAD_ARENA_FRAME_SIZE = 4 * 1024 * 1024;
+    UploadArena _uploadArena{};
+
     // Render layers
     std::vector<std::shared_ptr<RenderLayer>> _renderLayers;
     std::shared_ptr<ImGuiLayer> _imGuiLayer = nullptr;
@@ -0,0 +1,89 @@
+#include "ShaderLibrary.h"
+
+#include "Factory/FactoryVulkan.h"
+#include "../Utils/UtilsVulkan.h"
+#include "../Utils/UtilsFile.h"
+
+#ifdef VELCRO_EMBED_SHADERS
+// generated at build time from the SPIR-V directory, see core/Assets/Shaders/EmbedShaders.cmake
+#include <EmbeddedShaders.h>
+#endif
+
+#include <filesystem>
+#include <cstring>
+#include <algorithm>
+
+#ifndef VELCRO_SHADER_DIR
+#define VELCRO_SHADER_DIR R"(..\..\..\core\Assets\Shaders\SPIR-V)"
+#endif
+
+
+void ShaderLibrary::init(VkDevice device) {
+    _device = device;
+}
+
+void ShaderLibrary::destroy() {
+    std::scoped_lock lock(_mutex);
+    for (auto& [hash, shared] : _modulesByHash)
+        vkDestroyShaderModule(_device, shared.module, nullptr);
+    _modulesByHash.clear();
+    _modulesByName.clear();
+}
+
+VkShaderModule ShaderLibrary::getModule(const std::string& filename) {
+    std::scoped_lock lock(_mutex);
+    if (auto it = _modulesByName.find(filename); it != _modulesByName.end())
+        return it->second;
+
+    // files with the same code (e.g. a shader compiled under two names) share the module
+    std::vector<uint32_t> code = loadCode(filename);
+    uint64_t hash = hashCode(code);
+    auto [first, last] = _modulesByHash.equal_range(hash);
+    auto it = std::find_if(first, last, [&code](const auto& entry){ return entry.second.code == code; });
+    if (it == last){
+        VkShaderModule module = Factory::createShaderModule(_device, code.data(), code.size() * sizeof(uint32_t));
+        it = _modulesByHash.emplace(hash, SharedModule{.code = std::move(code), .module = module});
+    }
+
+    _modulesByName[filename] = it->second.module;
+    return it->second.module;
+}
+
+uint32_t ShaderLibrary::getModuleCount() {
+    std::scoped_lock lock(_mutex);
+    return (uint32_t)_modulesByHash.size();
+}
+
+std::vector<uint32_t> ShaderLibrary::loadCode(const std::string& filename) {
+    std::vector<uint32_t> code;
+#ifdef VELCRO_EMBED_SHADERS
+    for (const embedded_shaders::EmbeddedShader& shader : embedded_shaders::SHADERS){
+        if (shader.name != filename)
+            continue;
+        code.resize(shader.size / sizeof(uint32_t));
+        memcpy(code.data(), shader.code, code.size() * sizeof(uint32_t));
+        return code;
+    }
+    throw std::runtime_error("Shader " + filename + " is not embedded");
+#else
+    std::filesystem::path path(VELCRO_SHADER_DIR);
+    path /= filename;
+    VK_ASSERT(utils::fileExists(path), "Shader file does not exist");
+
+    // SPIR-V is a stream of 32 bits words
+    std::vector<char> content = utils::getFileContent(path.string());
+    VK_ASSERT(content.size() % sizeof(uint32_t) == 0, "Invalid SPIR-V size");
+    code.resize(content.size() / sizeof(uint32_t));
+    memcpy(code.data(), content.data(), content.size());
+#endif
+    return code;
+}
+
+uint64_t ShaderLibrary::hashCode(const std::vector<uint32_t>& code) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t word : code){
+        hash ^= word;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
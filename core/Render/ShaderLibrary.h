@@ -0,0 +1,44 @@
+#pragma once
+
+#include "VulkanRenderDevice.hpp"
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+/// Owns the shader modules of the device. A module is created on the first request of its SPIR-V file and kept until
+/// shutdown, so the pipelines using the same shader (and the rebuilt pipelines) share it. Files with identical code
+/// share one module. With VELCRO_EMBED_SHADERS, the SPIR-V is read from the binary instead of the shader directory.
+/// NOTE : can be called from any thread
+class ShaderLibrary {
+public:
+    ShaderLibrary() = default;
+
+    void init(VkDevice device);
+    void destroy();
+
+    /// returns the module of the SPIR-V file (e.g. "multiV.spv"), created if needed. The module must not be destroyed
+    VkShaderModule getModule(const std::string& filename);
+
+    uint32_t getModuleCount();
+
+private:
+    /// reads the SPIR-V words of the file, from the embedded shaders or from the shader directory
+    static std::vector<uint32_t> loadCode(const std::string& filename);
+
+    /// FNV-1a hash of the code, finds the modules which might have the same code
+    static uint64_t hashCode(const std::vector<uint32_t>& code);
+
+private:
+    struct SharedModule {
+        std::vector<uint32_t> code;         ///< compared before sharing the module, the hashes can collide
+        VkShaderModule module = nullptr;
+    };
+
+    VkDevice _device = nullptr;
+    std::mutex _mutex;
+    std::unordered_map<std::string, VkShaderModule> _modulesByName;
+    std::unordered_multimap<uint64_t, SharedModule> _modulesByHash;    ///< one entry per created module
+};
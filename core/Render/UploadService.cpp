@@ -0,0 +1,259 @@
+#include "UploadService.h"
+
+#include "Factory/FactoryVulkan.h"
+#include "../Utils/UtilsVulkan.h"
+
+
+void UploadService::init(VulkanRenderDevice* vrd) {
+    _vrd = vrd;
+
+    // command buffers are short lived and reset individually when their batch is done
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = vrd->transferQueueFamilyIndex
+    };
+    VK_CHECK(vkCreateCommandPool(vrd->device, &commandPoolCreateInfo, nullptr, &_commandPool));
+
+    // timeline semaphore, the value is incremented by every submitted batch
+    VkSemaphoreTypeCreateInfo typeCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0
+    };
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &typeCreateInfo,
+    };
+    VK_CHECK(vkCreateSemaphore(vrd->device, &semaphoreCreateInfo, nullptr, &_timeline));
+}
+
+void UploadService::destroy() {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // wait for the submitted batches. The recorded batch is dropped, its destinations are destroyed anyway
+    VkSemaphoreWaitInfo waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &_timeline,
+            .pValues = &_submittedValue
+    };
+    VK_CHECK(vkWaitSemaphores(_vrd->device, &waitInfo, UINT64_MAX));
+    for (auto& batch : _inFlight)
+        releaseBatch(batch);
+    _inFlight.clear();
+    releaseBatch(_recording);
+
+    if (!_freeCommandBuffers.empty())
+        vkFreeCommandBuffers(_vrd->device, _commandPool, _freeCommandBuffers.size(), _freeCommandBuffers.data());
+    _freeCommandBuffers.clear();
+    vkDestroyCommandPool(_vrd->device, _commandPool, nullptr);
+    vkDestroySemaphore(_vrd->device, _timeline, nullptr);
+
+    _commandPool = nullptr;
+    _timeline = nullptr;
+}
+
+uint64_t UploadService::uploadBuffer(VkBuffer dst, const void* data, VkDeviceSize size, VkDeviceSize dstOffset) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    VkCommandBuffer commandBuffer = getCommandBuffer();
+
+    auto [stagingBuffer, stagingOffset] = stage(data, size, 16);
+    VkBufferCopy bufferCopy = {
+            .srcOffset = stagingOffset,
+            .dstOffset = dstOffset,
+            .size = size
+    };
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, dst, 1, &bufferCopy);
+    return _recording.value;
+}
+
+uint64_t UploadService::uploadImage(VkImage dst, const void* data, VkDeviceSize size, uint32_t width, uint32_t height,
+                                    uint32_t texelSize) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    VkCommandBuffer commandBuffer = getCommandBuffer();
+
+    // the buffer offset must be a multiple of the texel size, and of 4 on a transfer only queue
+    auto [stagingBuffer, stagingOffset] = stage(data, size, 4 * texelSize);
+
+    // transition image layout UNDEFINED -> DST_OPTIMAL
+    utils::transitionImageLayout(commandBuffer, dst, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    // copy staging buffer -> image
+    VkBufferImageCopy imageRegion = {
+            .bufferOffset = stagingOffset,
+            .bufferRowLength = 0,     // would matter if data was not tightly pacted
+            .bufferImageHeight = 0,   // would matter if data was not tightly pacted
+            .imageSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = 0,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1
+            },
+            .imageOffset = {
+                    .x = 0,
+                    .y = 0,
+                    .z = 0,
+            },
+            .imageExtent = {
+                    .width = width,
+                    .height = height,
+                    .depth = 1,
+            }
+    };
+    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageRegion);
+
+    // transition from DST_OPTIMAL -> SHADER_READ_ONLY_OPTIMAL
+    utils::transitionImageLayout(commandBuffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    return _recording.value;
+}
+
+uint64_t UploadService::flush() {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // submit the recorded batch, it signals its value once done
+    if (_recording.commandBuffer != nullptr){
+        VK_CHECK(vkEndCommandBuffer(_recording.commandBuffer));
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+                .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+                .signalSemaphoreValueCount = 1,
+                .pSignalSemaphoreValues = &_recording.value
+        };
+        VkSubmitInfo submitInfo = {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .pNext = &timelineSubmitInfo,
+                .commandBufferCount = 1,
+                .pCommandBuffers = &_recording.commandBuffer,
+                .signalSemaphoreCount = 1,
+                .pSignalSemaphores = &_timeline
+        };
+        VK_CHECK(vkQueueSubmit(_vrd->transferQueue, 1, &submitInfo, nullptr));
+
+        _submittedValue = _recording.value;
+        _inFlight.push_back(std::move(_recording));
+        _recording = {};
+    }
+
+    // release the staging memory of the completed batches
+    uint64_t completedValue;
+    VK_CHECK(vkGetSemaphoreCounterValue(_vrd->device, _timeline, &completedValue));
+    while (!_inFlight.empty() && _inFlight.front().value <= completedValue){
+        releaseBatch(_inFlight.front());
+        _inFlight.pop_front();
+    }
+
+    return _submittedValue;
+}
+
+void UploadService::requireForFrame(uint64_t value) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // the values of the batch being recorded are waited on once it is submitted, the submitted ones right away
+    if (value > _submittedValue)
+        _pendingRequirement = std::max(_pendingRequirement, value);
+    else
+        _frameRequirement = std::max(_frameRequirement, value);
+}
+
+uint64_t UploadService::takeFrameRequirement() {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // the pending requirement might belong to a batch recorded after the flush, the frame can't be using it yet
+    if (_pendingRequirement != 0 && _pendingRequirement <= _submittedValue){
+        _frameRequirement = std::max(_frameRequirement, _pendingRequirement);
+        _pendingRequirement = 0;
+    }
+
+    uint64_t value = _frameRequirement;
+    _frameRequirement = 0;
+    return value;
+}
+
+bool UploadService::isComplete(uint64_t value) {
+    uint64_t completedValue;
+    VK_CHECK(vkGetSemaphoreCounterValue(_vrd->device, _timeline, &completedValue));
+    return completedValue >= value;
+}
+
+void UploadService::wait(uint64_t value) {
+    // the value might belong to the batch being recorded
+    if (value > _submittedValue)
+        flush();
+
+    VkSemaphoreWaitInfo waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &_timeline,
+            .pValues = &value
+    };
+    VK_CHECK(vkWaitSemaphores(_vrd->device, &waitInfo, UINT64_MAX));
+}
+
+VkSemaphore UploadService::getTimelineSemaphore() {
+    return _timeline;
+}
+
+//////////////////////// PRIVATE METHODS ///////////////////////////////////
+
+VkCommandBuffer UploadService::getCommandBuffer() {
+    if (_recording.commandBuffer != nullptr)
+        return _recording.commandBuffer;
+
+    // reuse a command buffer from a completed batch if possible
+    if (_freeCommandBuffers.empty()){
+        VkCommandBufferAllocateInfo allocateInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = _commandPool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+        };
+        _freeCommandBuffers.emplace_back();
+        VK_CHECK(vkAllocateCommandBuffers(_vrd->device, &allocateInfo, &_freeCommandBuffers.back()));
+    }
+    _recording.commandBuffer = _freeCommandBuffers.back();
+    _freeCommandBuffers.pop_back();
+    _recording.value = _submittedValue + 1;
+
+    VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VK_CHECK(vkBeginCommandBuffer(_recording.commandBuffer, &beginInfo));
+    return _recording.commandBuffer;
+}
+
+std::pair<VkBuffer, VkDeviceSize> UploadService::stage(const void* data, VkDeviceSize size, VkDeviceSize alignment) {
+    // align the cursor (alignment is not always a power of 2 with 3 bytes texels)
+    VkDeviceSize offset = (_recording.cursor + alignment - 1) / alignment * alignment;
+
+    // create a new staging buffer if the current one is full
+    if (_recording.stagingBuffers.empty() || offset + size > _recording.stagingBuffers.back().allocation.size){
+        StagingBuffer stagingBuffer;
+        std::tie(stagingBuffer.buffer, stagingBuffer.allocation) = Factory::createBuffer(_vrd, std::max(size, STAGING_BUFFER_SIZE),
+                                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        _recording.stagingBuffers.push_back(stagingBuffer);
+        offset = 0;
+    }
+
+    // copy to the staging buffer (persistently mapped)
+    StagingBuffer& stagingBuffer = _recording.stagingBuffers.back();
+    memcpy((uint8_t*)stagingBuffer.allocation.mapped + offset, data, size);
+    _recording.cursor = offset + size;
+
+    return {stagingBuffer.buffer, offset};
+}
+
+void UploadService::releaseBatch(Batch& batch) {
+    for (auto& stagingBuffer : batch.stagingBuffers)
+        Factory::destroyBuffer(_vrd, stagingBuffer.buffer, stagingBuffer.allocation);
+    batch.stagingBuffers.clear();
+    batch.cursor = 0;
+
+    if (batch.commandBuffer != nullptr){
+        VK_CHECK(vkResetCommandBuffer(batch.commandBuffer, 0));
+        _freeCommandBuffers.push_back(batch.commandBuffer);
+        batch.commandBuffer = nullptr;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "VulkanRenderDevice.hpp"
+#include "MemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include <mutex>
+
+/// Batches buffer and image uploads in a single command buffer, submitted once per frame on the transfer queue (a
+/// dedicated transfer family is used when available). Data is copied to staging memory right away, the source can be
+/// released after the call. Each batch signals a value on a timeline semaphore : a frame only waits on the values of the
+/// resources it uses (see requireForFrame), the other batches complete in the background and can be polled, so neither
+/// the graphics queue nor the main thread stalls on an unrelated upload.
+/// NOTE : like the upload arena, the destination must not be in use by a frame in flight while the upload is pending
+class UploadService {
+public:
+    UploadService() = default;
+
+    void init(VulkanRenderDevice* vrd);
+    void destroy();
+
+    /// records the copy of data in dst at dstOffset. Returns the timeline value signaled once the copy is done
+    uint64_t uploadBuffer(VkBuffer dst, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+
+    /// records the upload of a 2D color image (first mip). The image ends in the SHADER_READ_ONLY_OPTIMAL layout.
+    /// Returns the timeline value signaled once the upload is done
+    uint64_t uploadImage(VkImage dst, const void* data, VkDeviceSize size, uint32_t width, uint32_t height, uint32_t texelSize);
+
+    /// submits the recorded uploads (if any) and releases the staging memory of completed batches. Must be called from
+    /// the render thread. Returns the timeline value of the last submitted batch
+    uint64_t flush();
+
+    /// the next submitted frame uses a resource written by the uploads associated with the given value and waits on it
+    void requireForFrame(uint64_t value);
+
+    /// returns the highest submitted value required by the frame being submitted (0 if none) and resets it. Called by
+    /// the renderer after flush, the values of the batch recorded after the flush are kept for the next frames
+    uint64_t takeFrameRequirement();
+
+    /// true if the uploads associated with the given value are done. Can be called from any thread
+    bool isComplete(uint64_t value);
+
+    /// blocks until the uploads associated with the given value are done. Must be called from the render thread
+    void wait(uint64_t value);
+
+    VkSemaphore getTimelineSemaphore();
+
+private:
+    struct StagingBuffer {
+        VkBuffer buffer = nullptr;
+        MemoryAllocation allocation{};
+    };
+
+    struct Batch {
+        VkCommandBuffer commandBuffer = nullptr;    ///< null if nothing was recorded
+        std::vector<StagingBuffer> stagingBuffers;  ///< the last one is being filled
+        VkDeviceSize cursor = 0;                    ///< offset in the last staging buffer
+        uint64_t value = 0;                         ///< timeline value signaled when the batch is done
+    };
+
+    /// begins recording the current batch if needed and returns its command buffer
+    VkCommandBuffer getCommandBuffer();
+
+    /// copies data to the staging memory of the current batch. Returns the staging buffer and the offset of the data
+    std::pair<VkBuffer, VkDeviceSize> stage(const void* data, VkDeviceSize size, VkDeviceSize alignment);
+
+    void releaseBatch(Batch& batch);
+
+    static constexpr VkDeviceSize STAGING_BUFFER_SIZE = 8 * 1024 * 1024; ///< bigger uploads get their own staging buffer
+
+private:
+    VulkanRenderDevice* _vrd = nullptr;
+    VkCommandPool _commandPool = nullptr;       ///< allocates command buffers from the transfer family
+    std::vector<VkCommandBuffer> _freeCommandBuffers;
+    VkSemaphore _timeline = nullptr;
+    uint64_t _submittedValue = 0;               ///< value signaled by the last submitted batch
+    uint64_t _frameRequirement = 0;             ///< highest submitted value required by the next frame
+    uint64_t _pendingRequirement = 0;           ///< highest value of the recorded batch required, not submitted yet
+
+    Batch _recording{};                         ///< batch being recorded, submitted at the next flush
+    std::deque<Batch> _inFlight;                ///< submitted batches, ordered by value
+    std::mutex _mutex;                          ///< uploads can be recorded from loading threads
+};
@@ -3,6 +3,11 @@
 #include <vulkan/vulkan_core.h>
 #include <array>
 
+class MemoryAllocator;
+class UploadService;
+class ShaderLibrary;
+class PipelineBuilder;
+
 static constexpr uint32_t FB_COUNT = 3;         ///< triple buffering is used
 
 ///< max number of frames processed by cpu or gpu. This way the recording of a frame (cpu) does not have to wait for the gpu to finish rendering.
@@ -21,6 +26,8 @@ struct VulkanRenderDevice final{
     // queue
     uint32_t graphicsQueueFamilyIndex = 0; ///< index of the graphics family
     VkQueue graphicsQueue = nullptr;
+    uint32_t transferQueueFamilyIndex = 0; ///< index of the transfer family, dedicated if available. Same as graphics otherwise
+    VkQueue transferQueue = nullptr;
 
     // commands
     VkCommandPool commandPool = nullptr;
@@ -28,4 +35,11 @@ struct VulkanRenderDevice final{
 
     // pipeline
     VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
+    VkPipelineCache pipelineCache = nullptr; ///< used by every pipeline creation, persisted between the runs
+    ShaderLibrary* shaderLibrary = nullptr;  ///< shader modules shared by the pipelines
+    PipelineBuilder* pipelineBuilder = nullptr; ///< builds the queued pipelines concurrently
+
+    // memory
+    MemoryAllocator* allocator = nullptr; ///< all buffers and images are sub-allocated from it
+    UploadService* uploadService = nullptr; ///< batches the staging uploads to device local buffers and images
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <array>
 
 
 struct TransformComponent{
@@ -15,9 +16,11 @@ struct TransformComponent{
 };
 
 struct HierarchyComponent {
-    int level = -1;
+    int level = -1;         ///< -1 if the entity was removed
     int parent = -1;
     int firstChild = -1;
+    int lastChild = -1;     ///< children are appended in O(1)
+    int prevSibling = -1;   ///< siblings are unlinked in O(1)
     int nextSibling = -1;
 };
 
@@ -27,12 +30,27 @@ enum class RenderNode{
     COUNT
 };
 
+/// simplified version of a mesh, its indices are in the index buffer and relative to the mesh vertices as well
+struct MeshLod {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    float error = 0.f;              ///< max distance to the full detail surface, in the mesh space
+};
+
+/// levels of detail of a mesh after the full detail one, each with about half of the triangles of the previous one
+constexpr uint32_t MAX_MESH_LODS = 3;
+
 //TODO : rename to mesh node?
 struct MeshComponent {
     uint32_t firstVertexIndex = 0; ///< Index in the index buffer of the first vertex
     uint32_t indexCount = 0;       ///< Number of indices
+    uint32_t vertexOffset = 0;     ///< Index of the first vertex of the mesh, its indices are relative to it
+    uint32_t vertexCount = 0;      ///< Number of vertices of the mesh
     uint32_t meshIndex = 0;        ///< Index of the mesh in the scene
     uint32_t materialIndex = 0;    ///< Index of the material (assimp)
+    glm::vec4 boundingSphere = glm::vec4(0.f); ///< Center (xyz) and radius (w) in the mesh space, used for culling
+    std::array<MeshLod, MAX_MESH_LODS> lods{}; ///< Coarser levels of detail, from the finest
+    uint32_t lodCount = 0;
 };
 
 struct TextComponent {
@@ -5,6 +5,12 @@
 #include "Scene.h"
 
 #include "../Utils/UtilsMath.h"
+#include "../Utils/UtilsTemplate.h"
+#include "../Utils/UtilsSimd.h"
+#include "../Utils/ThreadPool.h"
+
+#include <bit>
+#include <atomic>
 
 Scene::Scene(std::string name) : _name(std::move(name)){
     HierarchyComponent root = {};
@@ -13,6 +19,8 @@ Scene::Scene(std::string name) : _name(std::move(name)){
     _hierarchies.push_back(root);
     _transforms.emplace_back();
     _entityNames.emplace_back("Root");
+    _levelIndices.push_back(0);
+    addToLevel(0, 0);
 
     SPDLOG_INFO("Vertex Size {}", sizeof(Vertex));
 }
@@ -22,49 +30,93 @@ int Scene::addSceneNode(int parent, int level, const std::string& name) {
     if (parent == -1)
         parent = 0;
 
-    // add the ubiquitous components (except hie that will be added later)
-    _transforms.emplace_back();
-    _entityNames.push_back(name);
-
-    // create new hierarchy component
-    int newEntity = _hierarchies.size();
-    HierarchyComponent newComponent = {};
-
     // only the root can have a level of 0
     if (level == 0)
         level = 1;
-    HierarchyComponent& pc = _hierarchies[parent];
+    int parentLevel = _hierarchies[parent].level;
+    VK_ASSERT(parentLevel != -1, "Parent was removed");
 
     // sanity checks, should never happen
-    if (pc.level + 1 != level){
+    if (parentLevel + 1 != level){
         SPDLOG_INFO("Specified level is not valid with parent's level. Correcting it\n");
-        level = pc.level + 1;
+        level = parentLevel + 1;
     }
-    if (level > MAX_LEVELS)
+    if (level >= MAX_LEVELS)
         throw std::runtime_error("Level is too big");
 
-    // assign level + parent to new node
-    newComponent.level = level;
-    newComponent.parent = parent;
-
-    // if we it's the first child, simply set the newEntity as the firstChild
-    if (pc.firstChild == -1){
-        pc.firstChild = newEntity;
-    }
-    // if we are not, set the newEntity as the nextSibling of the lastChild of the parent
-    else{
-        for(int e = pc.firstChild; e != -1; e = _hierarchies[e].nextSibling){
-            if (_hierarchies[e].nextSibling == -1){
-                _hierarchies[e].nextSibling = newEntity;
-                break;
-            }
-        }
+    // reuse the id of a removed entity, or add the ubiquitous components
+    int newEntity;
+    if (!_freeEntities.empty()){
+        newEntity = _freeEntities.back();
+        _freeEntities.pop_back();
+        _transforms[newEntity] = {};
+        _entityNames[newEntity] = name;
+    }
+    else {
+        newEntity = _hierarchies.size();
+        _hierarchies.emplace_back();
+        _transforms.emplace_back();
+        _entityNames.push_back(name);
+        _levelIndices.push_back(0);
     }
 
-    _hierarchies.push_back(newComponent);
+    // the new entity is the last child of the parent
+    _hierarchies[newEntity] = {};
+    _hierarchies[newEntity].level = level;
+    linkChild(parent, newEntity);
+    addToLevel(newEntity, level);
     return newEntity;
 }
 
+void Scene::removeSceneNode(int entity) {
+    VK_ASSERT(entity > 0 && isAlive(entity), "Invalid entity, the root can't be removed");
+
+    // the children are removed with the node
+    std::vector<int> subtree;
+    traverse(entity, [&subtree](int e){ subtree.push_back(e); });
+    unlinkChild(entity);
+
+    for (int e : subtree){
+        removeFromLevel(e);
+        removeRenderNodes(e);
+        _hierarchies[e] = {};
+        _entityNames[e].clear();
+        _freeEntities.push_back(e);
+    }
+}
+
+void Scene::reparentSceneNode(int entity, int newParent) {
+    if (newParent == -1)
+        newParent = 0;
+    VK_ASSERT(entity > 0 && isAlive(entity) && isAlive(newParent), "Invalid entity, the root can't be reparented");
+
+    // the new parent can't be a descendant of the node
+    for (int e = newParent; e != -1; e = _hierarchies[e].parent){
+        if (e == entity)
+            throw std::runtime_error("Cannot reparent a node under one of its descendants");
+    }
+
+    // the levels of the subtree are shifted by the level difference
+    std::vector<int> subtree;
+    traverse(entity, [&subtree](int e){ subtree.push_back(e); });
+    int levelOffset = _hierarchies[newParent].level + 1 - _hierarchies[entity].level;
+    for (int e : subtree){
+        if (_hierarchies[e].level + levelOffset >= MAX_LEVELS)
+            throw std::runtime_error("Level is too big");
+    }
+
+    unlinkChild(entity);
+    linkChild(newParent, entity);
+    for (int e : subtree){
+        removeFromLevel(e);
+        _hierarchies[e].level += levelOffset;
+        addToLevel(e, _hierarchies[e].level);
+    }
+}
+
+bool Scene::isAlive(int entity) {
+    return entity >= 0 && entity < (int)_hierarchies.size() && _hierarchies[entity].level != -1;
+}
 
 std::string& Scene::getName(int entity) {
     return _entityNames[entity];
@@ -79,31 +131,28 @@ TransformComponent& Scene::getTransform(int entity) {
 }
 
 MeshComponent* Scene::getMesh(int entity) {
-    auto it = _renderNodesMap[(uint32_t)RenderNode::MESH].find(entity);
-    if (it == _renderNodesMap[(uint32_t)RenderNode::MESH].end())
-        return nullptr;
-    return &_meshes[it->second];
+    return _meshes.get(entity);
 }
 
 // TODO : make more general for other renderNode ??
 /// creates a mesh for the given entityID and returns the created mesh
 MeshComponent& Scene::createMesh(int entityID){
-    auto& meshesMap = _renderNodesMap[(uint32_t)RenderNode::MESH];
-
     // check if the mesh already exists
-    if (meshesMap.find(entityID) != meshesMap.end()){
+    if (MeshComponent* mesh = _meshes.get(entityID); mesh != nullptr){
         SPDLOG_INFO("Mesh already exists\n");
-        return _meshes[meshesMap[entityID]];
+        return *mesh;
     }
     // create new mesh
     int newMeshID = _meshes.size();
     _worldTransforms[(uint32_t)RenderNode::MESH].emplace_back(1.f);
-    _meshes.emplace_back();
-    _meshes.back().meshIndex = newMeshID;
-
-    // associate entity with new mesh
-    meshesMap[entityID] = newMeshID;
-    return _meshes.back();
+    _meshNormalMatrices.emplace_back(1.f);
+    if ((uint32_t)newMeshID >= _dirtyMeshTransforms.size() * 64)
+        _dirtyMeshTransforms.push_back(0);
+    _dirtyMeshTransforms[newMeshID / 64] |= 1ull << (newMeshID % 64);
+    MeshComponent& mesh = _meshes.emplace(entityID);
+    mesh.meshIndex = newMeshID;
+    ++_meshesVersion;
+    return mesh;
 }
 
 void Scene::setTransform(int entity, const glm::mat4& transform){
@@ -115,76 +164,44 @@ void Scene::setTransform(int entity, const glm::mat4& transform){
     tc.needUpdateModelMatrix = false;
 
     // recursively mark this entity and all of his children as dirty
-    traverseRecursive(entity, [this](int entity){
-        auto& hie = _hierarchies[entity];
-        _changedTransforms[hie.level].insert(entity);
-    });
+    setDirtyTransform(entity);
 }
 
 void Scene::setDirtyTransform(int entity) {
-    traverseRecursive(entity, [this](int entity){
-        auto& hie = _hierarchies[entity];
-        _changedTransforms[hie.level].insert(entity);
+    if (entity == -1)
+        return;
+
+    traverse(entity, [this](int e){
+        markDirty(e);
     });
 }
 
 
-void Scene::propagateTransforms() {
-    // special logic for root (no parent)
-    if (!_changedTransforms[0].empty()){
-        int root = *_changedTransforms[0].begin();
-        VK_ASSERT(root == 0, "no bueno amigo");
+void Scene::propagateTransforms(bool parallel) {
+    // sweep the dirty bits level by level, the parents are updated before their children
+    while (_dirtyLevels != 0){
+        uint32_t level = std::countr_zero(_dirtyLevels);
+        _dirtyLevels &= _dirtyLevels - 1;
 
-        auto& tc = getTransform(root);
-        // update the local transform if required
-        if (tc.needUpdateModelMatrix){
-            tc.localTransform = utils::calculateModelMatrix(tc.position, tc.scale, tc.rotation);
-            tc.needUpdateModelMatrix = false;
+        const auto& dirtyBits = _dirtyTransforms[level];
+        uint32_t wordCount = dirtyBits.size();
+        uint32_t dirtyCount = 0;
+        if (parallel){
+            for (uint64_t bits : dirtyBits)
+                dirtyCount += std::popcount(bits);
         }
-        tc.worldTransform = tc.localTransform;
-        _changedTransforms[0].clear();
-    }
 
-    // propagate the transforms, going down the levels
-    for (int i = 1; i < MAX_LEVELS; ++i){
-        if (_changedTransforms[i].empty())
+        if (dirtyCount < PARALLEL_PROPAGATION_THRESHOLD){
+            propagateLevel(level, 0, wordCount);
             continue;
-
-        for (auto entity : _changedTransforms[i]){
-            auto& hie = _hierarchies[entity];
-            auto& tc = _transforms[entity];
-
-            // update the local transform if required
-            if (tc.needUpdateModelMatrix){
-                tc.localTransform = utils::calculateModelMatrix(tc.position, tc.scale, tc.rotation);
-                tc.needUpdateModelMatrix = false;
-            }
-
-            // compute world transform using parent
-            tc.worldTransform = _transforms[hie.parent].worldTransform * tc.localTransform;
-
-            // update the world transform at well if it exists
-            for (uint32_t i = 0; i < (uint32_t)RenderNode::COUNT; ++i){
-                auto it = _renderNodesMap[i].find(entity);
-                if (it != _renderNodesMap[i].end()){
-                    _worldTransforms[i][it->second] = tc.worldTransform;
-                    break;
-                }
-            }
         }
-        _changedTransforms[i].clear();
-    }
-}
 
-void Scene::traverseRecursive(int entity, std::function<void(int)> foo) {
-    if (entity == -1)
-        return;
-    // pass by ref for stuff like deleting
-    auto hie = _hierarchies[entity];
-    foo(entity);
-
-    for (int e = hie.firstChild; e != -1; e = _hierarchies[e].nextSibling)
-        traverseRecursive(e, foo);
+        // the entities of a level only read the transforms of the previous levels, the chunks are independent
+        uint32_t chunkCount = (wordCount + PROPAGATION_CHUNK_WORDS - 1) / PROPAGATION_CHUNK_WORDS;
+        ThreadPool::global().parallelFor(chunkCount, [this, level, wordCount](uint32_t chunk){
+            propagateLevel(level, chunk * PROPAGATION_CHUNK_WORDS, std::min(wordCount, (chunk + 1) * PROPAGATION_CHUNK_WORDS));
+        });
+    }
 }
 
 std::pair<Vertex*, uint32_t> Scene::getVerticesData() {
@@ -197,7 +214,11 @@ std::pair<uint32_t*, uint32_t> Scene::getIndicesData() {
 }
 
 const std::vector<MeshComponent>& Scene::getMeshes() {
-    return _meshes;
+    return _meshes.getComponents();
+}
+
+const std::vector<TextComponent>& Scene::getTexts() {
+    return _texts.getComponents();
 }
 
 const std::vector<glm::mat4>& Scene::getWorldTransforms(RenderNode type) {
@@ -205,7 +226,202 @@ const std::vector<glm::mat4>& Scene::getWorldTransforms(RenderNode type) {
     return _worldTransforms[(uint32_t)type];
 }
 
+const std::vector<glm::mat3x4>& Scene::getMeshNormalMatrices() {
+    return _meshNormalMatrices;
+}
 
 const std::vector<Material>& Scene::getMaterials() {
     return _materials;
+}
+
+uint32_t Scene::getMeshesVersion() {
+    return _meshesVersion;
+}
+
+const std::vector<uint64_t>& Scene::getDirtyMeshTransforms() {
+    return _dirtyMeshTransforms;
+}
+
+void Scene::clearDirtyMeshTransforms() {
+    std::fill(_dirtyMeshTransforms.begin(), _dirtyMeshTransforms.end(), 0);
+}
+
+//////////////////////// PRIVATE METHODS ///////////////////////////////////
+
+void Scene::linkChild(int parent, int entity) {
+    auto& pc = _hierarchies[parent];
+    auto& hc = _hierarchies[entity];
+    hc.parent = parent;
+    hc.prevSibling = pc.lastChild;
+    hc.nextSibling = -1;
+
+    if (pc.lastChild == -1)
+        pc.firstChild = entity;
+    else
+        _hierarchies[pc.lastChild].nextSibling = entity;
+    pc.lastChild = entity;
+}
+
+void Scene::unlinkChild(int entity) {
+    auto& hc = _hierarchies[entity];
+    auto& pc = _hierarchies[hc.parent];
+    if (hc.prevSibling == -1)
+        pc.firstChild = hc.nextSibling;
+    else
+        _hierarchies[hc.prevSibling].nextSibling = hc.nextSibling;
+
+    if (hc.nextSibling == -1)
+        pc.lastChild = hc.prevSibling;
+    else
+        _hierarchies[hc.nextSibling].prevSibling = hc.prevSibling;
+
+    hc.parent = -1;
+    hc.prevSibling = -1;
+    hc.nextSibling = -1;
+}
+
+void Scene::addToLevel(int entity, int level) {
+    _levelIndices[entity] = _levelEntities[level].size();
+    _levelEntities[level].push_back(entity);
+
+    // one dirty word per 64 entities of the level
+    if (_levelEntities[level].size() > _dirtyTransforms[level].size() * 64)
+        _dirtyTransforms[level].push_back(0);
+    markDirty(entity);
+}
+
+void Scene::removeFromLevel(int entity) {
+    uint32_t level = _hierarchies[entity].level;
+    uint32_t index = _levelIndices[entity];
+    auto& entities = _levelEntities[level];
+    auto& dirtyBits = _dirtyTransforms[level];
+    uint32_t lastIndex = entities.size() - 1;
+
+    // the last entity of the level takes the place of the removed one, with its dirty bit
+    bool lastDirty = (dirtyBits[lastIndex / 64] >> (lastIndex % 64)) & 1;
+    dirtyBits[index / 64] &= ~(1ull << (index % 64));
+    dirtyBits[lastIndex / 64] &= ~(1ull << (lastIndex % 64));
+    if (index != lastIndex){
+        entities[index] = entities[lastIndex];
+        _levelIndices[entities[index]] = index;
+        if (lastDirty)
+            dirtyBits[index / 64] |= 1ull << (index % 64);
+    }
+    entities.pop_back();
+    if (entities.size() <= (dirtyBits.size() - 1) * 64)
+        dirtyBits.pop_back();
+}
+
+int Scene::getRenderIndex(uint32_t type, int entity) {
+    switch ((RenderNode)type) {
+        case RenderNode::MESH:
+            return _meshes.indexOf(entity);
+        case RenderNode::TEXT:
+            return _texts.indexOf(entity);
+        default:
+            return -1;
+    }
+}
+
+void Scene::removeRenderNodes(int entity) {
+    for (uint32_t i = 0; i < (uint32_t)RenderNode::COUNT; ++i){
+        int index = getRenderIndex(i, entity);
+        if (index == -1)
+            continue;
+
+        // the pool moves its last component in the slot, the parallel arrays do the same
+        uint32_t lastIndex = _worldTransforms[i].size() - 1;
+        utils::swapRemove(_worldTransforms[i], index);
+
+        if (i == (uint32_t)RenderNode::MESH){
+            _meshes.remove(entity);
+            if (index != lastIndex)
+                _meshes.getComponents()[index].meshIndex = index;
+            utils::swapRemove(_meshNormalMatrices, index);
+
+            // the moved mesh changed of slot, the last slot is gone
+            _dirtyMeshTransforms[index / 64] |= 1ull << (index % 64);
+            _dirtyMeshTransforms[lastIndex / 64] &= ~(1ull << (lastIndex % 64));
+            if (lastIndex == (_dirtyMeshTransforms.size() - 1) * 64)
+                _dirtyMeshTransforms.pop_back();
+            ++_meshesVersion;
+        }
+        else if (i == (uint32_t)RenderNode::TEXT)
+            _texts.remove(entity);
+    }
+}
+
+void Scene::markDirty(int entity) {
+    uint32_t level = _hierarchies[entity].level;
+    uint32_t index = _levelIndices[entity];
+    _dirtyTransforms[level][index / 64] |= 1ull << (index % 64);
+    _dirtyLevels |= 1u << level;
+}
+
+void Scene::propagateLevel(uint32_t level, uint32_t firstWord, uint32_t lastWord) {
+    auto& dirtyBits = _dirtyTransforms[level];
+    const auto& entities = _levelEntities[level];
+    std::array<int, 64> batch;
+    for (uint32_t word = firstWord; word < lastWord; ++word){
+        // gather the set bits of the word, 64 clean entities are skipped at once
+        uint32_t batchSize = 0;
+        for (uint64_t bits = dirtyBits[word]; bits != 0; bits &= bits - 1)
+            batch[batchSize++] = entities[word * 64 + std::countr_zero(bits)];
+        if (batchSize != 0)
+            updateWorldTransforms(batch.data(), batchSize);
+        dirtyBits[word] = 0;
+    }
+}
+
+void Scene::updateWorldTransforms(const int* entities, uint32_t count) {
+    // SoA copies of the batch, the kernels work on contiguous arrays
+    std::array<glm::vec3, 64> positions, rotations, scales;
+    std::array<glm::mat4, 64> parents, locals;
+    std::array<int, 64> rebuilt;
+
+    // update the local transforms if required
+    uint32_t rebuildCount = 0;
+    for (uint32_t i = 0; i < count; ++i){
+        auto& tc = _transforms[entities[i]];
+        if (!tc.needUpdateModelMatrix)
+            continue;
+        positions[rebuildCount] = tc.position;
+        rotations[rebuildCount] = tc.rotation;
+        scales[rebuildCount] = tc.scale;
+        rebuilt[rebuildCount++] = entities[i];
+    }
+    utils::composeTransforms(positions.data(), rotations.data(), scales.data(), locals.data(), rebuildCount);
+    for (uint32_t i = 0; i < rebuildCount; ++i){
+        _transforms[rebuilt[i]].localTransform = locals[i];
+        _transforms[rebuilt[i]].needUpdateModelMatrix = false;
+    }
+
+    // compute world transforms using parent (the root has none)
+    for (uint32_t i = 0; i < count; ++i){
+        int parent = _hierarchies[entities[i]].parent;
+        parents[i] = parent == -1 ? glm::mat4(1.f) : _transforms[parent].worldTransform;
+        locals[i] = _transforms[entities[i]].localTransform;
+    }
+    utils::multiplyTransforms(parents.data(), locals.data(), locals.data(), count);
+
+    for (uint32_t i = 0; i < count; ++i)
+        writeWorldTransform(entities[i], locals[i]);
+}
+
+void Scene::writeWorldTransform(int entity, const glm::mat4& worldTransform) {
+    _transforms[entity].worldTransform = worldTransform;
+
+    // update the world transform of the render node as well if it exists
+    for (uint32_t i = 0; i < (uint32_t)RenderNode::COUNT; ++i){
+        int index = getRenderIndex(i, entity);
+        if (index == -1)
+            continue;
+        _worldTransforms[i][index] = worldTransform;
+        if (i == (uint32_t)RenderNode::MESH){
+            // the meshes of a word can be updated by different jobs
+            _meshNormalMatrices[index] = utils::calculateNormalMatrix(worldTransform);
+            std::atomic_ref(_dirtyMeshTransforms[index / 64]).fetch_or(1ull << (index % 64), std::memory_order_relaxed);
+        }
+        break;
+    }
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "Components.hpp"
+#include "SparseSet.h"
 
 #include <array>
 #include <vector>
@@ -35,17 +36,34 @@ public:
     TransformComponent& getTransform(int entity);
     MeshComponent* getMesh(int entity);
 
+    /// adds a node as the last child of the parent (the root if -1). The id of a removed node is recycled if possible
     int addSceneNode(int parent, int level, const std::string& name);
 
+    /// removes the node and all its descendants, with their components. Their ids are recycled by the next added nodes.
+    /// The geometry of the removed meshes is left in the vertex and index buffers
+    void removeSceneNode(int entity);
+
+    /// moves the node and its descendants under the new parent (the root if -1), as its last child. The local transform
+    /// is kept, the world transforms are recomputed by the next propagation
+    void reparentSceneNode(int entity, int newParent);
+
+    /// false if the entity was removed (or never existed)
+    bool isAlive(int entity);
+
     /// creates a mesh for the given entityID and returns the created mesh
     MeshComponent& createMesh(int entityID);
 
     void setTransform(int entity, const glm::mat4& transform);
     void setDirtyTransform(int entity);
 
-    void propagateTransforms();
+    /// recomputes the dirty world transforms. The large levels are split in chunks processed on the global thread pool,
+    /// unless parallel is false
+    void propagateTransforms(bool parallel = true);
 
-    void traverseRecursive(int entity, std::function<void(int entt)> foo);
+    /// visits the entity and all its descendants in depth first order, without recursion nor allocation. The visitor
+    /// must not add, remove or move nodes
+    template<typename Visitor>
+    void traverse(int entity, Visitor&& visitor);
 
     // TODO : remove these 2 methods
     /// pair of vertex* / size(in bytes)
@@ -57,24 +75,67 @@ public:
     /// return pair of transform* / size(in bytes)
     const std::vector<glm::mat4>& getWorldTransforms(RenderNode type);
 
+    /// normal matrices of the meshes, in the same order as the mesh world transforms
+    const std::vector<glm::mat3x4>& getMeshNormalMatrices();
+
     const std::vector<TextComponent>& getTexts();
     const std::vector<MeshComponent>& getMeshes();
     const std::vector<Material>& getMaterials();
 
+    /// incremented every time a mesh is added or removed, the mesh indices of the existing meshes can change on removal
+    uint32_t getMeshesVersion();
+
+    /// dirty bit of each mesh (by mesh index, 64 per word) whose world transform and normal matrix changed since the
+    /// last clearDirtyMeshTransforms. Lets the renderer upload only the changed transforms
+    const std::vector<uint64_t>& getDirtyMeshTransforms();
+    void clearDirtyMeshTransforms();
+
+private:
+    /// links the entity as the last child of the parent
+    void linkChild(int parent, int entity);
+    /// unlinks the entity from its parent and siblings
+    void unlinkChild(int entity);
+
+    /// adds the entity to the entities of its level, its transform is dirty
+    void addToLevel(int entity, int level);
+    /// removes the entity from the entities of its level, the last entity of the level takes its place
+    void removeFromLevel(int entity);
+
+    /// index of the render node of the entity in the pool of the type, -1 if none
+    int getRenderIndex(uint32_t type, int entity);
+
+    /// removes the render nodes of the entity. The last render node of each type takes its place
+    void removeRenderNodes(int entity);
+
+    /// sets the dirty bit of the entity, it is propagated by the next propagateTransforms
+    void markDirty(int entity);
+
+    /// updates the dirty entities of the level in the words [firstWord, lastWord) of its dirty bits, and clears them
+    void propagateLevel(uint32_t level, uint32_t firstWord, uint32_t lastWord);
+
+    /// recomputes the world transforms of the entities (at most 64) from their parent's and writes them in their render
+    /// slots. The local and world transforms are computed in batches with the SIMD kernels
+    void updateWorldTransforms(const int* entities, uint32_t count);
+
+    /// sets the world transform of the entity and of its render node, if any
+    void writeWorldTransform(int entity, const glm::mat4& worldTransform);
+
 private:
 
     /// ubiquitous components
     std::vector<HierarchyComponent> _hierarchies;
     std::vector<TransformComponent> _transforms;
     std::vector<std::string> _entityNames;
+    std::vector<int> _freeEntities;         ///< ids of the removed entities, reused by addSceneNode
 
-    /// map of entity to renderNodeID
-    std::array<std::unordered_map<int, int>, (uint32_t)RenderNode::COUNT> _renderNodesMap;
-
-    std::vector<MeshComponent> _meshes;
-    std::vector<TextComponent> _texts;
+    /// render node components, packed. The world transforms (and normal matrices) of a type are parallel to its pool
+    SparseSet<MeshComponent> _meshes;
+    SparseSet<TextComponent> _texts;
+    uint32_t _meshesVersion = 0;
 
     std::array<std::vector<glm::mat4>, (uint32_t)RenderNode::COUNT> _worldTransforms; ///< transforms to be uploaded to gpu
+    std::vector<glm::mat3x4> _meshNormalMatrices;   ///< recomputed with the dirty mesh world transforms
+    std::vector<uint64_t> _dirtyMeshTransforms;     ///< set from the propagation jobs, atomically
 
     ///< vector of material data and material name. Index in vector corresponds to the meshes material index
     std::vector<Material> _materials;
@@ -85,17 +146,41 @@ private:
     static constexpr uint32_t MAX_LEVELS = 16;
 
 
-    /// used to only recompute necessary transforms, note : it might be faster/simpler to always recompute all transforms
-    /// in certain case. Profile to get an accurate answer. If done so, the transforms must be sorted by level
-    std::array<std::unordered_set<int>, MAX_LEVELS> _changedTransforms;
-
-    std::vector<Vertex> _vertices;
-    std::vector<uint32_t> _indices;
-
-};
-
+    /// entities sorted by hierarchy level. Propagation sweeps the levels in order, the parents are always up to date
+    std::array<std::vector<int>, MAX_LEVELS> _levelEntities;
+    std::vector<uint32_t> _levelIndices;    ///< index of each entity in the entities of its level
 
+    /// dirty bit of the entities of each level, indexed like _levelEntities. Only the dirty transforms are recomputed
+    std::array<std::vector<uint64_t>, MAX_LEVELS> _dirtyTransforms;
+    uint32_t _dirtyLevels = 0;              ///< bit i is set if level i has dirty transforms
 
+    /// levels with fewer dirty entities are propagated on the calling thread, the job overhead is not worth it
+    static constexpr uint32_t PARALLEL_PROPAGATION_THRESHOLD = 4096;
+    static constexpr uint32_t PROPAGATION_CHUNK_WORDS = 16;   ///< dirty words per job (64 entities per word)
 
+    std::vector<Vertex> _vertices;
+    std::vector<uint32_t> _indices;     ///< relative to the vertex offset of their mesh
 
+};
 
+template<typename Visitor>
+void Scene::traverse(int entity, Visitor&& visitor) {
+    if (entity == -1)
+        return;
+
+    // the links replace the stack : go down to the first child, else to the next sibling of the node or of its closest
+    // ancestor having one, without leaving the subtree
+    int e = entity;
+    while (true){
+        visitor(e);
+        if (_hierarchies[e].firstChild != -1){
+            e = _hierarchies[e].firstChild;
+            continue;
+        }
+        while (e != entity && _hierarchies[e].nextSibling == -1)
+            e = _hierarchies[e].parent;
+        if (e == entity)
+            return;
+        e = _hierarchies[e].nextSibling;
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+/// Component pool of the entities. The components are packed in a dense array, iterated (or uploaded) as is. The sparse
+/// array maps an entity to the index of its component, lookups are a single array access. Removing a component moves
+/// the last one in its place, arrays parallel to the dense components must do the same (see utils::swapRemove)
+template<typename T>
+class SparseSet {
+public:
+    /// index of the component of the entity in the dense array, -1 if it has none
+    int indexOf(int entity) const;
+
+    bool contains(int entity) const;
+
+    /// component of the entity, nullptr if it has none
+    T* get(int entity);
+
+    /// adds a default component to the entity. The entity must not have one
+    T& emplace(int entity);
+
+    /// removes the component of the entity. Returns the index of the removed component, now holding the last component
+    /// (if it wasn't the last), or -1 if the entity had none
+    int remove(int entity);
+
+    uint32_t size() const;
+
+    std::vector<T>& getComponents();
+    const std::vector<T>& getComponents() const;
+
+    /// entity of each component, in the dense order
+    const std::vector<int>& getEntities() const;
+
+private:
+    std::vector<T> _dense;
+    std::vector<int> _entities;     ///< entity of each component
+    std::vector<int> _sparse;       ///< index of the component of each entity, -1 if none. Grown on demand
+};
+
+template<typename T>
+int SparseSet<T>::indexOf(int entity) const {
+    if (entity < 0 || entity >= (int)_sparse.size())
+        return -1;
+    return _sparse[entity];
+}
+
+template<typename T>
+bool SparseSet<T>::contains(int entity) const {
+    return indexOf(entity) != -1;
+}
+
+template<typename T>
+T* SparseSet<T>::get(int entity) {
+    int index = indexOf(entity);
+    return index == -1 ? nullptr : &_dense[index];
+}
+
+template<typename T>
+T& SparseSet<T>::emplace(int entity) {
+    if (entity >= (int)_sparse.size())
+        _sparse.resize(entity + 1, -1);
+
+    _sparse[entity] = _dense.size();
+    _entities.push_back(entity);
+    return _dense.emplace_back();
+}
+
+template<typename T>
+int SparseSet<T>::remove(int entity) {
+    int index = indexOf(entity);
+    if (index == -1)
+        return -1;
+
+    // move the last component in the slot
+    int lastEntity = _entities.back();
+    _dense[index] = std::move(_dense.back());
+    _entities[index] = lastEntity;
+    _sparse[lastEntity] = index;
+    _dense.pop_back();
+    _entities.pop_back();
+    _sparse[entity] = -1;
+    return index;
+}
+
+template<typename T>
+uint32_t SparseSet<T>::size() const {
+    return _dense.size();
+}
+
+template<typename T>
+std::vector<T>& SparseSet<T>::getComponents() {
+    return _dense;
+}
+
+template<typename T>
+const std::vector<T>& SparseSet<T>::getComponents() const {
+    return _dense;
+}
+
+template<typename T>
+const std::vector<int>& SparseSet<T>::getEntities() const {
+    return _entities;
+}
@@ -0,0 +1,104 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (_file == INVALID_HANDLE_VALUE){
+        _file = nullptr;
+        return false;
+    }
+
+    // empty files can't be mapped
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0){
+        close();
+        return false;
+    }
+    _size = (size_t)size.QuadPart;
+
+    _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping != nullptr)
+        _data = (const uint8_t*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (_data == nullptr){
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (_data != nullptr)
+        UnmapViewOfFile(_data);
+    if (_mapping != nullptr)
+        CloseHandle(_mapping);
+    if (_file != nullptr)
+        CloseHandle(_file);
+
+    _data = nullptr;
+    _mapping = nullptr;
+    _file = nullptr;
+    _size = 0;
+}
+#else
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    _fd = ::open(path.c_str(), O_RDONLY);
+    if (_fd == -1)
+        return false;
+
+    // empty files can't be mapped
+    struct stat fileStat{};
+    if (fstat(_fd, &fileStat) != 0 || fileStat.st_size == 0){
+        close();
+        return false;
+    }
+    _size = (size_t)fileStat.st_size;
+
+    void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED){
+        close();
+        return false;
+    }
+    _data = (const uint8_t*)data;
+    return true;
+}
+
+void MappedFile::close() {
+    if (_data != nullptr)
+        munmap((void*)_data, _size);
+    if (_fd != -1)
+        ::close(_fd);
+
+    _data = nullptr;
+    _fd = -1;
+    _size = 0;
+}
+#endif
+
+const uint8_t* MappedFile::getData() const {
+    return _data;
+}
+
+size_t MappedFile::getSize() const {
+    return _size;
+}
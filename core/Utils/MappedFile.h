@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+/// Read only memory mapped file. The content is paged in by the OS on access, nothing is read on open
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// maps the whole file. Returns false if the file does not exist, is empty or can't be mapped
+    bool open(const std::string& path);
+    void close();
+
+    const uint8_t* getData() const;
+    size_t getSize() const;
+
+private:
+#ifdef _WIN32
+    void* _file = nullptr;      ///< HANDLE of the file
+    void* _mapping = nullptr;   ///< HANDLE of the file mapping
+#else
+    int _fd = -1;
+#endif
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+};
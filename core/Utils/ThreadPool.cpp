@@ -0,0 +1,106 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    _workers.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i)
+        _workers.emplace_back([this](){ workerLoop(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _condition.notify_all();
+
+    // the queued tasks are executed before the workers exit
+    for (auto& worker : _workers)
+        worker.join();
+}
+
+ThreadPool& ThreadPool::global() {
+    static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t)>& function) {
+    if (count == 0)
+        return;
+
+    // shared with the helper tasks, which can start after this call returned if the workers are busy
+    struct State {
+        std::function<void(uint32_t)> function;
+        uint32_t count = 0;
+        std::atomic<uint32_t> next = 0;     ///< next item to process
+        std::atomic<uint32_t> done = 0;     ///< number of processed items
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::exception_ptr exception = nullptr;
+    };
+    auto state = std::make_shared<State>();
+    state->function = function;
+    state->count = count;
+
+    // pull items until there are none left
+    auto work = [state](){
+        for (uint32_t i = state->next++; i < state->count; i = state->next++){
+            try {
+                state->function(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->exception == nullptr)
+                    state->exception = std::current_exception();
+            }
+
+            // wake up the calling thread once the last item is done
+            if (++state->done == state->count){
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->condition.notify_all();
+            }
+        }
+    };
+
+    // the calling thread is one of the workers
+    uint32_t helperCount = std::min(count - 1, getThreadCount());
+    for (uint32_t i = 0; i < helperCount; ++i)
+        enqueue(work);
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock, [&state](){ return state->done == state->count; });
+    if (state->exception != nullptr)
+        std::rethrow_exception(state->exception);
+}
+
+uint32_t ThreadPool::getThreadCount() {
+    return _workers.size();
+}
+
+//////////////////////// PRIVATE METHODS ///////////////////////////////////
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(std::move(task));
+    }
+    _condition.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+    while (true){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this](){ return _stop || !_tasks.empty(); });
+            if (_stop && _tasks.empty())
+                return;
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+        task();
+    }
+}
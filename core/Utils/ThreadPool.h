@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+/// Fixed size pool of worker threads executing tasks in submission order
+class ThreadPool {
+public:
+    explicit ThreadPool(uint32_t threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// pool shared by the engine, with one worker per hardware thread (minus the main thread)
+    static ThreadPool& global();
+
+    /// queues the task. The returned future holds the result, or the exception thrown by the task
+    template<typename F>
+    auto submit(F&& task) -> std::future<std::invoke_result_t<F>>;
+
+    /// calls function(i) for i in [0, count) on the workers and blocks until all calls are done. The calling thread
+    /// processes items as well, so it is safe to call from a task running on the pool
+    void parallelFor(uint32_t count, const std::function<void(uint32_t)>& function);
+
+    uint32_t getThreadCount();
+
+private:
+    void enqueue(std::function<void()> task);
+    void workerLoop();
+
+private:
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    bool _stop = false;
+};
+
+template<typename F>
+auto ThreadPool::submit(F&& task) -> std::future<std::invoke_result_t<F>> {
+    // std::function must be copyable, the packaged task is not
+    using Result = std::invoke_result_t<F>;
+    auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> future = packagedTask->get_future();
+    enqueue([packagedTask](){ (*packagedTask)(); });
+    return future;
+}
@@ -101,8 +101,28 @@ namespace utils {
         glm::mat4 rotateMat = glm::toMat4(glm::quat(rotation));
         return translate * rotateMat * scaleMat;
     }
-}
-
-
 
+    glm::mat3x4 calculateNormalMatrix(const glm::mat4& transform) {
+        // the translation does not affect the normals, the 3x3 inverse is enough
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+        return glm::mat3x4(glm::vec4(normalMatrix[0], 0.f), glm::vec4(normalMatrix[1], 0.f), glm::vec4(normalMatrix[2], 0.f));
+    }
 
+    std::array<glm::vec4, 6> getFrustumPlanes(const glm::mat4& pv) {
+        // Gribb-Hartmann : the planes are combinations of the rows of the matrix (glm is column major)
+        glm::mat4 rows = glm::transpose(pv);
+        std::array<glm::vec4, 6> planes = {
+                rows[3] + rows[0], // left
+                rows[3] - rows[0], // right
+                rows[3] + rows[1], // bottom
+                rows[3] - rows[1], // top
+                rows[2],           // near, the depth range is [0, 1]
+                rows[3] - rows[2], // far
+        };
+
+        // normalize so the distance to a plane is in world units
+        for (auto& plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+        return planes;
+    }
+}
@@ -9,6 +9,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/matrix_decompose.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <array>
 
 
 namespace utils {
@@ -18,5 +19,13 @@ namespace utils {
     bool decomposeTransform(const glm::mat4& transform, glm::vec3& translation, glm::vec3& rotation, glm::vec3& scale);
 
     glm::mat4 calculateModelMatrix(const glm::vec3& position, const glm::vec3& scale, const glm::vec3& rotation);
+
+    /// inverse transpose of the upper 3x3 of the transform, transforms the normals under non uniform scale. The columns
+    /// are padded to vec4 to match the std430 layout of a mat3
+    glm::mat3x4 calculateNormalMatrix(const glm::mat4& transform);
+
+    /// extracts the normalized frustum planes (left, right, bottom, top, near, far) of a projection view matrix with a
+    /// [0, 1] depth range. A point p is inside a plane if dot(plane.xyz, p) + plane.w >= 0
+    std::array<glm::vec4, 6> getFrustumPlanes(const glm::mat4& pv);
 }
 
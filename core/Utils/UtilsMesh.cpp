@@ -0,0 +1,482 @@
+#include "UtilsMesh.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+#include <unordered_set>
+
+namespace {
+    // Forsyth's scoring. The vertices in the cache score by their position (the last triangle's ones slightly less, to
+    // avoid strips), the vertices with few remaining triangles are boosted so they are finished and leave the cache
+    constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+    constexpr uint32_t FORSYTH_MAX_VALENCE = 32;   ///< valence boost of the vertices with more triangles is computed
+    constexpr float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+    constexpr float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+    constexpr float FORSYTH_VALENCE_BOOST_SCALE = 2.f;
+    constexpr float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+    struct ForsythTables {
+        std::array<float, FORSYTH_CACHE_SIZE + 1> cacheScores;      ///< by cache position, the last one is out of the cache
+        std::array<float, FORSYTH_MAX_VALENCE> valenceScores;       ///< by remaining triangle count
+
+        ForsythTables() {
+            for (uint32_t i = 0; i < FORSYTH_CACHE_SIZE; ++i){
+                if (i < 3)
+                    cacheScores[i] = FORSYTH_LAST_TRIANGLE_SCORE;
+                else
+                    cacheScores[i] = std::pow(1.f - (float)(i - 3) / (FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY_POWER);
+            }
+            cacheScores[FORSYTH_CACHE_SIZE] = 0.f;
+            valenceScores[0] = 0.f;
+            for (uint32_t i = 1; i < FORSYTH_MAX_VALENCE; ++i)
+                valenceScores[i] = FORSYTH_VALENCE_BOOST_SCALE * std::pow((float)i, -FORSYTH_VALENCE_BOOST_POWER);
+        }
+
+        /// score of a vertex, -1 if it has no triangle left. Cache position is FORSYTH_CACHE_SIZE if not cached
+        float score(uint32_t cachePosition, uint32_t liveTriangles) const {
+            if (liveTriangles == 0)
+                return -1.f;
+            float valenceScore = liveTriangles < FORSYTH_MAX_VALENCE ? valenceScores[liveTriangles] :
+                    FORSYTH_VALENCE_BOOST_SCALE * std::pow((float)liveTriangles, -FORSYTH_VALENCE_BOOST_POWER);
+            return cacheScores[cachePosition] + valenceScore;
+        }
+    };
+
+    /// sum of the squared distances to planes, weighted by the area of their triangle : p^T A p + 2 b.p + c
+    struct Quadric {
+        double a00 = 0., a11 = 0., a22 = 0., a01 = 0., a02 = 0., a12 = 0.;
+        double b0 = 0., b1 = 0., b2 = 0.;
+        double c = 0.;
+        double weight = 0.;
+
+        void addPlane(const glm::vec3& normal, double distance, double planeWeight) {
+            double x = normal.x, y = normal.y, z = normal.z;
+            a00 += planeWeight * x * x; a11 += planeWeight * y * y; a22 += planeWeight * z * z;
+            a01 += planeWeight * x * y; a02 += planeWeight * x * z; a12 += planeWeight * y * z;
+            b0 += planeWeight * x * distance; b1 += planeWeight * y * distance; b2 += planeWeight * z * distance;
+            c += planeWeight * distance * distance;
+            weight += planeWeight;
+        }
+
+        void add(const Quadric& q) {
+            a00 += q.a00; a11 += q.a11; a22 += q.a22; a01 += q.a01; a02 += q.a02; a12 += q.a12;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c; weight += q.weight;
+        }
+
+        /// weighted average of the squared distances
+        double error(const glm::vec3& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            double result = a00 * x * x + a11 * y * y + a22 * z * z + 2. * (a01 * x * y + a02 * x * z + a12 * y * z)
+                            + 2. * (b0 * x + b1 * y + b2 * z) + c;
+            return std::max(result, 0.) / std::max(weight, DBL_MIN);
+        }
+    };
+
+    /// maps the unit sphere on the [-1, 1] square : the upper hemisphere on the inner diamond, the lower one folded on
+    /// the corners
+    glm::vec2 encodeOctahedral(const glm::vec3& normal) {
+        float norm = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if (norm == 0.f)
+            return glm::vec2(0.f);
+        glm::vec3 n = normal / norm;
+        if (n.z >= 0.f)
+            return glm::vec2(n.x, n.y);
+        return glm::vec2((1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f),
+                         (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f));
+    }
+
+    glm::vec3 decodeOctahedral(const glm::vec2& encoded) {
+        glm::vec3 n(encoded.x, encoded.y, 1.f - std::abs(encoded.x) - std::abs(encoded.y));
+        float t = std::max(-n.z, 0.f);
+        n.x += n.x >= 0.f ? -t : t;
+        n.y += n.y >= 0.f ? -t : t;
+        return glm::normalize(n);
+    }
+}
+
+namespace utils {
+
+    VertexCacheStatistics analyzeVertexCache(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount,
+                                             uint32_t cacheSize) {
+        VertexCacheStatistics statistics{};
+        if (indexCount < 3 || vertexCount == 0)
+            return statistics;
+
+        // FIFO cache : a vertex is cached if fewer than cacheSize vertices were transformed since its own transformation
+        std::vector<uint32_t> timestamps(vertexCount, 0);
+        uint32_t timestamp = cacheSize + 1;
+        for (uint32_t i = 0; i < indexCount; ++i){
+            uint32_t vertex = indices[i];
+            if (timestamp - timestamps[vertex] > cacheSize){
+                timestamps[vertex] = timestamp++;
+                ++statistics.transformedVertices;
+            }
+        }
+
+        statistics.acmr = (float)statistics.transformedVertices / (float)(indexCount / 3);
+        statistics.atvr = (float)statistics.transformedVertices / (float)vertexCount;
+        return statistics;
+    }
+
+    void optimizeVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t vertexCount) {
+        uint32_t triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+            return;
+        static const ForsythTables tables;
+
+        // triangles of each vertex, packed by vertex. The first liveTriangles[vertex] ones are not emitted yet
+        std::vector<uint32_t> liveTriangles(vertexCount, 0);
+        for (uint32_t i = 0; i < triangleCount * 3; ++i)
+            ++liveTriangles[indices[i]];
+        std::vector<uint32_t> adjacencyOffsets(vertexCount);
+        std::exclusive_scan(liveTriangles.begin(), liveTriangles.end(), adjacencyOffsets.begin(), 0u);
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        std::vector<uint32_t> adjacencyCounts(vertexCount, 0);
+        for (uint32_t i = 0; i < triangleCount * 3; ++i){
+            uint32_t vertex = indices[i];
+            adjacency[adjacencyOffsets[vertex] + adjacencyCounts[vertex]++] = i / 3;
+        }
+
+        std::vector<uint32_t> cachePositions(vertexCount, FORSYTH_CACHE_SIZE);
+        std::vector<float> vertexScores(vertexCount);
+        for (uint32_t i = 0; i < vertexCount; ++i)
+            vertexScores[i] = tables.score(FORSYTH_CACHE_SIZE, liveTriangles[i]);
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> result(triangleCount * 3);
+
+        // LRU cache, the vertices of the last triangle first. The cache overflows by up to 3 vertices before eviction
+        std::array<uint32_t, FORSYTH_CACHE_SIZE + 3> cache{}, newCache{};
+        uint32_t cacheCount = 0;
+
+        int bestTriangle = -1;
+        uint32_t nextUnemitted = 0;
+        for (uint32_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount){
+            // no triangle left around the cached vertices : restart from the first triangle not emitted yet, instead of
+            // scoring all the triangles
+            if (bestTriangle == -1){
+                while (emitted[nextUnemitted])
+                    ++nextUnemitted;
+                bestTriangle = nextUnemitted;
+            }
+            const uint32_t* triangle = indices + bestTriangle * 3;
+            memcpy(result.data() + emittedCount * 3, triangle, 3 * sizeof(uint32_t));
+            emitted[bestTriangle] = true;
+
+            // remove the triangle from the live triangles of its vertices
+            for (uint32_t k = 0; k < 3; ++k){
+                uint32_t vertex = triangle[k];
+                uint32_t* triangles = adjacency.data() + adjacencyOffsets[vertex];
+                uint32_t& live = liveTriangles[vertex];
+                for (uint32_t j = 0; j < live; ++j){
+                    if (triangles[j] == (uint32_t)bestTriangle){
+                        triangles[j] = triangles[live - 1];
+                        --live;
+                        break;
+                    }
+                }
+            }
+
+            // the vertices of the triangle move to the front of the cache
+            uint32_t newCount = 0;
+            for (uint32_t k = 0; k < 3; ++k){
+                if (std::find(newCache.begin(), newCache.begin() + newCount, triangle[k]) == newCache.begin() + newCount)
+                    newCache[newCount++] = triangle[k];
+            }
+            for (uint32_t i = 0; i < cacheCount; ++i){
+                uint32_t vertex = cache[i];
+                if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                    newCache[newCount++] = vertex;
+            }
+
+            // the evicted vertices lose their cache score
+            for (uint32_t i = FORSYTH_CACHE_SIZE; i < newCount; ++i){
+                uint32_t vertex = newCache[i];
+                cachePositions[vertex] = FORSYTH_CACHE_SIZE;
+                vertexScores[vertex] = tables.score(FORSYTH_CACHE_SIZE, liveTriangles[vertex]);
+            }
+            cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+            std::swap(cache, newCache);
+
+            for (uint32_t i = 0; i < cacheCount; ++i){
+                uint32_t vertex = cache[i];
+                cachePositions[vertex] = i;
+                vertexScores[vertex] = tables.score(i, liveTriangles[vertex]);
+            }
+
+            // the next triangle is the best scored one around the cached vertices
+            bestTriangle = -1;
+            float bestScore = -1.f;
+            for (uint32_t i = 0; i < cacheCount; ++i){
+                uint32_t vertex = cache[i];
+                const uint32_t* triangles = adjacency.data() + adjacencyOffsets[vertex];
+                for (uint32_t j = 0; j < liveTriangles[vertex]; ++j){
+                    const uint32_t* candidate = indices + triangles[j] * 3;
+                    float score = vertexScores[candidate[0]] + vertexScores[candidate[1]] + vertexScores[candidate[2]];
+                    if (score > bestScore){
+                        bestScore = score;
+                        bestTriangle = triangles[j];
+                    }
+                }
+            }
+        }
+
+        memcpy(indices, result.data(), result.size() * sizeof(uint32_t));
+    }
+
+    void optimizeOverdraw(uint32_t* indices, uint32_t indexCount, const glm::vec3* positions, uint32_t vertexCount,
+                          uint32_t cacheSize) {
+        uint32_t triangleCount = indexCount / 3;
+        if (triangleCount < 2)
+            return;
+
+        // split the triangles in clusters, starting at the triangles missing the cache for all their vertices
+        std::vector<uint32_t> clusterStarts;
+        std::vector<uint32_t> timestamps(vertexCount, 0);
+        uint32_t timestamp = cacheSize + 1;
+        for (uint32_t i = 0; i < triangleCount; ++i){
+            uint32_t misses = 0;
+            for (uint32_t k = 0; k < 3; ++k){
+                uint32_t vertex = indices[i * 3 + k];
+                if (timestamp - timestamps[vertex] > cacheSize){
+                    timestamps[vertex] = timestamp++;
+                    ++misses;
+                }
+            }
+            if (i == 0 || misses == 3)
+                clusterStarts.push_back(i);
+        }
+        uint32_t clusterCount = clusterStarts.size();
+        clusterStarts.push_back(triangleCount);
+        if (clusterCount < 2)
+            return;
+
+        // area weighted centroid and normal of each cluster, and centroid of the mesh
+        std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.f));
+        std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.f));
+        glm::vec3 meshCentroid(0.f);
+        float meshArea = 0.f;
+        for (uint32_t c = 0; c < clusterCount; ++c){
+            float clusterArea = 0.f;
+            for (uint32_t i = clusterStarts[c]; i < clusterStarts[c + 1]; ++i){
+                const glm::vec3& p0 = positions[indices[i * 3]];
+                const glm::vec3& p1 = positions[indices[i * 3 + 1]];
+                const glm::vec3& p2 = positions[indices[i * 3 + 2]];
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);   // length is twice the area
+                float area = glm::length(normal);
+                clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.f);
+                clusterNormals[c] += normal;
+                clusterArea += area;
+            }
+            meshCentroid += clusterCentroids[c];
+            meshArea += clusterArea;
+            clusterCentroids[c] = clusterArea > 0.f ? clusterCentroids[c] / clusterArea : positions[indices[clusterStarts[c] * 3]];
+        }
+        if (meshArea > 0.f)
+            meshCentroid /= meshArea;
+
+        // the clusters facing away from the center are on the outside of the mesh, drawn first they occlude the rest
+        std::vector<float> sortKeys(clusterCount, 0.f);
+        for (uint32_t c = 0; c < clusterCount; ++c){
+            float length = glm::length(clusterNormals[c]);
+            if (length > 0.f)
+                sortKeys[c] = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c] / length);
+        }
+        std::vector<uint32_t> order(clusterCount);
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b){
+            return sortKeys[a] > sortKeys[b];
+        });
+
+        std::vector<uint32_t> result;
+        result.reserve(triangleCount * 3);
+        for (uint32_t c : order)
+            result.insert(result.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+        memcpy(indices, result.data(), result.size() * sizeof(uint32_t));
+    }
+
+    uint32_t simplifyMesh(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, const glm::vec3* positions,
+                          uint32_t vertexCount, uint32_t targetIndexCount, float maxError, float& resultError) {
+        uint32_t count = indexCount / 3 * 3;
+        memcpy(destination, indices, count * sizeof(uint32_t));
+        resultError = 0.f;
+
+        // the vertices of the edges used by a single triangle are on a border, moving them would open the mesh
+        std::vector<bool> locked(vertexCount, false);
+        std::unordered_set<uint64_t> edges;
+        auto edgeKey = [](uint32_t a, uint32_t b){ return ((uint64_t)a << 32) | b; };
+        for (uint32_t i = 0; i < count; ++i)
+            edges.insert(edgeKey(destination[i], destination[i - i % 3 + (i + 1) % 3]));
+        for (uint32_t i = 0; i < count; ++i){
+            uint32_t a = destination[i], b = destination[i - i % 3 + (i + 1) % 3];
+            if (!edges.contains(edgeKey(b, a)))
+                locked[a] = locked[b] = true;
+        }
+
+        // plane quadrics of the triangles around each vertex
+        std::vector<Quadric> quadrics(vertexCount);
+        for (uint32_t i = 0; i < count; i += 3){
+            const glm::vec3& p0 = positions[destination[i]];
+            glm::vec3 normal = glm::cross(positions[destination[i + 1]] - p0, positions[destination[i + 2]] - p0);
+            float length = glm::length(normal);
+            if (length == 0.f)
+                continue;
+            normal /= length;
+            double distance = -glm::dot(normal, p0);
+            for (uint32_t k = 0; k < 3; ++k)
+                quadrics[destination[i + k]].addPlane(normal, distance, length * 0.5);
+        }
+
+        struct Collapse {
+            uint32_t from;
+            uint32_t to;
+            double cost;    ///< squared error of the merged quadrics at the position of to
+        };
+        double maxCost = (double)maxError * maxError;
+        double resultCost = 0.;
+        std::vector<uint32_t> remap(vertexCount);
+        std::vector<bool> touched(vertexCount);
+        std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+        std::vector<uint32_t> adjacency;
+
+        // each pass collapses the cheapest independent edges, then rewrites the triangles
+        while (count > targetIndexCount){
+            // triangles around each vertex
+            std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+            for (uint32_t i = 0; i < count; ++i)
+                ++adjacencyOffsets[destination[i] + 1];
+            std::inclusive_scan(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+            adjacency.resize(count);
+            std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (uint32_t i = 0; i < count; ++i)
+                adjacency[fill[destination[i]]++] = i / 3;
+
+            // cheapest direction of each edge. The interior edges are seen from both triangles, keep one
+            std::vector<Collapse> collapses;
+            for (uint32_t i = 0; i < count; ++i){
+                uint32_t a = destination[i], b = destination[i - i % 3 + (i + 1) % 3];
+                if (a > b || (locked[a] && locked[b]))
+                    continue;
+                Quadric merged = quadrics[a];
+                merged.add(quadrics[b]);
+                double costToB = locked[a] ? DBL_MAX : merged.error(positions[b]);
+                double costToA = locked[b] ? DBL_MAX : merged.error(positions[a]);
+                if (costToB <= costToA)
+                    collapses.push_back({a, b, costToB});
+                else
+                    collapses.push_back({b, a, costToA});
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r){ return l.cost < r.cost; });
+
+            // a collapse removes 2 triangles. The triangles around a collapsed vertex changed, their vertices wait for
+            // the next pass
+            std::iota(remap.begin(), remap.end(), 0u);
+            std::fill(touched.begin(), touched.end(), false);
+            uint32_t removableTriangles = (count - targetIndexCount) / 3;
+            uint32_t collapsed = 0;
+            for (const Collapse& collapse : collapses){
+                if (collapse.cost > maxCost || collapsed * 2 >= removableTriangles)
+                    break;
+                if (touched[collapse.from] || touched[collapse.to])
+                    continue;
+
+                // the triangles kept around the moved vertex must not flip, nor turn by more than ~75 degrees
+                bool flips = false;
+                for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1] && !flips; ++j){
+                    const uint32_t* triangle = destination + adjacency[j] * 3;
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                        continue;
+                    glm::vec3 corners[3], movedCorners[3];
+                    for (uint32_t k = 0; k < 3; ++k){
+                        corners[k] = positions[triangle[k]];
+                        movedCorners[k] = positions[triangle[k] == collapse.from ? collapse.to : triangle[k]];
+                    }
+                    glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                    glm::vec3 movedNormal = glm::cross(movedCorners[1] - movedCorners[0], movedCorners[2] - movedCorners[0]);
+                    flips = glm::dot(normal, movedNormal) <= 0.25f * glm::length(normal) * glm::length(movedNormal);
+                }
+                if (flips)
+                    continue;
+
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to].add(quadrics[collapse.from]);
+                for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; ++j){
+                    const uint32_t* triangle = destination + adjacency[j] * 3;
+                    touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+                }
+                resultCost = std::max(resultCost, collapse.cost);
+                ++collapsed;
+            }
+            if (collapsed == 0)
+                break;
+
+            // rewrite the triangles, the collapsed ones are degenerate
+            uint32_t newCount = 0;
+            for (uint32_t i = 0; i < count; i += 3){
+                uint32_t a = remap[destination[i]], b = remap[destination[i + 1]], c = remap[destination[i + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+                destination[newCount++] = a;
+                destination[newCount++] = b;
+                destination[newCount++] = c;
+            }
+            count = newCount;
+        }
+
+        resultError = (float)std::sqrt(resultCost);
+        return count;
+    }
+
+    PackedVertex packVertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv, const glm::vec4& bounds) {
+        // the position is relative to the bounding cube of the mesh, mapped on [0, 1]
+        float size = std::max(bounds.w * 2.f, FLT_MIN);
+        glm::vec3 unorm = (position - glm::vec3(bounds)) / size + 0.5f;
+        return {
+                .positionXY = glm::packUnorm2x16(glm::vec2(unorm.x, unorm.y)),
+                .positionZ = glm::packUnorm2x16(glm::vec2(unorm.z, 0.f)),
+                .normal = glm::packSnorm2x16(encodeOctahedral(normal)),
+                .uv = glm::packHalf2x16(uv),
+        };
+    }
+
+    void unpackVertex(const PackedVertex& vertex, const glm::vec4& bounds, glm::vec3& position, glm::vec3& normal,
+                      glm::vec2& uv) {
+        glm::vec2 xy = glm::unpackUnorm2x16(vertex.positionXY);
+        glm::vec3 unorm(xy.x, xy.y, glm::unpackUnorm2x16(vertex.positionZ).x);
+        position = glm::vec3(bounds) + (unorm * 2.f - 1.f) * bounds.w;
+        normal = decodeOctahedral(glm::unpackSnorm2x16(vertex.normal));
+        uv = glm::unpackHalf2x16(vertex.uv);
+    }
+
+    uint32_t optimizeVertexFetch(void* vertices, uint32_t* indices, uint32_t indexCount, uint32_t vertexCount,
+                                 uint32_t vertexSize) {
+        // new index of each vertex, by first use
+        constexpr uint32_t UNUSED = UINT32_MAX;
+        std::vector<uint32_t> remap(vertexCount, UNUSED);
+        uint32_t usedCount = 0;
+        for (uint32_t i = 0; i < indexCount; ++i){
+            uint32_t& newIndex = remap[indices[i]];
+            if (newIndex == UNUSED)
+                newIndex = usedCount++;
+            indices[i] = newIndex;
+        }
+
+        // the unused vertices follow, in their original order
+        uint32_t unusedIndex = usedCount;
+        for (uint32_t& newIndex : remap){
+            if (newIndex == UNUSED)
+                newIndex = unusedIndex++;
+        }
+
+        std::vector<uint8_t> copy((uint8_t*)vertices, (uint8_t*)vertices + (size_t)vertexCount * vertexSize);
+        for (uint32_t i = 0; i < vertexCount; ++i)
+            memcpy((uint8_t*)vertices + (size_t)remap[i] * vertexSize, copy.data() + (size_t)i * vertexSize, vertexSize);
+        return usedCount;
+    }
+}
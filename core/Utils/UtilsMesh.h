@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+
+/// Index and vertex buffer optimizations, run once per mesh at import. The indices are relative to the first vertex of
+/// the mesh, in [0, vertexCount)
+namespace utils {
+
+    /// vertex cache efficiency of an index buffer, simulated with a FIFO post transform cache
+    struct VertexCacheStatistics {
+        uint32_t transformedVertices = 0;   ///< vertex shader invocations (cache misses)
+        float acmr = 0.f;                   ///< average cache miss ratio : transformed vertices per triangle, in [0.5, 3]
+        float atvr = 0.f;                   ///< average transformed vertex ratio : transformed vertices per vertex, 1 is optimal
+    };
+
+    /// size of the simulated post transform cache. Close to the effective size of the desktop GPUs
+    constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+    VertexCacheStatistics analyzeVertexCache(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount,
+                                             uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+    /// reorders the triangles to maximize the post transform vertex cache hits (Forsyth's linear speed algorithm)
+    void optimizeVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t vertexCount);
+
+    /// reorders clusters of the cache optimized triangles so the outer surfaces, likely occluders, are drawn first. The
+    /// clusters start where the cache is cold anyway, the vertex cache efficiency is mostly kept
+    void optimizeOverdraw(uint32_t* indices, uint32_t indexCount, const glm::vec3* positions, uint32_t vertexCount,
+                          uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+    /// simplifies the mesh with quadric error metrics, by collapsing edges on one of their vertices : the vertices are
+    /// kept, only the triangles change. The border vertices (and so the uv or normal seams) are never moved. Stops at
+    /// targetIndexCount or before a collapse exceeding maxError (in the mesh units). Writes the indices in destination
+    /// (at least indexCount big) and returns their count. The error is the max distance to the original surface
+    uint32_t simplifyMesh(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, const glm::vec3* positions,
+                          uint32_t vertexCount, uint32_t targetIndexCount, float maxError, float& resultError);
+
+    /// vertex packed in 16 bytes, decoded by the vertex shaders. Must match the PackedVertex of multi.vert
+    struct PackedVertex {
+        uint32_t positionXY = 0;    ///< unorm 2x16, in the bounding cube of the mesh bounding sphere
+        uint32_t positionZ = 0;     ///< unorm 16, the high bits are unused
+        uint32_t normal = 0;        ///< octahedral encoding, snorm 2x16
+        uint32_t uv = 0;            ///< half 2x16
+    };
+
+    /// packs the vertex of a mesh. The bounds are the center (xyz) and the radius (w) of the mesh bounding sphere
+    PackedVertex packVertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv, const glm::vec4& bounds);
+    void unpackVertex(const PackedVertex& vertex, const glm::vec4& bounds, glm::vec3& position, glm::vec3& normal,
+                      glm::vec2& uv);
+
+    /// reorders the vertices in the order of their first use by the indices (and rewrites the indices), so the vertex
+    /// fetches are sequential. The unused vertices are moved at the end. Returns the number of used vertices
+    uint32_t optimizeVertexFetch(void* vertices, uint32_t* indices, uint32_t indexCount, uint32_t vertexCount,
+                                 uint32_t vertexSize);
+}
@@ -0,0 +1,270 @@
+#include "UtilsSimd.h"
+#include "UtilsMath.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VELCRO_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts AVX2 intrinsics in any function, gcc and clang only in functions compiled for the target
+#if defined(_MSC_VER) && !defined(__clang__)
+#define VELCRO_TARGET_AVX2
+#else
+#define VELCRO_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+
+namespace utils {
+
+#ifdef VELCRO_SIMD_X86
+    namespace {
+        /// translation, rotation and scale of up to 8 nodes in SoA. The rotation is stored as the sines and cosines of
+        /// the half euler angles, the only part computed on scalars
+        struct TRSLanes {
+            alignas(32) float cosX[8], sinX[8], cosY[8], sinY[8], cosZ[8], sinZ[8];
+            alignas(32) float scaleX[8], scaleY[8], scaleZ[8];
+            alignas(32) float posX[8], posY[8], posZ[8];
+        };
+
+        void loadLanes(TRSLanes& lanes, const glm::vec3* positions, const glm::vec3* rotations, const glm::vec3* scales,
+                       uint32_t laneCount) {
+            for (uint32_t i = 0; i < laneCount; ++i){
+                lanes.cosX[i] = std::cos(rotations[i].x * 0.5f);
+                lanes.sinX[i] = std::sin(rotations[i].x * 0.5f);
+                lanes.cosY[i] = std::cos(rotations[i].y * 0.5f);
+                lanes.sinY[i] = std::sin(rotations[i].y * 0.5f);
+                lanes.cosZ[i] = std::cos(rotations[i].z * 0.5f);
+                lanes.sinZ[i] = std::sin(rotations[i].z * 0.5f);
+                lanes.scaleX[i] = scales[i].x;
+                lanes.scaleY[i] = scales[i].y;
+                lanes.scaleZ[i] = scales[i].z;
+                lanes.posX[i] = positions[i].x;
+                lanes.posY[i] = positions[i].y;
+                lanes.posZ[i] = positions[i].z;
+            }
+        }
+
+        /// transposes the lanes of x, y, z and w, and stores them as the given column of 4 consecutive matrices
+        inline void storeColumn(glm::mat4* results, uint32_t column, __m128 x, __m128 y, __m128 z, __m128 w) {
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            _mm_storeu_ps(&results[0][column][0], x);
+            _mm_storeu_ps(&results[1][column][0], y);
+            _mm_storeu_ps(&results[2][column][0], z);
+            _mm_storeu_ps(&results[3][column][0], w);
+        }
+
+        SimdLevel detectSimdLevel() {
+#ifdef _MSC_VER
+            // AVX2 (leaf 7) and FMA, AVX and OSXSAVE (leaf 1). The OS must save the YMM registers (XCR0 bits 1 and 2)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return SimdLevel::SSE;
+            __cpuid(info, 1);
+            bool fma = (info[2] & (1 << 12)) != 0;
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            bool avx = (info[2] & (1 << 28)) != 0;
+            if (!fma || !osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+                return SimdLevel::SSE;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0 ? SimdLevel::AVX2 : SimdLevel::SSE;
+#else
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+                return SimdLevel::AVX2;
+            return SimdLevel::SSE;
+#endif
+        }
+
+        void multiplyTransformsSSE(const glm::mat4* parents, const glm::mat4* children, glm::mat4* results, uint32_t count) {
+            for (uint32_t i = 0; i < count; ++i){
+                const float* parent = &parents[i][0][0];
+                const float* child = &children[i][0][0];
+                float* result = &results[i][0][0];
+                __m128 p0 = _mm_loadu_ps(parent);
+                __m128 p1 = _mm_loadu_ps(parent + 4);
+                __m128 p2 = _mm_loadu_ps(parent + 8);
+                __m128 p3 = _mm_loadu_ps(parent + 12);
+
+                // each result column is a combination of the parent columns. The child column is read before the
+                // result column is written, the result can alias the child
+                for (uint32_t c = 0; c < 4; ++c){
+                    __m128 column = _mm_mul_ps(p0, _mm_set1_ps(child[c * 4]));
+                    column = _mm_add_ps(column, _mm_mul_ps(p1, _mm_set1_ps(child[c * 4 + 1])));
+                    column = _mm_add_ps(column, _mm_mul_ps(p2, _mm_set1_ps(child[c * 4 + 2])));
+                    column = _mm_add_ps(column, _mm_mul_ps(p3, _mm_set1_ps(child[c * 4 + 3])));
+                    _mm_storeu_ps(result + c * 4, column);
+                }
+            }
+        }
+
+        VELCRO_TARGET_AVX2
+        void multiplyTransformsAVX2(const glm::mat4* parents, const glm::mat4* children, glm::mat4* results, uint32_t count) {
+            for (uint32_t i = 0; i < count; ++i){
+                const float* parent = &parents[i][0][0];
+                const float* child = &children[i][0][0];
+                float* result = &results[i][0][0];
+
+                // the parent columns are duplicated in both halves, two result columns are computed at once
+                __m256 p0 = _mm256_broadcast_ps((const __m128*)parent);
+                __m256 p1 = _mm256_broadcast_ps((const __m128*)(parent + 4));
+                __m256 p2 = _mm256_broadcast_ps((const __m128*)(parent + 8));
+                __m256 p3 = _mm256_broadcast_ps((const __m128*)(parent + 12));
+
+                for (uint32_t c = 0; c < 4; c += 2){
+                    // child columns c and c + 1, each element is broadcast in its half
+                    __m256 columns = _mm256_loadu_ps(child + c * 4);
+                    __m256 result01 = _mm256_mul_ps(p0, _mm256_permute_ps(columns, 0x00));
+                    result01 = _mm256_fmadd_ps(p1, _mm256_permute_ps(columns, 0x55), result01);
+                    result01 = _mm256_fmadd_ps(p2, _mm256_permute_ps(columns, 0xAA), result01);
+                    result01 = _mm256_fmadd_ps(p3, _mm256_permute_ps(columns, 0xFF), result01);
+                    _mm256_storeu_ps(result + c * 4, result01);
+                }
+            }
+        }
+
+        /// composes the transforms 4 at a time, the remaining ones are left to the caller
+        uint32_t composeTransformsSSE(const glm::vec3* positions, const glm::vec3* rotations, const glm::vec3* scales,
+                                      glm::mat4* results, uint32_t count) {
+            TRSLanes lanes;
+            uint32_t i = 0;
+            for (; i + 4 <= count; i += 4){
+                loadLanes(lanes, positions + i, rotations + i, scales + i, 4);
+                __m128 cx = _mm_load_ps(lanes.cosX), sx = _mm_load_ps(lanes.sinX);
+                __m128 cy = _mm_load_ps(lanes.cosY), sy = _mm_load_ps(lanes.sinY);
+                __m128 cz = _mm_load_ps(lanes.cosZ), sz = _mm_load_ps(lanes.sinZ);
+
+                // quaternion of the euler angles, same as glm::quat(vec3)
+                __m128 cxcy = _mm_mul_ps(cx, cy), sxsy = _mm_mul_ps(sx, sy);
+                __m128 sxcy = _mm_mul_ps(sx, cy), cxsy = _mm_mul_ps(cx, sy);
+                __m128 qw = _mm_add_ps(_mm_mul_ps(cxcy, cz), _mm_mul_ps(sxsy, sz));
+                __m128 qx = _mm_sub_ps(_mm_mul_ps(sxcy, cz), _mm_mul_ps(cxsy, sz));
+                __m128 qy = _mm_add_ps(_mm_mul_ps(cxsy, cz), _mm_mul_ps(sxcy, sz));
+                __m128 qz = _mm_sub_ps(_mm_mul_ps(cxcy, sz), _mm_mul_ps(sxsy, cz));
+
+                // rotation matrix of the quaternion, same as glm::toMat4
+                __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f), zero = _mm_setzero_ps();
+                __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+                __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+                __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+                // the rotation columns are scaled
+                __m128 scale = _mm_load_ps(lanes.scaleX);
+                storeColumn(results + i, 0,
+                            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scale),
+                            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scale),
+                            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scale),
+                            zero);
+                scale = _mm_load_ps(lanes.scaleY);
+                storeColumn(results + i, 1,
+                            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scale),
+                            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scale),
+                            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scale),
+                            zero);
+                scale = _mm_load_ps(lanes.scaleZ);
+                storeColumn(results + i, 2,
+                            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scale),
+                            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scale),
+                            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scale),
+                            zero);
+                storeColumn(results + i, 3, _mm_load_ps(lanes.posX), _mm_load_ps(lanes.posY), _mm_load_ps(lanes.posZ), one);
+            }
+            return i;
+        }
+
+        /// composes the transforms 8 at a time, the remaining ones are left to the caller
+        VELCRO_TARGET_AVX2
+        uint32_t composeTransformsAVX2(const glm::vec3* positions, const glm::vec3* rotations, const glm::vec3* scales,
+                                       glm::mat4* results, uint32_t count) {
+            TRSLanes lanes;
+            uint32_t i = 0;
+            for (; i + 8 <= count; i += 8){
+                loadLanes(lanes, positions + i, rotations + i, scales + i, 8);
+                __m256 cx = _mm256_load_ps(lanes.cosX), sx = _mm256_load_ps(lanes.sinX);
+                __m256 cy = _mm256_load_ps(lanes.cosY), sy = _mm256_load_ps(lanes.sinY);
+                __m256 cz = _mm256_load_ps(lanes.cosZ), sz = _mm256_load_ps(lanes.sinZ);
+
+                // quaternion of the euler angles, same as glm::quat(vec3)
+                __m256 cxcy = _mm256_mul_ps(cx, cy), sxsy = _mm256_mul_ps(sx, sy);
+                __m256 sxcy = _mm256_mul_ps(sx, cy), cxsy = _mm256_mul_ps(cx, sy);
+                __m256 qw = _mm256_fmadd_ps(cxcy, cz, _mm256_mul_ps(sxsy, sz));
+                __m256 qx = _mm256_fmsub_ps(sxcy, cz, _mm256_mul_ps(cxsy, sz));
+                __m256 qy = _mm256_fmadd_ps(cxsy, cz, _mm256_mul_ps(sxcy, sz));
+                __m256 qz = _mm256_fmsub_ps(cxcy, sz, _mm256_mul_ps(sxsy, cz));
+
+                // rotation matrix of the quaternion, same as glm::toMat4. The columns are scaled
+                __m256 one = _mm256_set1_ps(1.f), two = _mm256_set1_ps(2.f);
+                __m256 xx = _mm256_mul_ps(qx, qx), yy = _mm256_mul_ps(qy, qy), zz = _mm256_mul_ps(qz, qz);
+                __m256 xy = _mm256_mul_ps(qx, qy), xz = _mm256_mul_ps(qx, qz), yz = _mm256_mul_ps(qy, qz);
+                __m256 wx = _mm256_mul_ps(qw, qx), wy = _mm256_mul_ps(qw, qy), wz = _mm256_mul_ps(qw, qz);
+
+                __m256 scale = _mm256_load_ps(lanes.scaleX);
+                __m256 c0x = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(yy, zz), one), scale);
+                __m256 c0y = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), scale);
+                __m256 c0z = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), scale);
+                scale = _mm256_load_ps(lanes.scaleY);
+                __m256 c1x = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), scale);
+                __m256 c1y = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, zz), one), scale);
+                __m256 c1z = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), scale);
+                scale = _mm256_load_ps(lanes.scaleZ);
+                __m256 c2x = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), scale);
+                __m256 c2y = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), scale);
+                __m256 c2z = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, yy), one), scale);
+                __m256 c3x = _mm256_load_ps(lanes.posX), c3y = _mm256_load_ps(lanes.posY), c3z = _mm256_load_ps(lanes.posZ);
+
+                // the lower and upper halves hold the first and last 4 matrices
+                __m128 zero = _mm_setzero_ps(), one4 = _mm_set1_ps(1.f);
+                storeColumn(results + i, 0, _mm256_castps256_ps128(c0x), _mm256_castps256_ps128(c0y), _mm256_castps256_ps128(c0z), zero);
+                storeColumn(results + i, 1, _mm256_castps256_ps128(c1x), _mm256_castps256_ps128(c1y), _mm256_castps256_ps128(c1z), zero);
+                storeColumn(results + i, 2, _mm256_castps256_ps128(c2x), _mm256_castps256_ps128(c2y), _mm256_castps256_ps128(c2z), zero);
+                storeColumn(results + i, 3, _mm256_castps256_ps128(c3x), _mm256_castps256_ps128(c3y), _mm256_castps256_ps128(c3z), one4);
+                storeColumn(results + i + 4, 0, _mm256_extractf128_ps(c0x, 1), _mm256_extractf128_ps(c0y, 1), _mm256_extractf128_ps(c0z, 1), zero);
+                storeColumn(results + i + 4, 1, _mm256_extractf128_ps(c1x, 1), _mm256_extractf128_ps(c1y, 1), _mm256_extractf128_ps(c1z, 1), zero);
+                storeColumn(results + i + 4, 2, _mm256_extractf128_ps(c2x, 1), _mm256_extractf128_ps(c2y, 1), _mm256_extractf128_ps(c2z, 1), zero);
+                storeColumn(results + i + 4, 3, _mm256_extractf128_ps(c3x, 1), _mm256_extractf128_ps(c3y, 1), _mm256_extractf128_ps(c3z, 1), one4);
+            }
+            return i;
+        }
+    }
+#endif
+
+    SimdLevel getSimdLevel() {
+#ifdef VELCRO_SIMD_X86
+        static const SimdLevel level = detectSimdLevel();
+        return level;
+#else
+        return SimdLevel::SCALAR;
+#endif
+    }
+
+    void multiplyTransforms(const glm::mat4* parents, const glm::mat4* children, glm::mat4* results, uint32_t count,
+                            SimdLevel level) {
+#ifdef VELCRO_SIMD_X86
+        if (level == SimdLevel::AVX2)
+            return multiplyTransformsAVX2(parents, children, results, count);
+        if (level == SimdLevel::SSE)
+            return multiplyTransformsSSE(parents, children, results, count);
+#endif
+        for (uint32_t i = 0; i < count; ++i)
+            results[i] = parents[i] * children[i];
+    }
+
+    void composeTransforms(const glm::vec3* positions, const glm::vec3* rotations, const glm::vec3* scales,
+                           glm::mat4* results, uint32_t count, SimdLevel level) {
+        uint32_t done = 0;
+#ifdef VELCRO_SIMD_X86
+        if (level == SimdLevel::AVX2)
+            done = composeTransformsAVX2(positions, rotations, scales, results, count);
+        else if (level == SimdLevel::SSE)
+            done = composeTransformsSSE(positions, rotations, scales, results, count);
+#endif
+        // the remaining transforms that don't fill a vector
+        for (uint32_t i = done; i < count; ++i)
+            results[i] = calculateModelMatrix(positions[i], scales[i], rotations[i]);
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+
+/// Batched transform kernels. Every kernel has a scalar, an SSE and an AVX2 (+ FMA) version, the best one supported by
+/// the CPU is selected at runtime
+namespace utils {
+
+    enum class SimdLevel {
+        SCALAR = 0,
+        SSE,        ///< SSE2, always available on x64
+        AVX2,       ///< AVX2 + FMA
+    };
+
+    /// best instruction set supported by the CPU and the OS, detected once
+    SimdLevel getSimdLevel();
+
+    /// results[i] = parents[i] * children[i]. Results can alias children, not parents
+    void multiplyTransforms(const glm::mat4* parents, const glm::mat4* children, glm::mat4* results, uint32_t count,
+                            SimdLevel level = getSimdLevel());
+
+    /// results[i] = calculateModelMatrix(positions[i], scales[i], rotations[i]) (translate * rotate * scale). The
+    /// rotations are euler angles in radians
+    void composeTransforms(const glm::vec3* positions, const glm::vec3* rotations, const glm::vec3* scales,
+                           glm::mat4* results, uint32_t count, SimdLevel level = getSimdLevel());
+}
@@ -11,6 +11,15 @@ namespace utils{
         return vec.size() * sizeof(vec[0]);
     }
 
+    /// removes the element at index by moving the last element in its place, the order isn't kept. Mirrors the
+    /// removals of SparseSet on the arrays parallel to its components
+    template<typename T>
+    void swapRemove(std::vector<T>& vec, uint32_t index){
+        if (index != vec.size() - 1)
+            vec[index] = std::move(vec.back());
+        vec.pop_back();
+    }
+
     /// returns true if the two given floating (simple or double precision) numbers are almost equal
     template<typename T>
     bool almostEqual(T a, T b) {
@@ -4,6 +4,7 @@
 
 #include "UtilsVulkan.h"
 #include "../Render/Factory/FactoryVulkan.h"
+#include "../Render/UploadService.h"
 
 namespace utils {
     bool isInstanceExtensionSupported(const char* extension) {
@@ -103,6 +104,29 @@ namespace utils {
         return 0;
     }
 
+    uint32_t getTransferQueueFamilyIndex(VkPhysicalDevice device) {
+        uint32_t count;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &count, nullptr);
+        std::vector<VkQueueFamilyProperties> properties(count);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &count, properties.data());
+
+        // dedicated transfer family (usually backed by the DMA engines)
+        for (uint32_t i = 0; i < properties.size(); ++i) {
+            if ((properties[i].queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                !(properties[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+                return i;
+        }
+
+        // async compute family, compute queues implicitly support transfer
+        for (uint32_t i = 0; i < properties.size(); ++i) {
+            if ((properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+                return i;
+        }
+
+        // share the graphics family
+        return getQueueFamilyIndex(device, VK_QUEUE_GRAPHICS_BIT);
+    }
+
     void printQueueFamiliesInfo(VkPhysicalDevice device) {
         uint32_t count;
         vkGetPhysicalDeviceQueueFamilyProperties(device, &count, nullptr);
@@ -211,8 +235,7 @@ namespace utils {
         return newExtent;
     }
 
-    bool transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool pool, VkImage image, VkFormat format,
-                               VkImageLayout oldLayout, VkImageLayout newLayout) {
+    bool transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout) {
         VkImageMemoryBarrier memoryBarrier = {
                 .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
                 .oldLayout = oldLayout,
@@ -245,9 +268,10 @@ namespace utils {
             memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
             srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 
-            // transition must happen before the fragment shader tries to read the image
-            memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-            dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            // recorded on the transfer queue, which does not support the shader stages. The graphics queue waits on the
+            // upload timeline semaphore before reading the image, which makes the writes visible
+            memoryBarrier.dstAccessMask = VK_ACCESS_NONE;
+            dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
         }
         else {
             VK_ASSERT(false, "Non supported transfer formats");
@@ -255,27 +279,24 @@ namespace utils {
         }
 
         // use a pipeline barrier (between stages) to transition the layouts
-        executeOnQueueSync(queue, device, pool, [&](VkCommandBuffer commandBuffer){
-            vkCmdPipelineBarrier(commandBuffer,
-                                 srcStage,                          // src stage (used with given srcAccessMask)
-                                 dstStage,                          // dst stage (used with given dstAccessMask)
-                                 0,                                 // dependency flags (could use by region)
-                                 0, nullptr,                        // memory barriers
-                                 0, nullptr,                        // buffer memory barriers
-                                 1, &memoryBarrier                  // image barriers
-            );
-        });
-
-
-
-
+        vkCmdPipelineBarrier(commandBuffer,
+                             srcStage,                          // src stage (used with given srcAccessMask)
+                             dstStage,                          // dst stage (used with given dstAccessMask)
+                             0,                                 // dependency flags (could use by region)
+                             0, nullptr,                        // memory barriers
+                             0, nullptr,                        // buffer memory barriers
+                             1, &memoryBarrier                  // image barriers
+        );
         return true;
     }
 
     uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
         VkPhysicalDeviceMemoryProperties memProperties;
         vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+        return findMemoryType(memProperties, typeFilter, properties);
+    }
 
+    uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties& memProperties, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
         // NOTE : we could also check the heap types in the mem properties
         for (size_t i = 0; i < memProperties.memoryTypeCount; ++i) {
             if (((1 << i) & typeFilter) &&
@@ -292,32 +313,9 @@ namespace utils {
         if (data == nullptr || size == 0)
             return false;
 
-        // create staging buffet to transfer
-        auto stagingBuffer = Factory::createBuffer(vrd->device, vrd->physicalDevice, size,
-                                                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-
-        // copy from data -> staging buffer
-        void *dst;
-        VK_CHECK(vkMapMemory(vrd->device, stagingBuffer.second, 0, size, 0u, &dst));
-        memcpy(dst, data, size);
-        vkUnmapMemory(vrd->device, stagingBuffer.second);
-
-
-        // copy from staging buffer -> device local buffer
-        utils::executeOnQueueSync(vrd->graphicsQueue, vrd->device, vrd->commandPool, [=](VkCommandBuffer commandBuffer){
-            VkBufferCopy bufferCopy = {
-                    .srcOffset = 0,
-                    .dstOffset = 0,
-                    .size = size
-            };
-            vkCmdCopyBuffer(commandBuffer, stagingBuffer.first, buffer, 1, &bufferCopy);
-        });
-
-        // destroy staging buffer
-        vkFreeMemory(vrd->device, stagingBuffer.second, nullptr);
-        vkDestroyBuffer(vrd->device, stagingBuffer.first, nullptr);
-
+        // data is copied to staging memory right away, the copy to the device local buffer is batched. The buffer is
+        // used right away, the next frame waits on it
+        vrd->uploadService->requireForFrame(vrd->uploadService->uploadBuffer(buffer, data, size));
         return true;
     }
 
@@ -22,6 +22,8 @@ namespace utils {
 
     // Queue
     uint32_t getQueueFamilyIndex(VkPhysicalDevice device, VkQueueFlagBits queueFlags);
+    /// returns a transfer only family if available, then a family without graphics, then the graphics family
+    uint32_t getTransferQueueFamilyIndex(VkPhysicalDevice device);
     void printQueueFamiliesInfo(VkPhysicalDevice device);
     void executeOnQueueSync(VkQueue queue, VkDevice device, VkCommandPool pool,const std::function<void(VkCommandBuffer)>& commands);
 
@@ -31,11 +33,13 @@ namespace utils {
     VkExtent2D pickSwapchainExtent(const VkSurfaceCapabilitiesKHR& surfaceCapabilites, int frameBufferW, int frameBufferH);
 
     // images
-    bool transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool pool,
-                               VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+    /// records a layout transition of a color image in the given command buffer
+    bool transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout);
 
     // Memory
     uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties& memProperties, uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    /// records the copy in the upload service. The copy is done before the next submitted frame is rendered
     bool copyToDeviceLocalBuffer(VulkanRenderDevice* vrd, VkBuffer buffer, void* data, uint32_t size);
 
     // format